@@ -0,0 +1,102 @@
+/*
+* Helpers for the animation keyframe lookup benchmark
+*
+* Synthetic clips with a large number of irregularly spaced keys, used to compare the time spent in Model::updateAnimation
+* using a linear key search (as done before key cursors were added), cursor based lookup, binary search (random seeks) and
+* clips resampled to a uniform rate
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include "VulkanglTFModel.h"
+
+namespace vkglTF
+{
+	namespace benchmark
+	{
+		// Creates a model with one node per channel and a single animation, alternating translation and rotation channels
+		inline void createSyntheticAnimation(Model& model, uint32_t channelCount, uint32_t keyCount)
+		{
+			std::mt19937 rng(1234);
+			std::uniform_real_distribution<float> jitter(0.5f, 1.5f);
+			std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+			Animation animation{};
+			animation.name = "synthetic";
+			for (uint32_t c = 0; c < channelCount; c++) {
+				Node* node = new Node{};
+				node->index = c;
+				node->transforms = &model.transforms;
+				node->transformIndex = model.transforms.add(-1);
+				model.nodes.push_back(node);
+				model.linearNodes.push_back(node);
+
+				AnimationChannel channel{};
+				channel.path = (c % 2 == 0) ? AnimationChannel::PathType::TRANSLATION : AnimationChannel::PathType::ROTATION;
+				channel.node = node;
+				channel.samplerIndex = c;
+
+				AnimationSampler sampler{};
+				sampler.interpolation = AnimationSampler::InterpolationType::LINEAR;
+				float time = 0.0f;
+				for (uint32_t k = 0; k < keyCount; k++) {
+					sampler.inputs.push_back(time);
+					if (channel.path == AnimationChannel::PathType::ROTATION) {
+						sampler.outputsVec4.push_back(glm::normalize(glm::vec4(value(rng), value(rng), value(rng), 1.0f)));
+					} else {
+						sampler.outputsVec4.push_back(glm::vec4(value(rng), value(rng), value(rng), 0.0f));
+					}
+					// Irregular spacing around 30 keys per second
+					time += jitter(rng) / 30.0f;
+				}
+				animation.start = std::min(animation.start, sampler.inputs.front());
+				animation.end = std::max(animation.end, sampler.inputs.back());
+				animation.samplers.push_back(sampler);
+				animation.channels.push_back(channel);
+			}
+			model.animations.push_back(animation);
+			model.linkNodes();
+		}
+
+		// Key lookup as done before key cursors were added, scanning all keys of a sampler for every channel
+		inline void updateAnimationLinearScan(Model& model, uint32_t index, float time)
+		{
+			Animation& animation = model.animations[index];
+			bool updated = false;
+			for (auto& channel : animation.channels) {
+				AnimationSampler& sampler = animation.samplers[channel.samplerIndex];
+				for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
+					if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
+						if (channel.path == AnimationChannel::PathType::ROTATION) {
+							sampler.rotate(i, time, channel.node);
+						} else {
+							sampler.translate(i, time, channel.node);
+						}
+						updated = true;
+					}
+				}
+			}
+			if (updated) {
+				model.updateTransforms();
+			}
+		}
+
+		// Returns the average time per update in milliseconds
+		inline double measure(const std::vector<float>& times, const std::function<void(float)>& update)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			for (float time : times) {
+				update(time);
+			}
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			return std::chrono::duration<double, std::milli>(tEnd - tStart).count() / static_cast<double>(times.size());
+		}
+	}
+}
@@ -0,0 +1,234 @@
+/*
+* Frame time benchmark
+*
+* Records per-frame times over a fixed number of frames after a warmup period, computes statistics and exports them
+* along with the full series as CSV or JSON
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <utility>
+#include "VulkanUtils.hpp"
+
+namespace vks
+{
+	class FrameBenchmark
+	{
+	public:
+		struct Statistics {
+			double min = 0.0;
+			double avg = 0.0;
+			double p50 = 0.0;
+			double p95 = 0.0;
+			double p99 = 0.0;
+			double max = 0.0;
+		};
+
+		// A named series of per-frame times in milliseconds, negative values mark frames without a measurement
+		struct Series {
+			std::string name;
+			std::vector<double> values;
+		};
+
+		bool active = false;
+		uint32_t warmupFrames = 100;
+		uint32_t frameCount = 1000;
+		// Fixed time step in seconds used for animations instead of the measured frame time
+		float timestep = 1.0f / 60.0f;
+		// Camera orbit speed in degrees per second (of benchmark time)
+		float orbitSpeed = 20.0f;
+		// Results are written as CSV if the file name ends with .csv, as JSON otherwise
+		std::string outputFileName = "benchmark.json";
+		// Device, scene and settings written along with the results
+		std::vector<std::pair<std::string, std::string>> info;
+		std::vector<Series> series;
+
+		// Number of frames rendered since the benchmark started, including the warmup
+		uint32_t frame = 0;
+
+		/** @brief Returns true if the current frame is measured */
+		bool recording() const
+		{
+			return active && (frame >= warmupFrames) && (frame < warmupFrames + frameCount);
+		}
+
+		/** @brief Returns true once all frames have been rendered */
+		bool finished() const
+		{
+			return active && (frame >= warmupFrames + frameCount);
+		}
+
+		/** @brief Time since the benchmark started (including the warmup) in seconds */
+		float time() const
+		{
+			return static_cast<float>(frame) * timestep;
+		}
+
+		/** @brief Index of the current frame in the measured series */
+		uint32_t sampleIndex() const
+		{
+			return frame - warmupFrames;
+		}
+
+		/**
+		* Add a series of per-frame times
+		*
+		* @param name Name used for the column in the exported results
+		*
+		* @return Index of the series
+		*/
+		size_t addSeries(const std::string& name)
+		{
+			series.push_back({ name, std::vector<double>(frameCount, -1.0) });
+			return series.size() - 1;
+		}
+
+		/**
+		* Store a time for a measured frame, this can also be done after the frame has advanced (e.g. for GPU times read back later)
+		*
+		* @param seriesIndex Index of the series returned by addSeries
+		* @param sampleIndex Index of the frame in the series
+		* @param value Time in milliseconds
+		*/
+		void setValue(size_t seriesIndex, uint32_t sampleIndex, double value)
+		{
+			if (sampleIndex < series[seriesIndex].values.size()) {
+				series[seriesIndex].values[sampleIndex] = value;
+			}
+		}
+
+		void addInfo(const std::string& key, const std::string& value)
+		{
+			info.push_back({ key, value });
+		}
+
+		/** @brief Computes statistics for all valid values of a series, percentiles use the nearest rank */
+		static Statistics getStatistics(const std::vector<double>& values)
+		{
+			Statistics statistics{};
+			std::vector<double> sorted;
+			for (double value : values) {
+				if (value >= 0.0) {
+					sorted.push_back(value);
+				}
+			}
+			if (sorted.empty()) {
+				return statistics;
+			}
+			std::sort(sorted.begin(), sorted.end());
+			auto percentile = [&sorted](double p) {
+				const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+				return sorted[std::min(std::max(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+			};
+			statistics.min = sorted.front();
+			statistics.max = sorted.back();
+			statistics.avg = std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size());
+			statistics.p50 = percentile(50.0);
+			statistics.p95 = percentile(95.0);
+			statistics.p99 = percentile(99.0);
+			return statistics;
+		}
+
+		void printSummary() const
+		{
+			std::cout << "Benchmark results for " << frameCount << " frames (" << warmupFrames << " warmup frames):\n";
+			std::cout << std::fixed << std::setprecision(3);
+			for (auto& s : series) {
+				const Statistics statistics = getStatistics(s.values);
+				std::cout << "  " << std::left << std::setw(6) << s.name << std::right << " min " << statistics.min << " / avg " << statistics.avg << " / p50 " << statistics.p50 << " / p95 " << statistics.p95 << " / p99 " << statistics.p99 << " / max " << statistics.max << " ms\n";
+			}
+			std::cout.unsetf(std::ios::floatfield);
+		}
+
+		/** @brief Writes the results to the output file, the format depends on the file extension */
+		bool save() const
+		{
+			std::ofstream file(outputFileName);
+			if (!file.is_open()) {
+				std::cerr << "Could not write benchmark results to \"" << outputFileName << "\"\n";
+				return false;
+			}
+			file << std::setprecision(6);
+			const std::string extension = ".csv";
+			const bool csv = (outputFileName.size() >= extension.size()) && (outputFileName.compare(outputFileName.size() - extension.size(), extension.size(), extension) == 0);
+			if (csv) {
+				writeCSV(file);
+			} else {
+				writeJSON(file);
+			}
+			std::cout << "Benchmark results written to \"" << outputFileName << "\"\n";
+			return true;
+		}
+
+	private:
+		// Info and statistics are written as comment lines in front of the per-frame values
+		void writeCSV(std::ofstream& file) const
+		{
+			for (auto& entry : info) {
+				file << "# " << entry.first << ": " << entry.second << "\n";
+			}
+			for (auto& s : series) {
+				const Statistics statistics = getStatistics(s.values);
+				file << "# " << s.name << " ms: min " << statistics.min << ", avg " << statistics.avg << ", p50 " << statistics.p50 << ", p95 " << statistics.p95 << ", p99 " << statistics.p99 << ", max " << statistics.max << "\n";
+			}
+			file << "frame";
+			for (auto& s : series) {
+				file << "," << s.name << "_ms";
+			}
+			file << "\n";
+			for (uint32_t i = 0; i < frameCount; i++) {
+				file << i;
+				for (auto& s : series) {
+					file << ",";
+					if (s.values[i] >= 0.0) {
+						file << s.values[i];
+					}
+				}
+				file << "\n";
+			}
+		}
+
+		void writeJSON(std::ofstream& file) const
+		{
+			file << "{\n";
+			for (auto& entry : info) {
+				file << "\t\"" << escapeJSON(entry.first) << "\": \"" << escapeJSON(entry.second) << "\",\n";
+			}
+			file << "\t\"warmupFrames\": " << warmupFrames << ",\n";
+			file << "\t\"frameCount\": " << frameCount << ",\n";
+			file << "\t\"statistics\": {\n";
+			for (size_t i = 0; i < series.size(); i++) {
+				const Statistics statistics = getStatistics(series[i].values);
+				file << "\t\t\"" << escapeJSON(series[i].name) << "\": { \"min\": " << statistics.min << ", \"avg\": " << statistics.avg << ", \"p50\": " << statistics.p50 << ", \"p95\": " << statistics.p95 << ", \"p99\": " << statistics.p99 << ", \"max\": " << statistics.max << " }" << ((i + 1 < series.size()) ? "," : "") << "\n";
+			}
+			file << "\t},\n";
+			file << "\t\"frames\": {\n";
+			for (size_t i = 0; i < series.size(); i++) {
+				file << "\t\t\"" << escapeJSON(series[i].name) << "\": [";
+				for (size_t j = 0; j < series[i].values.size(); j++) {
+					// Frames without a measurement are written as null
+					if (series[i].values[j] >= 0.0) {
+						file << series[i].values[j];
+					} else {
+						file << "null";
+					}
+					file << ((j + 1 < series[i].values.size()) ? ", " : "");
+				}
+				file << "]" << ((i + 1 < series.size()) ? "," : "") << "\n";
+			}
+			file << "\t}\n";
+			file << "}\n";
+		}
+	};
+}
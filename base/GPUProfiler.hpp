@@ -0,0 +1,216 @@
+/*
+* GPU timestamp profiler
+*
+* Measures the GPU time of named scopes using timestamp queries. Each frame in flight uses its own range of queries, so
+* results can be read back without stalling once the frame's fence has signaled
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "vulkan/vulkan.h"
+#include "macros.h"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	class GPUProfiler
+	{
+	public:
+		struct Result {
+			std::string name;
+			// Nesting level, the root scope of a frame has a depth of zero
+			uint32_t depth;
+			// Time in milliseconds, scopes with the same name and depth that are recorded multiple times in a frame are added up
+			double time;
+		};
+
+		bool supported = false;
+
+		/**
+		* Create the query pool
+		*
+		* @param device Device to create the query pool on, timestamps are written on its graphics queue
+		* @param frameCount Number of frames that can be in flight at the same time
+		* @param (Optional) maxScopes Maximum number of scopes per frame including the root scope, additional scopes are ignored
+		*
+		* @return True if timestamps are supported
+		*/
+		bool create(vks::VulkanDevice* device, uint32_t frameCount, uint32_t maxScopes = 32)
+		{
+			this->device = device;
+			this->maxScopes = maxScopes;
+			const uint32_t validBits = device->queueFamilyProperties[device->queueFamilyIndices.graphics].timestampValidBits;
+			supported = (device->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (validBits > 0);
+			if (!supported) {
+				return false;
+			}
+			timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+			timestampPeriod = device->properties.limits.timestampPeriod;
+			frames.resize(frameCount);
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = frameCount * maxScopes * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &queryPool));
+			return true;
+		}
+
+		void destroy()
+		{
+			if (queryPool != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+				queryPool = VK_NULL_HANDLE;
+			}
+			frames.clear();
+			results.clear();
+			supported = false;
+		}
+
+		/**
+		* Reset the queries of a frame and begin its root scope, needs to be called outside of a render pass
+		*
+		* @param commandBuffer Command buffer of the frame
+		* @param frame Index of the frame in flight
+		* @param (Optional) name Name of the root scope
+		*/
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame, const std::string& name = "Frame")
+		{
+			if (!supported) {
+				return;
+			}
+			currentFrame = frame;
+			frames[frame].scopes.clear();
+			frames[frame].stack.clear();
+			vkCmdResetQueryPool(commandBuffer, queryPool, frame * maxScopes * 2, maxScopes * 2);
+			beginScope(commandBuffer, name);
+		}
+
+		/** @brief Closes all open scopes of the current frame, results can be read once the command buffer has been executed */
+		void endFrame(VkCommandBuffer commandBuffer)
+		{
+			if (!supported) {
+				return;
+			}
+			while (!frames[currentFrame].stack.empty()) {
+				endScope(commandBuffer);
+			}
+			frames[currentFrame].pending = true;
+		}
+
+		void beginScope(VkCommandBuffer commandBuffer, const std::string& name)
+		{
+			if (!supported) {
+				return;
+			}
+			Frame& frame = frames[currentFrame];
+			if (frame.scopes.size() >= maxScopes) {
+				// Out of queries, the matching endScope call is ignored
+				frame.stack.push_back(UINT32_MAX);
+				return;
+			}
+			const uint32_t index = static_cast<uint32_t>(frame.scopes.size());
+			frame.scopes.push_back({ name, static_cast<uint32_t>(frame.stack.size()) });
+			frame.stack.push_back(index);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, getQuery(currentFrame, index));
+		}
+
+		void endScope(VkCommandBuffer commandBuffer)
+		{
+			if (!supported || frames[currentFrame].stack.empty()) {
+				return;
+			}
+			Frame& frame = frames[currentFrame];
+			const uint32_t index = frame.stack.back();
+			frame.stack.pop_back();
+			if (index != UINT32_MAX) {
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, getQuery(currentFrame, index) + 1);
+			}
+		}
+
+		/**
+		* Read the results of a frame if it has been recorded since its last read
+		*
+		* @param frame Index of the frame in flight
+		* @param (Optional) wait Wait for the results, otherwise results that aren't available yet stay pending and can be read by a later call
+		*
+		* @return True if new results are available through getResults
+		*/
+		bool readResults(uint32_t frame, bool wait = false)
+		{
+			if (!supported || !frames[frame].pending) {
+				return false;
+			}
+			Frame& data = frames[frame];
+			const uint32_t queryCount = static_cast<uint32_t>(data.scopes.size()) * 2;
+			timestamps.resize(queryCount);
+			const VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | (wait ? VK_QUERY_RESULT_WAIT_BIT : 0);
+			const VkResult queryResult = vkGetQueryPoolResults(device->logicalDevice, queryPool, getQuery(frame, 0), queryCount, queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), flags);
+			// Results that aren't available yet stay pending, so a later call can still read them
+			if (queryResult == VK_NOT_READY) {
+				return false;
+			}
+			data.pending = false;
+			VK_CHECK_RESULT(queryResult);
+			if (queryResult != VK_SUCCESS) {
+				return false;
+			}
+			results.clear();
+			for (size_t i = 0; i < data.scopes.size(); i++) {
+				const uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+				const double time = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+				const Scope& scope = data.scopes[i];
+				auto result = std::find_if(results.begin(), results.end(), [&scope](const Result& r) { return (r.name == scope.name) && (r.depth == scope.depth); });
+				if (result != results.end()) {
+					result->time += time;
+				} else {
+					results.push_back({ scope.name, scope.depth, time });
+				}
+			}
+			return true;
+		}
+
+		/** @brief Results of the last frame read with readResults, in the order the scopes were first recorded */
+		const std::vector<Result>& getResults() const
+		{
+			return results;
+		}
+
+		/** @brief Time of the root scope of the last frame read in milliseconds */
+		double getFrameTime() const
+		{
+			return results.empty() ? 0.0 : results[0].time;
+		}
+
+	private:
+		struct Scope {
+			std::string name;
+			uint32_t depth;
+		};
+		struct Frame {
+			std::vector<Scope> scopes;
+			// Indices of the open scopes
+			std::vector<uint32_t> stack;
+			bool pending = false;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		uint32_t maxScopes = 0;
+		uint32_t currentFrame = 0;
+		uint64_t timestampMask = ~0ull;
+		float timestampPeriod = 1.0f;
+		std::vector<Frame> frames;
+		std::vector<uint64_t> timestamps;
+		std::vector<Result> results;
+
+		uint32_t getQuery(uint32_t frame, uint32_t scope) const
+		{
+			return (frame * maxScopes + scope) * 2;
+		}
+	};
+}
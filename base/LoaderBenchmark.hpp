@@ -0,0 +1,518 @@
+/*
+* glTF loader and animation CPU benchmark
+*
+* Runs the CPU stages of the glTF loader (parsing, node construction, accessor conversion, skins and animations) and the
+* per-frame CPU work (animation updates, transform hierarchy updates and mesh data packing) on sample files and synthetic
+* scenes and reports their throughput. No Vulkan instance or device is created, so this also runs on machines without a GPU
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "VulkanglTFModel.h"
+#include "VulkanUtils.hpp"
+#include "AnimationBenchmark.hpp"
+
+namespace vkglTF
+{
+	namespace benchmark
+	{
+		// Appends data to the first buffer of a model and adds a tightly packed accessor for it, returns the index of the accessor
+		inline int addAccessor(tinygltf::Model& gltfModel, const void* data, size_t size, int componentType, int type, size_t count)
+		{
+			if (gltfModel.buffers.empty()) {
+				gltfModel.buffers.push_back(tinygltf::Buffer{});
+			}
+			tinygltf::Buffer& buffer = gltfModel.buffers[0];
+			tinygltf::BufferView bufferView{};
+			bufferView.buffer = 0;
+			bufferView.byteOffset = buffer.data.size();
+			bufferView.byteLength = size;
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			buffer.data.insert(buffer.data.end(), bytes, bytes + size);
+			// Keep all views 4 byte aligned
+			buffer.data.resize((buffer.data.size() + 3) & ~static_cast<size_t>(3));
+			gltfModel.bufferViews.push_back(bufferView);
+
+			tinygltf::Accessor accessor{};
+			accessor.bufferView = static_cast<int>(gltfModel.bufferViews.size()) - 1;
+			accessor.byteOffset = 0;
+			accessor.componentType = componentType;
+			accessor.type = type;
+			accessor.count = count;
+			gltfModel.accessors.push_back(accessor);
+			return static_cast<int>(gltfModel.accessors.size()) - 1;
+		}
+
+		/**
+		* Create a scene with a number of skinned and animated characters, built the same way as a parsed glTF file
+		*
+		* @param gltfModel Model to fill
+		* @param characterCount Number of characters, each with its own node hierarchy, skin and animation channels
+		* @param jointCount Number of joints per character, joints are arranged as a binary tree
+		* @param gridSize Number of vertices along each side of the skinned grid mesh shared by all characters
+		* @param keyCount Number of keys per animation channel
+		*/
+		inline void createSyntheticScene(tinygltf::Model& gltfModel, uint32_t characterCount, uint32_t jointCount, uint32_t gridSize, uint32_t keyCount)
+		{
+			gltfModel = tinygltf::Model{};
+			gltfModel.materials.push_back(tinygltf::Material{});
+
+			// Skinned grid mesh, each row of vertices is weighted to two neighbouring joints
+			const uint32_t vertexCount = gridSize * gridSize;
+			std::vector<float> positions(vertexCount * 3);
+			std::vector<float> normals(vertexCount * 3);
+			std::vector<float> uvs(vertexCount * 2);
+			std::vector<uint16_t> joints(vertexCount * 4, 0);
+			std::vector<float> weights(vertexCount * 4, 0.0f);
+			for (uint32_t y = 0; y < gridSize; y++) {
+				for (uint32_t x = 0; x < gridSize; x++) {
+					const uint32_t v = y * gridSize + x;
+					const float u = static_cast<float>(x) / static_cast<float>(gridSize - 1);
+					const float w = static_cast<float>(y) / static_cast<float>(gridSize - 1);
+					positions[v * 3 + 0] = u - 0.5f;
+					positions[v * 3 + 1] = w;
+					positions[v * 3 + 2] = 0.0f;
+					normals[v * 3 + 2] = 1.0f;
+					uvs[v * 2 + 0] = u;
+					uvs[v * 2 + 1] = w;
+					const uint32_t joint = std::min(static_cast<uint32_t>(w * static_cast<float>(jointCount - 1)), jointCount - 1);
+					joints[v * 4 + 0] = static_cast<uint16_t>(joint);
+					joints[v * 4 + 1] = static_cast<uint16_t>(std::min(joint + 1, jointCount - 1));
+					weights[v * 4 + 0] = 0.5f;
+					weights[v * 4 + 1] = 0.5f;
+				}
+			}
+			std::vector<uint32_t> indices;
+			indices.reserve((gridSize - 1) * (gridSize - 1) * 6);
+			for (uint32_t y = 0; y < gridSize - 1; y++) {
+				for (uint32_t x = 0; x < gridSize - 1; x++) {
+					const uint32_t v = y * gridSize + x;
+					indices.insert(indices.end(), { v, v + 1, v + gridSize, v + 1, v + gridSize + 1, v + gridSize });
+				}
+			}
+
+			tinygltf::Primitive primitive{};
+			primitive.material = 0;
+			primitive.attributes["POSITION"] = addAccessor(gltfModel, positions.data(), positions.size() * sizeof(float), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+			gltfModel.accessors.back().minValues = { -0.5, 0.0, 0.0 };
+			gltfModel.accessors.back().maxValues = { 0.5, 1.0, 0.0 };
+			primitive.attributes["NORMAL"] = addAccessor(gltfModel, normals.data(), normals.size() * sizeof(float), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+			primitive.attributes["TEXCOORD_0"] = addAccessor(gltfModel, uvs.data(), uvs.size() * sizeof(float), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, vertexCount);
+			primitive.attributes["JOINTS_0"] = addAccessor(gltfModel, joints.data(), joints.size() * sizeof(uint16_t), TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_VEC4, vertexCount);
+			primitive.attributes["WEIGHTS_0"] = addAccessor(gltfModel, weights.data(), weights.size() * sizeof(float), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4, vertexCount);
+			primitive.indices = addAccessor(gltfModel, indices.data(), indices.size() * sizeof(uint32_t), TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, indices.size());
+			tinygltf::Mesh mesh{};
+			mesh.name = "grid";
+			mesh.primitives.push_back(primitive);
+			gltfModel.meshes.push_back(mesh);
+
+			// Inverse bind matrices are shared by all skins
+			std::vector<glm::mat4> inverseBindMatrices(jointCount, glm::mat4(1.0f));
+			const int inverseBindAccessor = addAccessor(gltfModel, inverseBindMatrices.data(), inverseBindMatrices.size() * sizeof(glm::mat4), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_MAT4, jointCount);
+
+			// Key times and values are shared by all channels, but still converted per channel by the loader
+			std::vector<float> times(keyCount);
+			std::vector<glm::vec4> rotations(keyCount);
+			std::vector<glm::vec3> translations(keyCount);
+			for (uint32_t k = 0; k < keyCount; k++) {
+				const float angle = static_cast<float>(k) / static_cast<float>(keyCount) * 6.2831853f;
+				times[k] = static_cast<float>(k) / 30.0f;
+				rotations[k] = glm::vec4(0.0f, std::sin(angle * 0.5f), 0.0f, std::cos(angle * 0.5f));
+				translations[k] = glm::vec3(std::sin(angle), 0.0f, 0.0f);
+			}
+			const int timeAccessor = addAccessor(gltfModel, times.data(), times.size() * sizeof(float), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, keyCount);
+			const int rotationAccessor = addAccessor(gltfModel, rotations.data(), rotations.size() * sizeof(glm::vec4), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4, keyCount);
+			const int translationAccessor = addAccessor(gltfModel, translations.data(), translations.size() * sizeof(glm::vec3), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, keyCount);
+
+			tinygltf::Animation animation{};
+			animation.name = "synthetic";
+			auto addChannel = [&](int node, const std::string& path, int output) {
+				tinygltf::AnimationSampler sampler{};
+				sampler.input = timeAccessor;
+				sampler.output = output;
+				sampler.interpolation = "LINEAR";
+				animation.samplers.push_back(sampler);
+				tinygltf::AnimationChannel channel{};
+				channel.sampler = static_cast<int>(animation.samplers.size()) - 1;
+				channel.target_node = node;
+				channel.target_path = path;
+				animation.channels.push_back(channel);
+			};
+
+			tinygltf::Scene scene{};
+			for (uint32_t c = 0; c < characterCount; c++) {
+				// Character root, followed by its joints and the skinned mesh node
+				const int root = static_cast<int>(gltfModel.nodes.size());
+				const int firstJoint = root + 1;
+				const int meshNode = firstJoint + static_cast<int>(jointCount);
+				tinygltf::Node rootNode{};
+				rootNode.name = "character_" + std::to_string(c);
+				rootNode.translation = { static_cast<double>(c % 32) * 2.0, 0.0, static_cast<double>(c / 32) * 2.0 };
+				rootNode.children = { firstJoint, meshNode };
+				gltfModel.nodes.push_back(rootNode);
+
+				tinygltf::Skin skin{};
+				skin.skeleton = firstJoint;
+				skin.inverseBindMatrices = inverseBindAccessor;
+				for (uint32_t j = 0; j < jointCount; j++) {
+					tinygltf::Node joint{};
+					joint.name = "joint_" + std::to_string(j);
+					joint.translation = { 0.0, (j > 0) ? 0.25 : 0.0, 0.0 };
+					for (uint32_t child = j * 2 + 1; child <= j * 2 + 2; child++) {
+						if (child < jointCount) {
+							joint.children.push_back(firstJoint + static_cast<int>(child));
+						}
+					}
+					gltfModel.nodes.push_back(joint);
+					skin.joints.push_back(firstJoint + static_cast<int>(j));
+					addChannel(firstJoint + static_cast<int>(j), "rotation", rotationAccessor);
+				}
+				addChannel(firstJoint, "translation", translationAccessor);
+				gltfModel.skins.push_back(skin);
+
+				tinygltf::Node mesh{};
+				mesh.name = "mesh_" + std::to_string(c);
+				mesh.mesh = 0;
+				mesh.skin = static_cast<int>(c);
+				gltfModel.nodes.push_back(mesh);
+
+				scene.nodes.push_back(root);
+			}
+			gltfModel.animations.push_back(animation);
+			gltfModel.scenes.push_back(scene);
+			gltfModel.defaultScene = 0;
+		}
+
+		class LoaderBenchmark
+		{
+		public:
+			struct Stage {
+				std::string name;
+				// Average time per iteration (loader stages) or per frame (frame stages) in milliseconds
+				double time;
+				// Number of processed items per iteration or frame, throughput is reported as items per second
+				double items;
+				std::string unit;
+			};
+
+			struct Asset {
+				std::string name;
+				uint32_t nodeCount = 0;
+				size_t vertexCount = 0;
+				size_t indexCount = 0;
+				uint32_t channelCount = 0;
+				std::vector<Stage> stages;
+			};
+
+			// Number of times each asset is loaded, the loader stages are averaged over all iterations
+			uint32_t iterations = 10;
+			// Number of simulated frames for the per-frame stages
+			uint32_t frameCount = 1000;
+			// Fixed time step in seconds used to advance the animation
+			float timestep = 1.0f / 60.0f;
+			std::vector<Asset> assets;
+
+			/**
+			* Parse a glTF file and run all stages on it
+			*
+			* @param fileName Name of the glTF (.gltf or .glb) file
+			*
+			* @return False if the file could not be parsed
+			*/
+			bool runFile(const std::string& fileName)
+			{
+				std::ifstream fileStream(fileName, std::ios::binary | std::ios::ate);
+				if (!fileStream.is_open()) {
+					std::cerr << "Could not open \"" << fileName << "\", skipping\n";
+					return false;
+				}
+				const double fileBytes = static_cast<double>(fileStream.tellg());
+				fileStream.close();
+
+				tinygltf::Model gltfModel;
+				double parseTime = 0.0;
+				for (uint32_t i = 0; i < iterations; i++) {
+					std::string error;
+					std::string warning;
+					gltfModel = tinygltf::Model{};
+					auto tStart = std::chrono::high_resolution_clock::now();
+					if (!Model::parseFile(fileName, gltfModel, error, warning)) {
+						std::cerr << "Could not load gltf file \"" << fileName << "\": " << error << "\n";
+						return false;
+					}
+					parseTime += elapsed(tStart);
+				}
+				Stage parse{ "Parse", parseTime / static_cast<double>(iterations), fileBytes / (1024.0 * 1024.0), "MB" };
+				run(fileName.substr(fileName.find_last_of("/\\") + 1), gltfModel, &parse);
+				return true;
+			}
+
+			/**
+			* Run the loader and per-frame stages on an already parsed model
+			*
+			* @param name Name used in the results
+			* @param gltfModel Parsed (or synthetic) glTF model
+			* @param (Optional) parse Time of the parse stage if the model has been loaded from a file
+			*/
+			void run(const std::string& name, tinygltf::Model& gltfModel, const Stage* parse = nullptr)
+			{
+				Asset asset{};
+				asset.name = name;
+				if (parse) {
+					asset.stages.push_back(*parse);
+				}
+				if (gltfModel.scenes.empty()) {
+					std::cerr << "\"" << name << "\" contains no scene, skipping\n";
+					return;
+				}
+				const tinygltf::Scene& scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+
+				// Node construction without any mesh data, the difference to the full node load is the accessor conversion
+				tinygltf::Model hierarchy{};
+				hierarchy.nodes = gltfModel.nodes;
+				for (auto& node : hierarchy.nodes) {
+					node.mesh = -1;
+				}
+
+				double nodeTime = 0.0;
+				double loadTime = 0.0;
+				double skinTime = 0.0;
+				double animationTime = 0.0;
+				Model model{};
+				for (uint32_t i = 0; i < iterations; i++) {
+					Model nodesOnly{};
+					Model::LoaderInfo emptyInfo{};
+					auto tNodes = std::chrono::high_resolution_clock::now();
+					for (int node : scene.nodes) {
+						nodesOnly.loadNode(nullptr, hierarchy.nodes[node], node, hierarchy, emptyInfo, 1.0f);
+					}
+					nodeTime += elapsed(tNodes);
+					nodesOnly.destroy(VK_NULL_HANDLE);
+
+					destroyModel(model);
+					// Materials only store texture pointers, placeholders are enough as no textures are loaded
+					model.textures.resize(gltfModel.textures.size());
+					model.loadMaterials(gltfModel);
+					size_t vertexCount = 0;
+					size_t indexCount = 0;
+					for (int node : scene.nodes) {
+						model.getNodeProps(gltfModel.nodes[node], gltfModel, vertexCount, indexCount);
+					}
+					std::vector<Model::Vertex> vertexBuffer(vertexCount);
+					std::vector<uint32_t> indexBuffer(indexCount);
+					Model::LoaderInfo loaderInfo{};
+					loaderInfo.vertexBuffer = vertexBuffer.data();
+					loaderInfo.indexBuffer = indexBuffer.data();
+					auto tLoad = std::chrono::high_resolution_clock::now();
+					for (int node : scene.nodes) {
+						model.loadNode(nullptr, gltfModel.nodes[node], node, gltfModel, loaderInfo, 1.0f);
+					}
+					loadTime += elapsed(tLoad);
+					auto tAnimations = std::chrono::high_resolution_clock::now();
+					model.loadAnimations(gltfModel);
+					animationTime += elapsed(tAnimations);
+					auto tSkins = std::chrono::high_resolution_clock::now();
+					model.loadSkins(gltfModel);
+					skinTime += elapsed(tSkins);
+					model.linkNodes();
+					model.updateTransforms(true);
+					asset.vertexCount = vertexCount;
+					asset.indexCount = indexCount;
+				}
+
+				asset.nodeCount = static_cast<uint32_t>(model.linearNodes.size());
+				uint32_t jointCount = 0;
+				for (auto skin : model.skins) {
+					jointCount += static_cast<uint32_t>(skin->joints.size());
+				}
+				for (auto& animation : model.animations) {
+					asset.channelCount += static_cast<uint32_t>(animation.channels.size());
+				}
+				const double n = static_cast<double>(iterations);
+				asset.stages.push_back({ "Node construction", nodeTime / n, static_cast<double>(asset.nodeCount), "nodes" });
+				asset.stages.push_back({ "Accessor conversion", std::max(loadTime - nodeTime, 0.0) / n, static_cast<double>(asset.vertexCount), "vertices" });
+				asset.stages.push_back({ "Skins", skinTime / n, static_cast<double>(jointCount), "joints" });
+				asset.stages.push_back({ "Animations", animationTime / n, static_cast<double>(asset.channelCount), "channels" });
+
+				runFrames(model, asset);
+
+				destroyModel(model);
+				assets.push_back(asset);
+			}
+
+			/**
+			* Compare the keyframe lookup strategies of Model::updateAnimation on synthetic clips, each stage is one strategy
+			*
+			* @param channelCount Number of animated channels
+			* @param keyCount Number of irregularly spaced keys per channel
+			* @param (Optional) sampleRate Rate in keys per second used for the resampled clip
+			*/
+			void runKeyframeLookup(uint32_t channelCount, uint32_t keyCount, float sampleRate = 30.0f)
+			{
+				Model model{};
+				createSyntheticAnimation(model, channelCount, keyCount);
+				Model resampledModel{};
+				createSyntheticAnimation(resampledModel, channelCount, keyCount);
+				resampledModel.resampleAnimations(sampleRate);
+
+				const float start = model.animations[0].start;
+				const float duration = model.animations[0].end - start;
+
+				// Regular playback, advancing the time by a fixed step and looping several times over the clip
+				std::vector<float> playbackTimes(frameCount);
+				for (uint32_t i = 0; i < frameCount; i++) {
+					playbackTimes[i] = start + std::fmod(static_cast<float>(i) * duration / 500.0f, duration);
+				}
+				// Random seeks, which always miss the cursor and fall back to the binary search
+				std::mt19937 rng(4321);
+				std::uniform_real_distribution<float> seek(start, start + duration);
+				std::vector<float> seekTimes(frameCount);
+				for (auto& time : seekTimes) {
+					time = seek(rng);
+				}
+
+				Asset asset{};
+				asset.name = "Keyframe lookup (" + std::to_string(keyCount) + " keys)";
+				asset.nodeCount = channelCount;
+				asset.channelCount = channelCount;
+				const double channels = static_cast<double>(channelCount);
+				asset.stages.push_back({ "Linear scan", measure(playbackTimes, [&](float time) { updateAnimationLinearScan(model, 0, time); }), channels, "channels" });
+				asset.stages.push_back({ "Cursor (playback)", measure(playbackTimes, [&](float time) { model.updateAnimation(0, time); }), channels, "channels" });
+				asset.stages.push_back({ "Binary search (seek)", measure(seekTimes, [&](float time) { model.updateAnimation(0, time); }), channels, "channels" });
+				asset.stages.push_back({ "Uniform (resampled)", measure(playbackTimes, [&](float time) { resampledModel.updateAnimation(0, time); }), channels, "channels" });
+
+				model.destroy(VK_NULL_HANDLE);
+				resampledModel.destroy(VK_NULL_HANDLE);
+				assets.push_back(asset);
+			}
+
+			void print() const
+			{
+				std::cout << "glTF loader benchmark (" << iterations << " load iterations, " << frameCount << " frames):\n";
+				std::cout << std::fixed;
+				for (auto& asset : assets) {
+					std::cout << asset.name << ": " << asset.nodeCount << " nodes, " << asset.vertexCount << " vertices, " << asset.indexCount << " indices, " << asset.channelCount << " animation channels\n";
+					for (auto& stage : asset.stages) {
+						std::cout << "  " << std::left << std::setw(22) << stage.name << std::right << std::setprecision(3) << std::setw(10) << stage.time << " ms";
+						if ((stage.time > 0.0) && (stage.items > 0.0)) {
+							std::cout << std::setprecision(2) << std::setw(16) << throughput(stage) << " " << stage.unit << "/s";
+						}
+						std::cout << "\n";
+					}
+				}
+				std::cout.unsetf(std::ios::floatfield);
+			}
+
+			/** @brief Writes the results of all assets as JSON */
+			bool save(const std::string& fileName) const
+			{
+				std::ofstream file(fileName);
+				if (!file.is_open()) {
+					std::cerr << "Could not write benchmark results to \"" << fileName << "\"\n";
+					return false;
+				}
+				file << std::setprecision(6);
+				file << "{\n";
+				file << "\t\"iterations\": " << iterations << ",\n";
+				file << "\t\"frameCount\": " << frameCount << ",\n";
+				file << "\t\"assets\": [\n";
+				for (size_t i = 0; i < assets.size(); i++) {
+					const Asset& asset = assets[i];
+					file << "\t\t{\n";
+					file << "\t\t\t\"name\": \"" << escapeJSON(asset.name) << "\",\n";
+					file << "\t\t\t\"nodes\": " << asset.nodeCount << ",\n";
+					file << "\t\t\t\"vertices\": " << asset.vertexCount << ",\n";
+					file << "\t\t\t\"indices\": " << asset.indexCount << ",\n";
+					file << "\t\t\t\"channels\": " << asset.channelCount << ",\n";
+					file << "\t\t\t\"stages\": [\n";
+					for (size_t j = 0; j < asset.stages.size(); j++) {
+						const Stage& stage = asset.stages[j];
+						file << "\t\t\t\t{ \"name\": \"" << escapeJSON(stage.name) << "\", \"ms\": " << stage.time << ", \"" << stage.unit << "PerSecond\": " << throughput(stage) << " }" << ((j + 1 < asset.stages.size()) ? "," : "") << "\n";
+					}
+					file << "\t\t\t]\n";
+					file << "\t\t}" << ((i + 1 < assets.size()) ? "," : "") << "\n";
+				}
+				file << "\t]\n";
+				file << "}\n";
+				std::cout << "Benchmark results written to \"" << fileName << "\"\n";
+				return true;
+			}
+
+		private:
+			static double elapsed(std::chrono::high_resolution_clock::time_point start)
+			{
+				return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+
+			static double throughput(const Stage& stage)
+			{
+				return (stage.time > 0.0) ? stage.items / (stage.time / 1000.0) : 0.0;
+			}
+
+			// The placeholder textures have no device, so they must not be destroyed
+			static void destroyModel(Model& model)
+			{
+				model.textures.clear();
+				model.destroy(VK_NULL_HANDLE);
+			}
+
+			// Per-frame CPU work as done by the application for a single animated model
+			void runFrames(Model& model, Asset& asset)
+			{
+				std::vector<ShaderMeshData> meshData;
+				std::vector<glm::mat3x4> jointData;
+				std::vector<const Mesh*> meshes;
+				for (auto node : model.linearNodes) {
+					if (node->mesh) {
+						ShaderMeshData data{};
+						data.jointOffset = static_cast<uint32_t>(jointData.size());
+						data.jointCount = node->mesh->jointcount;
+						jointData.resize(jointData.size() + node->mesh->jointcount);
+						meshData.push_back(data);
+						meshes.push_back(node->mesh);
+					}
+				}
+				const double frames = static_cast<double>(frameCount);
+
+				// Animation playback, includes the transform and mesh updates of the animated nodes
+				if (!model.animations.empty()) {
+					const Animation& animation = model.animations[0];
+					const float duration = std::max(animation.end - animation.start, 0.0001f);
+					auto tAnimation = std::chrono::high_resolution_clock::now();
+					for (uint32_t i = 0; i < frameCount; i++) {
+						model.updateAnimation(0, animation.start + std::fmod(static_cast<float>(i) * timestep, duration));
+					}
+					asset.stages.push_back({ "updateAnimation", elapsed(tAnimation) / frames, static_cast<double>(animation.channels.size()), "channels" });
+				}
+
+				// Full update of the transform hierarchy, all meshes and bounds, as done when every node has moved
+				auto tTransforms = std::chrono::high_resolution_clock::now();
+				for (uint32_t i = 0; i < frameCount; i++) {
+					std::fill(model.transforms.dirty.begin(), model.transforms.dirty.end(), 1);
+					model.updateTransforms(true);
+				}
+				asset.stages.push_back({ "Transform update", elapsed(tTransforms) / frames, static_cast<double>(asset.nodeCount), "nodes" });
+
+				// Packing of the mesh matrices and joint palettes into the shader data of all meshes
+				auto tPacking = std::chrono::high_resolution_clock::now();
+				for (uint32_t i = 0; i < frameCount; i++) {
+					for (size_t m = 0; m < meshes.size(); m++) {
+						packMeshData(*meshes[m], meshData[m], jointData.data());
+					}
+				}
+				asset.stages.push_back({ "Mesh data packing", elapsed(tPacking) / frames, static_cast<double>(meshes.size() + jointData.size()), "matrices" });
+			}
+		};
+	}
+}
@@ -0,0 +1,181 @@
+/*
+* CPU scope tracing
+*
+* Scoped markers record their start time and duration into a buffer owned by the recording thread, so recording doesn't
+* need any locks. The recorded events can be saved in the Chrome trace event format for viewing in chrome://tracing or Perfetto
+*
+* Markers are only compiled in if VKS_ENABLE_TRACING is defined, recording also needs to be enabled at runtime
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <iostream>
+
+#if defined(VKS_ENABLE_TRACING)
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include "VulkanUtils.hpp"
+#endif
+
+namespace vks
+{
+	namespace trace
+	{
+#if defined(VKS_ENABLE_TRACING)
+		namespace detail
+		{
+			struct Event {
+				// Names need to have static storage duration (e.g. string literals)
+				const char* name;
+				// Start and duration in nanoseconds, relative to the time tracing was enabled
+				int64_t start;
+				int64_t duration;
+			};
+
+			struct ThreadBuffer {
+				uint32_t id;
+				std::string name;
+				std::vector<Event> events;
+			};
+
+			// Buffers are owned by the registry and outlive their threads, the mutex is only taken when a thread records its first event
+			struct Registry {
+				std::mutex mutex;
+				std::vector<std::unique_ptr<ThreadBuffer>> threads;
+				std::atomic<bool> enabled{ false };
+				std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+			};
+
+			inline Registry& registry()
+			{
+				static Registry registry;
+				return registry;
+			}
+
+			inline ThreadBuffer& threadBuffer()
+			{
+				thread_local ThreadBuffer* buffer = nullptr;
+				if (!buffer) {
+					Registry& reg = registry();
+					std::lock_guard<std::mutex> lock(reg.mutex);
+					reg.threads.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+					buffer = reg.threads.back().get();
+					buffer->id = static_cast<uint32_t>(reg.threads.size());
+					buffer->name = (buffer->id == 1) ? "Main thread" : "Thread " + std::to_string(buffer->id);
+					buffer->events.reserve(4096);
+				}
+				return *buffer;
+			}
+
+			inline int64_t now()
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count();
+			}
+		}
+
+		/** @brief Start recording events, the thread calling this is listed as the main thread */
+		inline void enable()
+		{
+			detail::Registry& reg = detail::registry();
+			reg.epoch = std::chrono::steady_clock::now();
+			detail::threadBuffer();
+			reg.enabled = true;
+		}
+
+		inline bool enabled()
+		{
+			return detail::registry().enabled.load(std::memory_order_relaxed);
+		}
+
+		/** @brief Name the calling thread in the saved trace */
+		inline void setThreadName(const std::string& name)
+		{
+			if (enabled()) {
+				detail::threadBuffer().name = name;
+			}
+		}
+
+		class Scope
+		{
+		public:
+			explicit Scope(const char* name) : name(name), active(enabled())
+			{
+				if (active) {
+					start = detail::now();
+				}
+			}
+			~Scope()
+			{
+				if (active) {
+					detail::threadBuffer().events.push_back({ name, start, detail::now() - start });
+				}
+			}
+		private:
+			const char* name;
+			bool active;
+			int64_t start = 0;
+		};
+
+		/**
+		* Save all recorded events as a Chrome trace event JSON file
+		*
+		* @param fileName Name of the file to write
+		*
+		* @note No other thread may record events while saving, e.g. call this after all worker threads have been joined
+		*
+		* @return True if the file has been written
+		*/
+		inline bool save(const std::string& fileName)
+		{
+			detail::Registry& reg = detail::registry();
+			std::ofstream file(fileName);
+			if (!file.is_open()) {
+				std::cerr << "Could not write trace to \"" << fileName << "\"\n";
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			size_t eventCount = 0;
+			file << std::fixed << std::setprecision(3);
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			bool first = true;
+			for (auto& thread : reg.threads) {
+				file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id << ",\"args\":{\"name\":\"" << escapeJSON(thread->name) << "\"}}";
+				first = false;
+				// Timestamps and durations are stored in microseconds
+				for (auto& event : thread->events) {
+					file << ",\n{\"name\":\"" << escapeJSON(event.name) << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+				}
+				eventCount += thread->events.size();
+			}
+			file << "\n]}\n";
+			std::cout << "Saved " << eventCount << " trace events from " << reg.threads.size() << " threads to \"" << fileName << "\"\n";
+			return true;
+		}
+#else
+		inline void enable()
+		{
+			std::cerr << "CPU tracing is not available, it needs to be enabled at compile time (VKS_ENABLE_TRACING)\n";
+		}
+		inline bool enabled() { return false; }
+		inline void setThreadName(const std::string&) {}
+		inline bool save(const std::string&) { return false; }
+#endif
+	}
+}
+
+#if defined(VKS_ENABLE_TRACING)
+#define VKS_TRACE_CONCAT_INNER(a, b) a##b
+#define VKS_TRACE_CONCAT(a, b) VKS_TRACE_CONCAT_INNER(a, b)
+// Records the time from this line to the end of the enclosing block
+#define VKS_TRACE_SCOPE(name) vks::trace::Scope VKS_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define VKS_TRACE_SCOPE(name)
+#endif
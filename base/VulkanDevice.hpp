@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <cstring>
 #include <vector>
+#include <string>
 #include "vulkan/vulkan.h"
 
 #if defined(VK_USE_PLATFORM_MACOS_MVK) && (VK_HEADER_VERSION >= 216)
@@ -26,6 +27,7 @@
 #endif
 
 #include "macros.h"
+#include "VulkanMemoryAllocator.hpp"
 
 namespace vks
 {	
@@ -38,8 +40,11 @@ namespace vks
 		VkPhysicalDeviceFeatures enabledFeatures;
 		VkPhysicalDeviceMemoryProperties memoryProperties;
 		std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+		std::vector<std::string> supportedExtensions;
 		VkCommandPool commandPool = VK_NULL_HANDLE;
 		bool requiresStaging = true;
+		// Sub-allocates device memory for all buffers and images created on this device
+		vks::MemoryAllocator* memoryAllocator = nullptr;
 
 		struct {
 			uint32_t graphics;
@@ -72,6 +77,18 @@ namespace vks
 			queueFamilyProperties.resize(queueFamilyCount);
 			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties.data());
 
+			// Get list of supported extensions
+			uint32_t extCount = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, nullptr);
+			if (extCount > 0) {
+				std::vector<VkExtensionProperties> extensions(extCount);
+				if (vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, &extensions.front()) == VK_SUCCESS) {
+					for (auto& ext : extensions) {
+						supportedExtensions.push_back(ext.extensionName);
+					}
+				}
+			}
+
 			// Check if the device has a host accesible device local buffer
 			// That either means BAR (max. 256 MByte) or ReBAR (SAM)/Integrated GPU with access to all memory
 			// But even 256 MByte is more than enough, and such a memory type saves us from having to stage memory
@@ -93,6 +110,7 @@ namespace vks
 			if (commandPool) {
 				vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
 			}
+			delete memoryAllocator;
 			if (logicalDevice) {
 				vkDestroyDevice(logicalDevice, nullptr);
 			}
@@ -169,11 +187,14 @@ namespace vks
 		* Create the logical device based on the assigned physical device, also gets default queue family indices
 		*
 		* @param enabledFeatures Can be used to enable certain features upon device creation
+		* @param enabledExtensions Device extensions to be enabled in addition to the swapchain extension
+		* @param (Optional) pNextChain Chain of extension feature structures to be passed to device creation
 		* @param requestedQueueTypes Bit flags specifying the queue types to be requested from the device  
+		* @param useSwapChain Set to false for headless rendering to omit the swapchain extension
 		*
 		* @return VkResult of the device creation call
 		*/
-		VkResult createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char*> enabledExtensions, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)
+		VkResult createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char*> enabledExtensions, void* pNextChain = nullptr, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, bool useSwapChain = true)
 		{			
 			// Desired queues need to be requested upon logical device creation
 			// Due to differing queue family configurations of Vulkan implementations this can be a bit tricky, especially if the application
@@ -218,7 +239,9 @@ namespace vks
 
 			// Create the logical device representation
 			std::vector<const char*> deviceExtensions(enabledExtensions);
-			deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+			if (useSwapChain) {
+				deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+			}
 
 #if defined(VK_USE_PLATFORM_MACOS_MVK) && (VK_HEADER_VERSION >= 216)
             deviceExtensions.push_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
@@ -230,6 +253,16 @@ namespace vks
 			deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 			deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
+			// If a pNext chain has been passed, the core features need to be passed as part of it
+			VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2{};
+			if (pNextChain) {
+				physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+				physicalDeviceFeatures2.features = enabledFeatures;
+				physicalDeviceFeatures2.pNext = pNextChain;
+				deviceCreateInfo.pEnabledFeatures = nullptr;
+				deviceCreateInfo.pNext = &physicalDeviceFeatures2;
+			}
+
 			if (deviceExtensions.size() > 0) {
 				deviceCreateInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
 				deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
@@ -239,6 +272,7 @@ namespace vks
 
 			if (result == VK_SUCCESS) {
 				commandPool = createCommandPool(queueFamilyIndices.graphics);
+				memoryAllocator = new vks::MemoryAllocator(logicalDevice, physicalDevice);
 			}
 
 			this->enabledFeatures = enabledFeatures;
@@ -246,6 +280,54 @@ namespace vks
 			return result;
 		}
 
+		/**
+		* Check if an extension is supported by the (physical device)
+		*
+		* @param extension Name of the extension to check
+		*
+		* @return True if the extension is supported (present in the list read at device creation time)
+		*/
+		bool extensionSupported(std::string extension)
+		{
+			return (std::find(supportedExtensions.begin(), supportedExtensions.end(), extension) != supportedExtensions.end());
+		}
+
+		/**
+		* Check if a format supports all of the requested features
+		*
+		* @param format Format to check
+		* @param tiling Image tiling the features are required for
+		* @param features Bitmask of required format features
+		*
+		* @return True if the format supports all requested features for the given tiling
+		*/
+		bool formatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features)
+		{
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+			const VkFormatFeatureFlags supportedFeatures = (tiling == VK_IMAGE_TILING_OPTIMAL) ? formatProperties.optimalTilingFeatures : formatProperties.linearTilingFeatures;
+			return (supportedFeatures & features) == features;
+		}
+
+		/**
+		* Select the first format from a list of candidates that supports all of the requested features
+		*
+		* @param candidates Formats to check in order of preference
+		* @param tiling Image tiling the features are required for
+		* @param features Bitmask of required format features
+		*
+		* @return The first supported format, or VK_FORMAT_UNDEFINED if none of the candidates is supported
+		*/
+		VkFormat getSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+		{
+			for (VkFormat format : candidates) {
+				if (formatSupported(format, tiling, features)) {
+					return format;
+				}
+			}
+			return VK_FORMAT_UNDEFINED;
+		}
+
 		/**
 		* Create a buffer on the device
 		*
@@ -253,12 +335,14 @@ namespace vks
 		* @param memoryPropertyFlags Memory properties for this buffer (i.e. device local, host visible, coherent)
 		* @param size Size of the buffer in byes
 		* @param buffer Pointer to the buffer handle acquired by the function
-		* @param memory Pointer to the memory handle acquired by the function
+		* @param allocation Pointer to the memory allocation acquired by the function, needs to be freed with freeMemory
 		* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
+		* @param (Optional) strategy Allocation strategy, use AllocationStrategy::Linear for short-lived buffers like staging buffers
+		* @param (Optional) category Category the buffer's memory is accounted under
 		*
 		* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
 		*/
-		VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data = nullptr, VkDeviceSize *actualBufferSize = nullptr)
+		VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, vks::Allocation *allocation, void *data = nullptr, VkDeviceSize *actualBufferSize = nullptr, vks::AllocationStrategy strategy = vks::AllocationStrategy::FreeList, vks::MemoryCategory category = vks::MemoryCategory::Other)
 		{
 			// Create the buffer handle
 			VkBufferCreateInfo bufferCreateInfo{};
@@ -268,37 +352,25 @@ namespace vks
 			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, buffer));
 
-			// Create the memory backing up the buffer handle
+			// Sub-allocate the memory backing up the buffer handle
 			VkMemoryRequirements memReqs;
-			VkMemoryAllocateInfo memAlloc{};
-			memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 			vkGetBufferMemoryRequirements(logicalDevice, *buffer, &memReqs);
-			memAlloc.allocationSize = memReqs.size;
-			// Find a memory type index that fits the properties of the buffer
-			memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
+			*allocation = memoryAllocator->allocate(memReqs, memoryPropertyFlags, vks::ResourceType::Linear, strategy, category);
 			
-			// If a pointer to the buffer data has been passed, map the buffer and copy over the data
+			// If a pointer to the buffer data has been passed, copy over the data using the persistent mapping
 			if (data != nullptr)
 			{
-				void *mapped;
-				VK_CHECK_RESULT(vkMapMemory(logicalDevice, *memory, 0, size, 0, &mapped));
-				memcpy(mapped, data, size);
+				assert(allocation->mapped);
+				memcpy(allocation->mapped, data, size);
 				// If host coherency hasn't been requested, do a manual flush to make writes visible
 				if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
 				{
-					VkMappedMemoryRange mappedRange{};
-					mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-					mappedRange.memory = *memory;
-					mappedRange.offset = 0;
-					mappedRange.size = memReqs.size;
-					vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
+					flushMemory(*allocation);
 				}
-				vkUnmapMemory(logicalDevice, *memory);
 			}
 
 			// Attach the memory to the buffer object
-			VK_CHECK_RESULT(vkBindBufferMemory(logicalDevice, *buffer, *memory, 0));
+			VK_CHECK_RESULT(vkBindBufferMemory(logicalDevice, *buffer, allocation->memory, allocation->offset));
 
 			if (actualBufferSize) {
 				*actualBufferSize = memReqs.size;
@@ -307,6 +379,54 @@ namespace vks
 			return VK_SUCCESS;
 		}
 
+		/**
+		* Allocate and bind the memory for an image
+		*
+		* @param image Image to allocate memory for
+		* @param memoryPropertyFlags Memory properties for the image
+		* @param allocation Pointer to the memory allocation acquired by the function, needs to be freed with freeMemory
+		* @param (Optional) category Category the image's memory is accounted under
+		* @param (Optional) tiling Tiling the image has been created with
+		*/
+		void allocateImageMemory(VkImage image, VkMemoryPropertyFlags memoryPropertyFlags, vks::Allocation *allocation, vks::MemoryCategory category = vks::MemoryCategory::Other, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL)
+		{
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+			*allocation = memoryAllocator->allocate(memReqs, memoryPropertyFlags, (tiling == VK_IMAGE_TILING_OPTIMAL) ? vks::ResourceType::Optimal : vks::ResourceType::Linear, vks::AllocationStrategy::FreeList, category);
+			VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, image, allocation->memory, allocation->offset));
+		}
+
+		/**
+		* Return an allocation to the memory allocator
+		*
+		* @param allocation Allocation to free, is reset afterwards
+		*/
+		void freeMemory(vks::Allocation &allocation)
+		{
+			memoryAllocator->free(allocation);
+		}
+
+		/**
+		* Flush a range of a host visible, non-coherent allocation to make host writes visible to the device
+		*
+		* @param allocation Allocation to flush
+		* @param (Optional) size Size of the range to flush, relative to the start of the allocation
+		* @param (Optional) offset Offset of the range to flush, relative to the start of the allocation
+		*/
+		VkResult flushMemory(const vks::Allocation &allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
+		{
+			// Ranges passed to vkFlushMappedMemoryRanges must be multiples of nonCoherentAtomSize, the allocator aligns non-coherent allocations accordingly
+			const VkDeviceSize atomSize = properties.limits.nonCoherentAtomSize;
+			const VkDeviceSize start = offset / atomSize * atomSize;
+			const VkDeviceSize end = (size == VK_WHOLE_SIZE) ? allocation.size : std::min(allocation.size, (offset + size + atomSize - 1) / atomSize * atomSize);
+			VkMappedMemoryRange mappedRange{};
+			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			mappedRange.memory = allocation.memory;
+			mappedRange.offset = allocation.offset + start;
+			mappedRange.size = end - start;
+			return vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
+		}
+
 		/** 
 		* Create a command pool for allocation command buffers from
 		* 
@@ -48,9 +48,11 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 	appInfo.pEngineName = name.c_str();
 	appInfo.apiVersion = VK_API_VERSION_1_0;
 
-	std::vector<const char*> instanceExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+	std::vector<const char*> instanceExtensions;
 
-	// Enable surface extensions depending on os
+	// Enable surface extensions depending on os, these are not required when rendering headless
+	if (!settings.headless) {
+		instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #if defined(_WIN32)
 	instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -64,12 +66,36 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 #elif defined(VK_USE_PLATFORM_MACOS_MVK)
 	instanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
 #endif
+	}
 
 #if defined(VK_USE_PLATFORM_MACOS_MVK) && (VK_HEADER_VERSION >= 216)
     instanceExtensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
     instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 #endif
 
+	// Get extensions supported by the instance
+	uint32_t extCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extCount, nullptr);
+	if (extCount > 0) {
+		std::vector<VkExtensionProperties> extensions(extCount);
+		if (vkEnumerateInstanceExtensionProperties(nullptr, &extCount, &extensions.front()) == VK_SUCCESS) {
+			for (VkExtensionProperties& extension : extensions) {
+				supportedInstanceExtensions.push_back(extension.extensionName);
+			}
+		}
+	}
+
+	// Enable extensions requested by the application
+	for (const char* enabledExtension : enabledInstanceExtensions) {
+		if (std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), enabledExtension) == supportedInstanceExtensions.end()) {
+			std::cerr << "Enabled instance extension \"" << enabledExtension << "\" is not present at instance level\n";
+			continue;
+		}
+		if (std::find_if(instanceExtensions.begin(), instanceExtensions.end(), [&](const char* extension) { return strcmp(extension, enabledExtension) == 0; }) == instanceExtensions.end()) {
+			instanceExtensions.push_back(enabledExtension);
+		}
+	}
+
 	VkInstanceCreateInfo instanceCreateInfo = {};
 	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instanceCreateInfo.pNext = NULL;
@@ -79,11 +105,11 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
     instanceCreateInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
 #endif
 
+	if (settings.validation) {
+		instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	}
 	if (instanceExtensions.size() > 0)
 	{
-		if (settings.validation) {
-			instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-		}
 		instanceCreateInfo.enabledExtensionCount = (uint32_t)instanceExtensions.size();
 		instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
 	}
@@ -100,8 +126,12 @@ void VulkanExampleBase::prepare()
 	/*
 		Swapchain
 	*/
-	initSwapchain();
-	setupSwapChain();
+	if (settings.headless) {
+		setupHeadlessTarget();
+	} else {
+		initSwapchain();
+		setupSwapChain();
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	width = swapChain.extent.width;
@@ -143,7 +173,7 @@ void VulkanExampleBase::prepare()
 		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[1].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachments[1].finalLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 		// Multisampled depth attachment we render to
 		attachments[2].format = depthFormat;
@@ -224,7 +254,7 @@ void VulkanExampleBase::prepare()
 		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachments[0].finalLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 		// Depth attachment
 		attachments[1].format = depthFormat;
 		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -287,9 +317,7 @@ void VulkanExampleBase::prepare()
 	/*
 		Pipeline cache
 	*/
-	VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
-	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	loadPipelineCache();
 
 	/*
 		Frame buffer
@@ -321,6 +349,17 @@ void VulkanExampleBase::renderLoop()
 {
 	destWidth = width;
 	destHeight = height;
+	if (settings.headless) {
+		// There are no window events to process, so render a fixed number of frames and return
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < settings.headlessFrameCount; i++) {
+			renderFrame();
+		}
+		vkDeviceWaitIdle(device);
+		auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		std::cout << "Rendered " << settings.headlessFrameCount << " headless frames in " << tDiff << " ms (" << tDiff / std::max(settings.headlessFrameCount, 1u) << " ms per frame)\n";
+		return;
+	}
 #if defined(_WIN32)
 	MSG msg;
 	bool quitMessageReceived = false;
@@ -483,6 +522,23 @@ void VulkanExampleBase::renderLoop()
 	vkDeviceWaitIdle(device);
 }
 
+void VulkanExampleBase::requestQuit()
+{
+	// The headless render loop ends after a fixed number of frames
+	if (settings.headless) {
+		return;
+	}
+#if defined(_WIN32)
+	PostQuitMessage(0);
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+	ANativeActivity_finish(androidApp->activity);
+#elif defined(_DIRECT2DISPLAY) || defined(VK_USE_PLATFORM_WAYLAND_KHR) || defined(VK_USE_PLATFORM_XCB_KHR)
+	quit = true;
+#elif defined(VK_USE_PLATFORM_MACOS_MVK)
+	[NSApp terminate:nil];
+#endif
+}
+
 VulkanExampleBase::VulkanExampleBase()
 {
 	char* numConvPtr;
@@ -495,6 +551,9 @@ VulkanExampleBase::VulkanExampleBase()
 		if (args[i] == std::string("-vsync")) {
 			settings.vsync = true;
 		}
+		if (args[i] == std::string("--cold-pipeline-cache")) {
+			settings.coldPipelineCache = true;
+		}
 		if ((args[i] == std::string("-f")) || (args[i] == std::string("--fullscreen"))) {
 			settings.fullscreen = true;
 		}
@@ -506,6 +565,13 @@ VulkanExampleBase::VulkanExampleBase()
 			uint32_t h = strtol(args[i + 1], &numConvPtr, 10);
 			if (numConvPtr != args[i + 1]) { height = h; };
 		}
+		if (args[i] == std::string("--headless")) {
+			settings.headless = true;
+		}
+		if ((args[i] == std::string("--frames")) && (i + 1 < args.size())) {
+			uint32_t frames = strtol(args[i + 1], &numConvPtr, 10);
+			if (numConvPtr != args[i + 1]) { settings.headlessFrameCount = frames; };
+		}
 	}
 	
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -515,9 +581,13 @@ VulkanExampleBase::VulkanExampleBase()
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!settings.headless) {
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!settings.headless) {
+		initxcbConnection();
+	}
 #endif
 
 #if defined(_WIN32)
@@ -534,6 +604,13 @@ VulkanExampleBase::~VulkanExampleBase()
 {
 	// Clean up Vulkan resources
 	swapChain.cleanup();
+	if (settings.headless) {
+		for (uint32_t i = 0; i < swapChain.imageCount; i++) {
+			vkDestroyImageView(device, swapChain.buffers[i].view, nullptr);
+			vkDestroyImage(device, swapChain.images[i], nullptr);
+			vulkanDevice->freeMemory(headlessImageMemory[i]);
+		}
+	}
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 	vkDestroyRenderPass(device, renderPass, nullptr);
 	for (uint32_t i = 0; i < frameBuffers.size(); i++) {
@@ -541,22 +618,26 @@ VulkanExampleBase::~VulkanExampleBase()
 	}
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
-	vkFreeMemory(device, depthStencil.mem, nullptr);
+	vulkanDevice->freeMemory(depthStencil.mem);
+	savePipelineCache();
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 	vkDestroyCommandPool(device, cmdPool, nullptr);
 	if (settings.multiSampling) {
 		vkDestroyImage(device, multisampleTarget.color.image, nullptr);
 		vkDestroyImageView(device, multisampleTarget.color.view, nullptr);
-		vkFreeMemory(device, multisampleTarget.color.memory, nullptr);
+		vulkanDevice->freeMemory(multisampleTarget.color.memory);
 		vkDestroyImage(device, multisampleTarget.depth.image, nullptr);
 		vkDestroyImageView(device, multisampleTarget.depth.view, nullptr);
-		vkFreeMemory(device, multisampleTarget.depth.memory, nullptr);
+		vulkanDevice->freeMemory(multisampleTarget.depth.memory);
 	}
 	delete vulkanDevice;
 	if (settings.validation) {
 		vkDestroyDebugReportCallback(instance, debugReportCallback, nullptr);
 	}
 	vkDestroyInstance(instance, nullptr);
+	if (settings.headless) {
+		return;
+	}
 #if defined(_DIRECT2DISPLAY)
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
 	wl_shell_surface_destroy(shell_surface);
@@ -649,12 +730,11 @@ void VulkanExampleBase::initVulkan()
 		Device creation
 	*/
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
-	VkPhysicalDeviceFeatures enabledFeatures{};
 	if (deviceFeatures.samplerAnisotropy) {
 		enabledFeatures.samplerAnisotropy = VK_TRUE;
 	}
-	std::vector<const char*> enabledExtensions{};
-	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledExtensions);
+	getEnabledFeatures();
+	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, !settings.headless);
 	if (res != VK_SUCCESS) {
 		std::cerr << "Could not create Vulkan device!" << std::endl;
 		exit(res);
@@ -682,7 +762,9 @@ void VulkanExampleBase::initVulkan()
 	}
 	assert(validDepthFormat);
 
-	swapChain.connect(instance, physicalDevice, device);
+	if (!settings.headless) {
+		swapChain.connect(instance, physicalDevice, device);
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Get Android device name and manufacturer (to display along GPU name)
@@ -1897,8 +1979,90 @@ void VulkanExampleBase::windowDidResize()
 }
 #endif
 
+// Pipeline cache data depends on the device and driver, so a separate file is used per device
+std::string VulkanExampleBase::getPipelineCacheFileName()
+{
+	std::stringstream fileName;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	fileName << androidApp->activity->internalDataPath << "/";
+#endif
+	fileName << "pipelinecache_" << std::hex << deviceProperties.vendorID << "_" << deviceProperties.deviceID << ".bin";
+	return fileName.str();
+}
+
+void VulkanExampleBase::loadPipelineCache()
+{
+	std::vector<char> cacheData;
+	const std::string fileName = getPipelineCacheFileName();
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!settings.coldPipelineCache && file.is_open()) {
+		cacheData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0, std::ios::beg);
+		file.read(cacheData.data(), cacheData.size());
+		// Drivers should reject incompatible data themselves, but some don't, so the header is checked against the current device
+		bool valid = cacheData.size() >= sizeof(VkPipelineCacheHeaderVersionOne);
+		if (valid) {
+			VkPipelineCacheHeaderVersionOne header;
+			memcpy(&header, cacheData.data(), sizeof(header));
+			valid = (header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne)) &&
+				(header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+				(header.vendorID == deviceProperties.vendorID) &&
+				(header.deviceID == deviceProperties.deviceID) &&
+				(memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+		}
+		if (!valid) {
+			std::cout << "Pipeline cache " << fileName << " was created by a different device or driver and will be discarded\n";
+			cacheData.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+	pipelineCacheCreateInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	pipelineCacheWarm = !cacheData.empty();
+}
+
+void VulkanExampleBase::savePipelineCache()
+{
+	size_t dataSize = 0;
+	if ((vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) || (dataSize == 0)) {
+		return;
+	}
+	std::vector<char> cacheData(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS) {
+		return;
+	}
+	const std::string fileName = getPipelineCacheFileName();
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "Could not write pipeline cache to " << fileName << std::endl;
+		return;
+	}
+	file.write(cacheData.data(), dataSize);
+}
+
+VkResult VulkanExampleBase::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pipelineCI, VkPipeline* pipeline)
+{
+	auto tStart = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, pipeline);
+	pipelineCreationTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	return result;
+}
+
+VkResult VulkanExampleBase::createComputePipeline(const VkComputePipelineCreateInfo& pipelineCI, VkPipeline* pipeline)
+{
+	auto tStart = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, pipeline);
+	pipelineCreationTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	return result;
+}
+
 void VulkanExampleBase::windowResized() {}
 
+void VulkanExampleBase::getEnabledFeatures() {}
+
 void VulkanExampleBase::setupFrameBuffer()
 {
 	/*
@@ -1926,16 +2090,9 @@ void VulkanExampleBase::setupFrameBuffer()
 
 		VkMemoryRequirements memReqs;
 		vkGetImageMemoryRequirements(device, multisampleTarget.color.image, &memReqs);
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.allocationSize = memReqs.size;
 		VkBool32 lazyMemTypePresent;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
-		if (!lazyMemTypePresent) {
-			memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &multisampleTarget.color.memory));
-		vkBindImageMemory(device, multisampleTarget.color.image, multisampleTarget.color.memory, 0);
+		vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
+		vulkanDevice->allocateImageMemory(multisampleTarget.color.image, lazyMemTypePresent ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &multisampleTarget.color.memory, vks::MemoryCategory::RenderTargets);
 
 		// Create image view for the MSAA target
 		VkImageViewCreateInfo imageViewCI{};
@@ -1968,14 +2125,8 @@ void VulkanExampleBase::setupFrameBuffer()
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &multisampleTarget.depth.image));
 
 		vkGetImageMemoryRequirements(device, multisampleTarget.depth.image, &memReqs);
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
-		if (!lazyMemTypePresent) {
-			memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &multisampleTarget.depth.memory));
-		vkBindImageMemory(device, multisampleTarget.depth.image, multisampleTarget.depth.memory, 0);
+		vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
+		vulkanDevice->allocateImageMemory(multisampleTarget.depth.image, lazyMemTypePresent ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &multisampleTarget.depth.memory, vks::MemoryCategory::RenderTargets);
 
 		// Create image view for the MSAA target
 		imageViewCI.image = multisampleTarget.depth.image;
@@ -2007,12 +2158,6 @@ void VulkanExampleBase::setupFrameBuffer()
 	image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 	image.flags = 0;
 
-	VkMemoryAllocateInfo mem_alloc = {};
-	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	mem_alloc.pNext = NULL;
-	mem_alloc.allocationSize = 0;
-	mem_alloc.memoryTypeIndex = 0;
-
 	VkImageViewCreateInfo depthStencilView = {};
 	depthStencilView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	depthStencilView.pNext = NULL;
@@ -2026,13 +2171,8 @@ void VulkanExampleBase::setupFrameBuffer()
 	depthStencilView.subresourceRange.baseArrayLayer = 0;
 	depthStencilView.subresourceRange.layerCount = 1;
 
-	VkMemoryRequirements memReqs;
 	VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &depthStencil.image));
-	vkGetImageMemoryRequirements(device, depthStencil.image, &memReqs);
-	mem_alloc.allocationSize = memReqs.size;
-	mem_alloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &mem_alloc, nullptr, &depthStencil.mem));
-	VK_CHECK_RESULT(vkBindImageMemory(device, depthStencil.image, depthStencil.mem, 0));
+	vulkanDevice->allocateImageMemory(depthStencil.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthStencil.mem, vks::MemoryCategory::RenderTargets);
 
 	depthStencilView.image = depthStencil.image;
 	VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &depthStencil.view));
@@ -2087,14 +2227,14 @@ void VulkanExampleBase::windowResize()
 	if (settings.multiSampling) {
 		vkDestroyImageView(device, multisampleTarget.color.view, nullptr);
 		vkDestroyImage(device, multisampleTarget.color.image, nullptr);
-		vkFreeMemory(device, multisampleTarget.color.memory, nullptr);
+		vulkanDevice->freeMemory(multisampleTarget.color.memory);
 		vkDestroyImageView(device, multisampleTarget.depth.view, nullptr);
 		vkDestroyImage(device, multisampleTarget.depth.image, nullptr);
-		vkFreeMemory(device, multisampleTarget.depth.memory, nullptr);
+		vulkanDevice->freeMemory(multisampleTarget.depth.memory);
 	}
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
-	vkFreeMemory(device, depthStencil.mem, nullptr);
+	vulkanDevice->freeMemory(depthStencil.mem);
 	for (uint32_t i = 0; i < frameBuffers.size(); i++) {
 		vkDestroyFramebuffer(device, frameBuffers[i], nullptr);
 	}
@@ -2154,3 +2294,49 @@ void VulkanExampleBase::setupSwapChain()
 {
 	swapChain.create(&width, &height, settings.vsync);
 }
+
+void VulkanExampleBase::setupHeadlessTarget()
+{
+	// Offscreen color images take the place of the swapchain images, so frame buffers and render pass are set up the same way
+#ifdef HDR
+	swapChain.colorFormat = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+#else
+	swapChain.colorFormat = VK_FORMAT_B8G8R8A8_SRGB;
+#endif
+	swapChain.imageCount = 2;
+	swapChain.extent = { width, height };
+	swapChain.queueNodeIndex = vulkanDevice->queueFamilyIndices.graphics;
+	swapChain.images.resize(swapChain.imageCount);
+	swapChain.buffers.resize(swapChain.imageCount);
+	headlessImageMemory.resize(swapChain.imageCount);
+
+	VkImageCreateInfo imageCI{};
+	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = swapChain.colorFormat;
+	imageCI.extent = { width, height, 1 };
+	imageCI.mipLevels = 1;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	// Transfer source allows reading back the rendered images
+	imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImageViewCreateInfo imageViewCI{};
+	imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCI.format = swapChain.colorFormat;
+	imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCI.subresourceRange.levelCount = 1;
+	imageViewCI.subresourceRange.layerCount = 1;
+
+	for (uint32_t i = 0; i < swapChain.imageCount; i++) {
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &swapChain.images[i]));
+		vulkanDevice->allocateImageMemory(swapChain.images[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &headlessImageMemory[i], vks::MemoryCategory::RenderTargets);
+		swapChain.buffers[i].image = swapChain.images[i];
+		imageViewCI.image = swapChain.images[i];
+		VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &swapChain.buffers[i].view));
+	}
+}
@@ -42,6 +42,7 @@
 #include <glm/glm.hpp>
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <array>
 #include <numeric>
 
@@ -72,20 +73,30 @@ private:
 		struct {
 			VkImage image;
 			VkImageView view;
-			VkDeviceMemory memory;
+			vks::Allocation memory;
 		} color;
 		struct {
 			VkImage image;
 			VkImageView view;
-			VkDeviceMemory memory;
+			vks::Allocation memory;
 		} depth;
 	} multisampleTarget;
+	// Memory backing the offscreen color images that replace the swapchain images in headless mode
+	std::vector<vks::Allocation> headlessImageMemory;
 protected:
 	VkInstance instance;
 	VkPhysicalDevice physicalDevice;
 	VkPhysicalDeviceProperties deviceProperties;
 	VkPhysicalDeviceFeatures deviceFeatures;
 	VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
+	// Features and device extensions to be enabled, can be requested by the application in getEnabledFeatures
+	VkPhysicalDeviceFeatures enabledFeatures{};
+	std::vector<const char*> enabledDeviceExtensions;
+	// Optional chain of extension feature structures passed to device creation, can be set by the application in getEnabledFeatures
+	void* deviceCreatepNextChain = nullptr;
+	// Instance extensions to be enabled in addition to the ones required for presentation, need to be requested by the application before initVulkan
+	std::vector<const char*> enabledInstanceExtensions;
+	std::vector<std::string> supportedInstanceExtensions;
 	VkDevice device;
 	vks::VulkanDevice *vulkanDevice;
 	VkQueue queue;
@@ -96,6 +107,10 @@ protected:
 	uint32_t imageIndex = 0;
 	VkDescriptorPool descriptorPool;
 	VkPipelineCache pipelineCache;
+	// Set if the pipeline cache was initialized with data stored by a previous run on the same device
+	bool pipelineCacheWarm = false;
+	// Time spent in pipeline creation (using createGraphicsPipeline and createComputePipeline) in milliseconds
+	double pipelineCreationTime = 0.0;
 	VulkanSwapChain swapChain;
 	std::string title = "Vulkan Example";
 	std::string name = "vulkanExample";
@@ -115,6 +130,12 @@ public:
 		bool validation = false;
 		bool fullscreen = false;
 		bool vsync = false;
+		// Ignore pipeline cache data stored by previous runs (e.g. to compare cold and warm startup times)
+		bool coldPipelineCache = false;
+		// Render into offscreen images without creating a window, surface or swapchain (e.g. for CI or software rasterizers)
+		bool headless = false;
+		// Number of frames rendered in headless mode before the application exits
+		uint32_t headlessFrameCount = 100;
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 		// MSAA is costly on Android and barely visible due to high resolution displays, so disable b default
 		bool multiSampling = false;
@@ -127,7 +148,7 @@ public:
 	
 	struct DepthStencil {
 		VkImage image;
-		VkDeviceMemory mem;
+		vks::Allocation mem;
 		VkImageView view;
 	} depthStencil;
 
@@ -256,15 +277,26 @@ public:
 	void initVulkan();
 
 	virtual VkResult createInstance(bool enableValidation);
+	// Called after the physical device has been selected to request features and extensions for device creation
+	virtual void getEnabledFeatures();
 	virtual void render() = 0;
 	virtual void windowResized();
 	virtual void setupFrameBuffer();
 	virtual void prepare();
 	virtual void fileDropped(std::string filename);
 
+	std::string getPipelineCacheFileName();
+	void loadPipelineCache();
+	void savePipelineCache();
+	VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pipelineCI, VkPipeline* pipeline);
+	VkResult createComputePipeline(const VkComputePipelineCreateInfo& pipelineCI, VkPipeline* pipeline);
+
 	void initSwapchain();
 	void setupSwapChain();
+	void setupHeadlessTarget();
 
 	void renderLoop();
 	void renderFrame();
+	// Ends the render loop after the current frame, as if the window had been closed
+	void requestQuit();
 };
@@ -0,0 +1,590 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffers and images from large device memory blocks instead of doing one vkAllocateMemory call per resource
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+#include "vulkan/vulkan.h"
+#include "macros.h"
+
+namespace vks
+{
+	// Free list allocations can be freed in any order and their memory is reused right away
+	// Linear allocations are cheap bump allocations for short-lived resources like staging buffers, a block is only reused once all of its allocations have been freed
+	enum class AllocationStrategy { FreeList, Linear };
+
+	// Buffers and linear images must not share a bufferImageGranularity page with optimal tiled images
+	enum class ResourceType { Linear, Optimal };
+
+	// What an allocation is used for, memory usage is reported per category
+	enum class MemoryCategory : uint32_t { Other, Staging, Textures, Geometry, MeshData, Materials, DrawCommands, Uniforms, Environment, RenderTargets, Overlay, Count };
+
+	inline const char* getMemoryCategoryName(MemoryCategory category)
+	{
+		switch (category) {
+		case MemoryCategory::Staging: return "Staging";
+		case MemoryCategory::Textures: return "Textures";
+		case MemoryCategory::Geometry: return "Vertices/indices";
+		case MemoryCategory::MeshData: return "Mesh data";
+		case MemoryCategory::Materials: return "Materials";
+		case MemoryCategory::DrawCommands: return "Draw commands";
+		case MemoryCategory::Uniforms: return "Uniforms";
+		case MemoryCategory::Environment: return "Environment";
+		case MemoryCategory::RenderTargets: return "Render targets";
+		case MemoryCategory::Overlay: return "Overlay";
+		default: return "Other";
+		}
+	}
+
+	struct MemoryBlock;
+
+	// A range of device memory handed out by the allocator
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// Host visible memory is persistently mapped, this points to the start of the allocation
+		uint8_t* mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+		MemoryCategory category = MemoryCategory::Other;
+		// Block the allocation has been taken from, nullptr for dedicated allocations
+		MemoryBlock* block = nullptr;
+	};
+
+	struct MemoryBlock {
+		// Regions are sorted by offset and cover the whole block, adjacent free regions are always merged
+		struct Region {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			// Bytes at the start of the region lost to alignment and granularity
+			VkDeviceSize padding;
+			ResourceType type;
+			bool free;
+		};
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		AllocationStrategy strategy = AllocationStrategy::FreeList;
+		uint8_t* mapped = nullptr;
+		std::vector<Region> regions;
+		VkDeviceSize linearOffset = 0;
+		ResourceType linearLastType = ResourceType::Linear;
+		uint32_t allocationCount = 0;
+		VkDeviceSize usedSize = 0;
+		VkDeviceSize paddingSize = 0;
+	};
+
+	class MemoryAllocator
+	{
+	public:
+		struct Stats {
+			uint32_t blockCount = 0;
+			uint32_t dedicatedAllocationCount = 0;
+			uint32_t allocationCount = 0;
+			// Number of live vkAllocateMemory allocations (blocks + dedicated)
+			uint32_t deviceMemoryCount = 0;
+			VkDeviceSize blockBytes = 0;
+			VkDeviceSize usedBytes = 0;
+			VkDeviceSize dedicatedBytes = 0;
+			// Bytes lost to alignment and bufferImageGranularity padding
+			VkDeviceSize paddingBytes = 0;
+			VkDeviceSize freeBytes = 0;
+			VkDeviceSize largestFreeRange = 0;
+			// Share of free block memory that is not part of the largest free range of its block (0.0 = no fragmentation)
+			float fragmentation = 0.0f;
+		};
+
+		struct CategoryStats {
+			uint32_t allocationCount = 0;
+			VkDeviceSize bytes = 0;
+		};
+
+		struct HeapStats {
+			VkDeviceSize size = 0;
+			VkMemoryHeapFlags flags = 0;
+			// Device memory allocated by this allocator from the heap (blocks + dedicated)
+			VkDeviceSize allocatedBytes = 0;
+			// Bytes of live allocations
+			VkDeviceSize usedBytes = 0;
+			// Heap budget and usage of the whole process as reported by VK_EXT_memory_budget, zero if not available
+			VkDeviceSize budget = 0;
+			VkDeviceSize usage = 0;
+		};
+
+		// Resources larger than half of a block get their own device memory allocation
+		VkDeviceSize defaultBlockSize = 64 * 1024 * 1024;
+
+		MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice) : device(device), physicalDevice(physicalDevice)
+		{
+			vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			bufferImageGranularity = properties.limits.bufferImageGranularity;
+			nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+			maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+		}
+
+		~MemoryAllocator()
+		{
+			for (auto& blocks : blockLists) {
+				for (auto& block : blocks) {
+					vkFreeMemory(device, block->memory, nullptr);
+				}
+			}
+			if (dedicatedAllocationCount > 0) {
+				std::cerr << "[WARNING] " << dedicatedAllocationCount << " dedicated device memory allocations have not been freed\n";
+			}
+		}
+
+		/**
+		* Get the index of a memory type that has all the requested property bits set
+		*
+		* @param typeBits Bitmask with bits set for each memory type supported by the resource to request for (from VkMemoryRequirements)
+		* @param properties Bitmask of properties for the memory type to request
+		*
+		* @throw Throws an exception if no memory type could be found that supports the requested properties
+		*/
+		uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties)
+		{
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+				if ((typeBits & (1u << i)) && ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
+					return i;
+				}
+			}
+			throw std::runtime_error("Could not find a matching memory type");
+		}
+
+		/**
+		* Query heap budgets and usage through VK_EXT_memory_budget, the extension needs to be enabled on the device
+		*
+		* @param getMemoryProperties2 vkGetPhysicalDeviceMemoryProperties2(KHR) function pointer, requires VK_KHR_get_physical_device_properties2 or Vulkan 1.1
+		*/
+		void enableMemoryBudget(PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2)
+		{
+			vkGetPhysicalDeviceMemoryProperties2KHR = getMemoryProperties2;
+		}
+
+		bool memoryBudgetEnabled() const
+		{
+			return vkGetPhysicalDeviceMemoryProperties2KHR != nullptr;
+		}
+
+		/**
+		* Allocate device memory for a resource
+		*
+		* @param memReqs Memory requirements of the resource
+		* @param properties Memory properties the allocation needs to have
+		* @param type Type of the resource the memory is bound to
+		* @param (Optional) strategy Strategy used to sub-allocate from a memory block
+		* @param (Optional) category Category the allocation is accounted under
+		*
+		* @return The allocation, host visible allocations are mapped
+		*/
+		Allocation allocate(const VkMemoryRequirements& memReqs, VkMemoryPropertyFlags properties, ResourceType type, AllocationStrategy strategy = AllocationStrategy::FreeList, MemoryCategory category = MemoryCategory::Other)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			const uint32_t memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, properties);
+			const VkMemoryPropertyFlags typeFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+			VkDeviceSize size = memReqs.size;
+			VkDeviceSize alignment = std::max(memReqs.alignment, (VkDeviceSize)1);
+			// Flushing and invalidating non-coherent memory works on atoms, so allocations must not share them
+			const bool nonCoherent = (typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			if (nonCoherent) {
+				alignment = std::max(alignment, nonCoherentAtomSize);
+				size = alignUp(size, nonCoherentAtomSize);
+			}
+
+			Allocation allocation{};
+			const VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+			if (size > blockSize / 2) {
+				allocation = allocateDedicated(memoryTypeIndex, size);
+			} else {
+				bool allocated = false;
+				for (auto& block : blockLists[memoryTypeIndex]) {
+					if ((block->strategy == strategy) && allocateFromBlock(*block, size, alignment, type, allocation)) {
+						allocated = true;
+						break;
+					}
+				}
+				if (!allocated) {
+					MemoryBlock* block = createBlock(memoryTypeIndex, blockSize, strategy);
+					if (!allocateFromBlock(*block, size, alignment, type, allocation)) {
+						throw std::runtime_error("Could not sub-allocate from a new memory block");
+					}
+				}
+			}
+
+			allocation.category = category;
+			categoryStats[static_cast<uint32_t>(category)].allocationCount++;
+			categoryStats[static_cast<uint32_t>(category)].bytes += allocation.size;
+			heapUsedBytes[getHeapIndex(memoryTypeIndex)] += allocation.size;
+			return allocation;
+		}
+
+		/**
+		* Return an allocation to the allocator
+		*
+		* @param allocation Allocation to free, is reset afterwards
+		*/
+		void free(Allocation& allocation)
+		{
+			if (allocation.memory == VK_NULL_HANDLE) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> guard(lock);
+
+			categoryStats[static_cast<uint32_t>(allocation.category)].allocationCount--;
+			categoryStats[static_cast<uint32_t>(allocation.category)].bytes -= allocation.size;
+			heapUsedBytes[getHeapIndex(allocation.memoryTypeIndex)] -= allocation.size;
+
+			if (!allocation.block) {
+				freeDeviceMemory(allocation.memory, allocation.memoryTypeIndex, allocation.size);
+				dedicatedAllocationCount--;
+				dedicatedBytes -= allocation.size;
+				allocation = {};
+				return;
+			}
+
+			MemoryBlock& block = *allocation.block;
+			block.allocationCount--;
+			block.usedSize -= allocation.size;
+
+			if (block.strategy == AllocationStrategy::Linear) {
+				// Linear blocks can only be reset as a whole
+				if (block.allocationCount == 0) {
+					block.linearOffset = 0;
+					block.paddingSize = 0;
+				}
+			} else {
+				// Find the region this allocation belongs to
+				auto it = std::upper_bound(block.regions.begin(), block.regions.end(), allocation.offset, [](VkDeviceSize offset, const MemoryBlock::Region& region) { return offset < region.offset; });
+				assert(it != block.regions.begin());
+				--it;
+				assert(!it->free && (it->offset + it->padding == allocation.offset));
+				block.paddingSize -= it->padding;
+				it->free = true;
+				it->padding = 0;
+				// Merge with adjacent free regions
+				auto next = it + 1;
+				if ((next != block.regions.end()) && next->free) {
+					it->size += next->size;
+					it = block.regions.erase(next) - 1;
+				}
+				if (it != block.regions.begin()) {
+					auto prev = it - 1;
+					if (prev->free) {
+						prev->size += it->size;
+						block.regions.erase(it);
+					}
+				}
+			}
+
+			if (block.allocationCount == 0) {
+				releaseEmptyBlock(allocation.block);
+			}
+
+			allocation = {};
+		}
+
+		Stats getStats()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			Stats stats{};
+			stats.dedicatedAllocationCount = dedicatedAllocationCount;
+			stats.dedicatedBytes = dedicatedBytes;
+			stats.allocationCount = dedicatedAllocationCount;
+			stats.usedBytes = dedicatedBytes;
+			// Free memory outside of the largest free range of its block
+			VkDeviceSize fragmentedBytes = 0;
+			for (auto& blocks : blockLists) {
+				for (auto& block : blocks) {
+					stats.blockCount++;
+					stats.blockBytes += block->size;
+					stats.allocationCount += block->allocationCount;
+					stats.usedBytes += block->usedSize;
+					stats.paddingBytes += block->paddingSize;
+					VkDeviceSize blockFree = 0;
+					VkDeviceSize blockLargestFree = 0;
+					if (block->strategy == AllocationStrategy::Linear) {
+						blockFree = blockLargestFree = block->size - block->linearOffset;
+					} else {
+						for (auto& region : block->regions) {
+							if (region.free) {
+								blockFree += region.size;
+								blockLargestFree = std::max(blockLargestFree, region.size);
+							}
+						}
+					}
+					stats.freeBytes += blockFree;
+					stats.largestFreeRange = std::max(stats.largestFreeRange, blockLargestFree);
+					fragmentedBytes += blockFree - blockLargestFree;
+				}
+			}
+			stats.deviceMemoryCount = stats.blockCount + stats.dedicatedAllocationCount;
+			if (stats.freeBytes > 0) {
+				stats.fragmentation = (float)fragmentedBytes / (float)stats.freeBytes;
+			}
+			return stats;
+		}
+
+		CategoryStats getCategoryStats(MemoryCategory category)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return categoryStats[static_cast<uint32_t>(category)];
+		}
+
+		/** @brief Returns the stats for all memory heaps of the device, heap budgets are queried each call if VK_EXT_memory_budget is enabled */
+		std::vector<HeapStats> getHeapStats()
+		{
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			if (vkGetPhysicalDeviceMemoryProperties2KHR) {
+				VkPhysicalDeviceMemoryProperties2 memoryProperties2{};
+				memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+				memoryProperties2.pNext = &budgetProperties;
+				vkGetPhysicalDeviceMemoryProperties2KHR(physicalDevice, &memoryProperties2);
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			std::vector<HeapStats> heapStats(memoryProperties.memoryHeapCount);
+			for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+				heapStats[i].size = memoryProperties.memoryHeaps[i].size;
+				heapStats[i].flags = memoryProperties.memoryHeaps[i].flags;
+				heapStats[i].allocatedBytes = heapAllocatedBytes[i];
+				heapStats[i].usedBytes = heapUsedBytes[i];
+				heapStats[i].budget = budgetProperties.heapBudget[i];
+				heapStats[i].usage = budgetProperties.heapUsage[i];
+			}
+			return heapStats;
+		}
+
+		void printStats()
+		{
+			Stats stats = getStats();
+			const float toMB = 1.0f / (1024.0f * 1024.0f);
+			std::cout << "Device memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks and " << stats.dedicatedAllocationCount << " dedicated allocations (" << stats.deviceMemoryCount << " of max. " << maxMemoryAllocationCount << " vkAllocateMemory allocations)\n";
+			std::cout << "Device memory: " << (stats.blockBytes + stats.dedicatedBytes) * toMB << " MB allocated, " << stats.usedBytes * toMB << " MB used, " << stats.paddingBytes * toMB << " MB lost to padding, fragmentation " << stats.fragmentation * 100.0f << "%\n";
+			for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+				const CategoryStats category = getCategoryStats(static_cast<MemoryCategory>(i));
+				if (category.allocationCount > 0) {
+					std::cout << "  " << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << ": " << category.bytes * toMB << " MB in " << category.allocationCount << " allocations\n";
+				}
+			}
+			const std::vector<HeapStats> heapStats = getHeapStats();
+			for (size_t i = 0; i < heapStats.size(); i++) {
+				const HeapStats& heap = heapStats[i];
+				std::cout << "Heap " << i << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local, " : " (") << heap.size * toMB << " MB): " << heap.allocatedBytes * toMB << " MB allocated, " << heap.usedBytes * toMB << " MB used";
+				if (memoryBudgetEnabled()) {
+					std::cout << ", process usage " << heap.usage * toMB << " MB of " << heap.budget * toMB << " MB budget";
+				}
+				std::cout << "\n";
+				if (memoryBudgetEnabled() && (heap.usage > heap.budget)) {
+					std::cerr << "[WARNING] Heap " << i << " exceeds its budget, allocations may fail or be moved to slower memory\n";
+				}
+			}
+		}
+
+	private:
+		VkDevice device;
+		VkPhysicalDevice physicalDevice;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkDeviceSize bufferImageGranularity = 1;
+		VkDeviceSize nonCoherentAtomSize = 1;
+		uint32_t maxMemoryAllocationCount = 4096;
+		std::vector<std::unique_ptr<MemoryBlock>> blockLists[VK_MAX_MEMORY_TYPES];
+		uint32_t dedicatedAllocationCount = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		CategoryStats categoryStats[static_cast<uint32_t>(MemoryCategory::Count)];
+		VkDeviceSize heapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize heapUsedBytes[VK_MAX_MEMORY_HEAPS] = {};
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR vkGetPhysicalDeviceMemoryProperties2KHR = nullptr;
+		std::mutex lock;
+
+		static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Checks if the last byte of resource A and the first byte of resource B are located on the same "page" as defined by bufferImageGranularity
+		bool onSamePage(VkDeviceSize resourceAOffset, VkDeviceSize resourceASize, VkDeviceSize resourceBOffset)
+		{
+			const VkDeviceSize pageMask = ~(bufferImageGranularity - 1);
+			const VkDeviceSize resourceAEnd = resourceAOffset + resourceASize - 1;
+			return (resourceAEnd & pageMask) == (resourceBOffset & pageMask);
+		}
+
+		uint32_t getHeapIndex(uint32_t memoryTypeIndex) const
+		{
+			return memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+		}
+
+		VkDeviceSize getBlockSize(uint32_t memoryTypeIndex)
+		{
+			// Use smaller blocks for small heaps (e.g. the 256 MB BAR on devices without resizable BAR)
+			const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+			return std::min(defaultBlockSize, heapSize / 8);
+		}
+
+		void mapMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex, uint8_t** mapped)
+		{
+			if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+				VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, (void**)mapped));
+			}
+		}
+
+		VkDeviceMemory allocateDeviceMemory(uint32_t memoryTypeIndex, VkDeviceSize size)
+		{
+			VkMemoryAllocateInfo memAllocInfo{};
+			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memAllocInfo.allocationSize = size;
+			memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+			VkDeviceMemory memory;
+			VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &memory));
+			heapAllocatedBytes[getHeapIndex(memoryTypeIndex)] += size;
+			return memory;
+		}
+
+		void freeDeviceMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size)
+		{
+			vkFreeMemory(device, memory, nullptr);
+			heapAllocatedBytes[getHeapIndex(memoryTypeIndex)] -= size;
+		}
+
+		Allocation allocateDedicated(uint32_t memoryTypeIndex, VkDeviceSize size)
+		{
+			Allocation allocation{};
+			allocation.memory = allocateDeviceMemory(memoryTypeIndex, size);
+			allocation.size = size;
+			allocation.memoryTypeIndex = memoryTypeIndex;
+			mapMemory(allocation.memory, memoryTypeIndex, &allocation.mapped);
+			dedicatedAllocationCount++;
+			dedicatedBytes += size;
+			return allocation;
+		}
+
+		MemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, AllocationStrategy strategy)
+		{
+			std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+			block->memory = allocateDeviceMemory(memoryTypeIndex, size);
+			block->size = size;
+			block->memoryTypeIndex = memoryTypeIndex;
+			block->strategy = strategy;
+			block->regions.push_back({ 0, size, 0, ResourceType::Linear, true });
+			mapMemory(block->memory, memoryTypeIndex, &block->mapped);
+			blockLists[memoryTypeIndex].push_back(std::move(block));
+			return blockLists[memoryTypeIndex].back().get();
+		}
+
+		// Keep one empty block per memory type and strategy around to avoid allocation churn, release all others
+		void releaseEmptyBlock(MemoryBlock* emptyBlock)
+		{
+			auto& blocks = blockLists[emptyBlock->memoryTypeIndex];
+			uint32_t emptyCount = 0;
+			for (auto& block : blocks) {
+				if ((block->strategy == emptyBlock->strategy) && (block->allocationCount == 0)) {
+					emptyCount++;
+				}
+			}
+			if (emptyCount > 1) {
+				freeDeviceMemory(emptyBlock->memory, emptyBlock->memoryTypeIndex, emptyBlock->size);
+				blocks.erase(std::find_if(blocks.begin(), blocks.end(), [emptyBlock](const std::unique_ptr<MemoryBlock>& block) { return block.get() == emptyBlock; }));
+			}
+		}
+
+		bool allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, ResourceType type, Allocation& allocation)
+		{
+			VkDeviceSize offset = 0;
+			VkDeviceSize padding = 0;
+
+			if (block.strategy == AllocationStrategy::Linear) {
+				offset = alignUp(block.linearOffset, alignment);
+				if ((bufferImageGranularity > 1) && (block.allocationCount > 0) && (block.linearLastType != type) && onSamePage(0, block.linearOffset, offset)) {
+					offset = alignUp(offset, bufferImageGranularity);
+				}
+				if (offset + size > block.size) {
+					return false;
+				}
+				padding = offset - block.linearOffset;
+				block.linearOffset = offset + size;
+				block.linearLastType = type;
+			} else {
+				// Best fit: Use the smallest free region the allocation fits in
+				size_t bestIndex = SIZE_MAX;
+				VkDeviceSize bestOffset = 0;
+				for (size_t i = 0; i < block.regions.size(); i++) {
+					const MemoryBlock::Region& region = block.regions[i];
+					if (!region.free || (region.size < size)) {
+						continue;
+					}
+					VkDeviceSize regionOffset = alignUp(region.offset, alignment);
+					if ((bufferImageGranularity > 1) && (i > 0)) {
+						const MemoryBlock::Region& prev = block.regions[i - 1];
+						if ((prev.type != type) && onSamePage(prev.offset, prev.size, regionOffset)) {
+							regionOffset = alignUp(regionOffset, bufferImageGranularity);
+						}
+					}
+					if (regionOffset + size > region.offset + region.size) {
+						continue;
+					}
+					if ((bufferImageGranularity > 1) && (i + 1 < block.regions.size())) {
+						const MemoryBlock::Region& next = block.regions[i + 1];
+						if ((next.type != type) && onSamePage(regionOffset, size, next.offset)) {
+							continue;
+						}
+					}
+					if ((bestIndex == SIZE_MAX) || (region.size < block.regions[bestIndex].size)) {
+						bestIndex = i;
+						bestOffset = regionOffset;
+					}
+				}
+				if (bestIndex == SIZE_MAX) {
+					return false;
+				}
+
+				// Split the free region, padding is kept as part of the allocated region
+				MemoryBlock::Region& region = block.regions[bestIndex];
+				padding = bestOffset - region.offset;
+				const VkDeviceSize allocatedSize = padding + size;
+				if (region.size > allocatedSize) {
+					MemoryBlock::Region remainder = { region.offset + allocatedSize, region.size - allocatedSize, 0, ResourceType::Linear, true };
+					region.size = allocatedSize;
+					region.padding = padding;
+					region.type = type;
+					region.free = false;
+					block.regions.insert(block.regions.begin() + bestIndex + 1, remainder);
+				} else {
+					region.padding = padding;
+					region.type = type;
+					region.free = false;
+				}
+				offset = bestOffset;
+			}
+
+			block.allocationCount++;
+			block.usedSize += size;
+			block.paddingSize += padding;
+
+			allocation.memory = block.memory;
+			allocation.offset = offset;
+			allocation.size = size;
+			allocation.memoryTypeIndex = block.memoryTypeIndex;
+			allocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+			allocation.block = &block;
+			return true;
+		}
+	};
+}
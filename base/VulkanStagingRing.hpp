@@ -0,0 +1,207 @@
+/*
+* Vulkan staging ring
+*
+* Persistently mapped staging buffer for uploads done while rendering. Data is staged right away and the copies are
+* recorded into the command buffer of the next frame, staging memory is reclaimed once that frame's fence has signaled
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include "vulkan/vulkan.h"
+#include "macros.h"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	class StagingRing
+	{
+	public:
+		struct Stats {
+			// Bytes staged for the current frame
+			VkDeviceSize frameBytes = 0;
+			// Highest number of bytes in flight at once
+			VkDeviceSize peakBytesInFlight = 0;
+			uint32_t growCount = 0;
+		} stats;
+
+		/**
+		* Create the ring buffer
+		*
+		* @param device Device to create the staging buffer on
+		* @param frameCount Number of frames that can be in flight at the same time
+		* @param size Initial size of the ring buffer in bytes, the buffer grows if a frame needs more than this
+		*/
+		void create(vks::VulkanDevice* device, uint32_t frameCount, VkDeviceSize size)
+		{
+			this->device = device;
+			frameConsumed.assign(frameCount, 0);
+			allocateBuffer(size);
+		}
+
+		void destroy()
+		{
+			for (auto& retired : retiredBuffers) {
+				destroyBuffer(retired.buffer, retired.memory);
+			}
+			retiredBuffers.clear();
+			destroyBuffer(buffer, memory);
+			pendingCopies.clear();
+		}
+
+		/**
+		* Reclaim the staging memory of a frame, must be called once the frame's fence has been waited on
+		*
+		* @param frameIndex Index of the frame in flight that is about to be recorded
+		*/
+		void beginFrame(uint32_t frameIndex)
+		{
+			currentFrame = frameIndex;
+			bytesInFlight -= frameConsumed[frameIndex];
+			frameConsumed[frameIndex] = 0;
+			frameCounter++;
+			// Buffers replaced by a larger one are released once all frames that may have used them have finished
+			for (auto it = retiredBuffers.begin(); it != retiredBuffers.end();) {
+				if (frameCounter >= it->releaseFrame) {
+					destroyBuffer(it->buffer, it->memory);
+					it = retiredBuffers.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+
+		/**
+		* Stage data and queue a copy to a buffer, the copy is recorded with the next call to recordCopies
+		*
+		* @param data Pointer to the data to be copied
+		* @param size Size of the data in bytes
+		* @param dstBuffer Buffer to copy the data to
+		* @param (Optional) dstOffset Offset into the destination buffer
+		*/
+		void copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0)
+		{
+			const VkDeviceSize alignment = std::max((VkDeviceSize)16, device->properties.limits.optimalBufferCopyOffsetAlignment);
+			VkDeviceSize offset = alignUp(head, alignment);
+			VkDeviceSize consumed = offset - head;
+			if (offset + size > capacity) {
+				// Wrap around, the remainder at the end of the buffer is consumed by this frame
+				consumed = capacity - head;
+				offset = 0;
+			}
+			consumed += size;
+			if (consumed > capacity - bytesInFlight) {
+				grow(size);
+				offset = 0;
+				consumed = size;
+			}
+			head = offset + size;
+			bytesInFlight += consumed;
+			pendingConsumed += consumed;
+			stats.frameBytes += size;
+			stats.peakBytesInFlight = std::max(stats.peakBytesInFlight, bytesInFlight);
+
+			memcpy(mapped + offset, data, size);
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = offset;
+			copyRegion.dstOffset = dstOffset;
+			copyRegion.size = size;
+			pendingCopies.push_back({ buffer, dstBuffer, copyRegion });
+		}
+
+		/**
+		* Record all queued copies into a command buffer, must be called outside of a render pass
+		*
+		* @param commandBuffer Command buffer of the current frame
+		* @param (Optional) dstStageMask Pipeline stages that read the copied data
+		*/
+		void recordCopies(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		{
+			frameConsumed[currentFrame] += pendingConsumed;
+			pendingConsumed = 0;
+			stats.frameBytes = 0;
+			if (pendingCopies.empty()) {
+				return;
+			}
+			for (auto& copy : pendingCopies) {
+				vkCmdCopyBuffer(commandBuffer, copy.srcBuffer, copy.dstBuffer, 1, &copy.region);
+			}
+			pendingCopies.clear();
+			// Make the copies visible to the shaders reading the destination buffers
+			VkMemoryBarrier memoryBarrier{};
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+	private:
+		struct PendingCopy {
+			VkBuffer srcBuffer;
+			VkBuffer dstBuffer;
+			VkBufferCopy region;
+		};
+		struct RetiredBuffer {
+			VkBuffer buffer;
+			vks::Allocation memory;
+			uint64_t releaseFrame;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		vks::Allocation memory;
+		uint8_t* mapped = nullptr;
+		VkDeviceSize capacity = 0;
+		VkDeviceSize head = 0;
+		VkDeviceSize bytesInFlight = 0;
+		// Bytes staged since the last call to recordCopies
+		VkDeviceSize pendingConsumed = 0;
+		// Bytes (including alignment and wrap-around) used by each frame in flight
+		std::vector<VkDeviceSize> frameConsumed;
+		uint32_t currentFrame = 0;
+		uint64_t frameCounter = 0;
+		std::vector<PendingCopy> pendingCopies;
+		std::vector<RetiredBuffer> retiredBuffers;
+
+		static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		void allocateBuffer(VkDeviceSize size)
+		{
+			capacity = size;
+			head = 0;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, &buffer, &memory, nullptr, nullptr, vks::AllocationStrategy::FreeList, vks::MemoryCategory::Staging));
+			mapped = memory.mapped;
+		}
+
+		void destroyBuffer(VkBuffer& buffer, vks::Allocation& memory)
+		{
+			if (buffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device->logicalDevice, buffer, nullptr);
+				device->freeMemory(memory);
+				buffer = VK_NULL_HANDLE;
+			}
+		}
+
+		// Replace the ring buffer with a larger one, the old buffer stays alive until all frames that may still read from it have completed
+		void grow(VkDeviceSize minSize)
+		{
+			// Copies staged before the next beginFrame are recorded into that frame, hence the additional frame
+			retiredBuffers.push_back({ buffer, memory, frameCounter + frameConsumed.size() + 1 });
+			buffer = VK_NULL_HANDLE;
+			allocateBuffer(std::max(capacity * 2, alignUp(minSize, 1024 * 1024)));
+			// Memory in flight belongs to the retired buffer
+			std::fill(frameConsumed.begin(), frameConsumed.end(), 0);
+			bytesInFlight = 0;
+			pendingConsumed = 0;
+			stats.growCount++;
+		}
+	};
+}
@@ -30,7 +30,7 @@ namespace vks
 		vks::VulkanDevice *device;
 		VkImage image = VK_NULL_HANDLE;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
+		vks::Allocation deviceMemory;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -53,7 +53,7 @@ namespace vks
 			{
 				vkDestroySampler(device->logicalDevice, sampler, nullptr);
 			}
-			vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+			device->freeMemory(deviceMemory);
 		}
 	};
 
@@ -99,41 +99,14 @@ namespace vks
 			VkFormatProperties formatProperties;
 			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs;
-
 			// Use a separate command buffer for texture loading
 			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
 			// Create a host-visible staging buffer that contains the raw image data
 			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo{};
-			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-			bufferCreateInfo.size = tex2D.size();
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			// Copy texture data into staging buffer
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, tex2D.data(), tex2D.size());
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
+			vks::Allocation stagingMemory;
+			// Staging memory is short-lived, so it's taken from a linear block
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, tex2D.size(), &stagingBuffer, &stagingMemory, (void*)tex2D.data(), nullptr, vks::AllocationStrategy::Linear, vks::MemoryCategory::Staging));
 
 			// Setup buffer copy regions for each mip level
 			std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -176,13 +149,7 @@ namespace vks
 			}
 			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+			device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory, vks::MemoryCategory::Textures);
 
 			VkImageSubresourceRange subresourceRange = {};
 			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -231,8 +198,8 @@ namespace vks
 			device->flushCommandBuffer(copyCmd, copyQueue);
 
 			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			device->freeMemory(stagingMemory);
 
 			VkSamplerCreateInfo samplerCreateInfo{};
 			samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -283,40 +250,14 @@ namespace vks
 			height = height;
 			mipLevels = 1;
 
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs;
 			// Use a separate command buffer for texture loading
 			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
 			// Create a host-visible staging buffer that contains the raw image data
 			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo{};
-			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-			bufferCreateInfo.size = bufferSize;
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			// Copy texture data into staging buffer
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, buffer, bufferSize);
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
+			vks::Allocation stagingMemory;
+			// Staging memory is short-lived, so it's taken from a linear block
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize, &stagingBuffer, &stagingMemory, (void*)buffer, nullptr, vks::AllocationStrategy::Linear, vks::MemoryCategory::Staging));
 
 			VkBufferImageCopy bufferCopyRegion = {};
 			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -348,13 +289,7 @@ namespace vks
 			}
 			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+			device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory, vks::MemoryCategory::Textures);
 
 			VkImageSubresourceRange subresourceRange = {};
 			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -399,8 +334,8 @@ namespace vks
 			device->flushCommandBuffer(copyCmd, copyQueue);
 
 			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			device->freeMemory(stagingMemory);
 
 			// Create sampler
 			VkSamplerCreateInfo samplerCreateInfo = {};
@@ -437,13 +372,14 @@ namespace vks
 
 	class TextureCubeMap : public Texture {
 	public:
-		void loadFromFile(
-			std::string filename,
-			VkFormat format,
-			vks::VulkanDevice *device,
-			VkQueue copyQueue,
-			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
-			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		/**
+		* Read the cube map data from a KTX file, doesn't use any Vulkan objects so it can be called from a worker thread
+		*
+		* @param filename Name of the KTX file
+		*
+		* @return Cube map data including all mip levels
+		*/
+		static gli::texture_cube loadData(const std::string& filename)
 		{
 #if defined(__ANDROID__)
 			// Textures are stored inside the apk on Android (compressed)
@@ -467,44 +403,40 @@ namespace vks
 			gli::texture_cube texCube(gli::load(filename));
 #endif	
 			assert(!texCube.empty());
+			return texCube;
+		}
 
+		/**
+		* Create the cube map image from previously loaded data and record the upload into a command buffer
+		*
+		* @param texCube Cube map data as returned by loadData
+		* @param format Vulkan format of the image
+		* @param device Vulkan device to create the image on
+		* @param copyCmd Command buffer the upload is recorded to
+		* @param stagingBuffer Staging buffer holding the data, needs to be destroyed by the caller once the command buffer has finished execution
+		* @param stagingMemory Memory of the staging buffer, needs to be freed by the caller along with the buffer
+		* @param imageUsageFlags (Optional) Usage flags for the image
+		* @param imageLayout (Optional) Layout of the image after the upload
+		*/
+		void fromData(
+			const gli::texture_cube& texCube,
+			VkFormat format,
+			vks::VulkanDevice *device,
+			VkCommandBuffer copyCmd,
+			VkBuffer *stagingBuffer,
+			vks::Allocation *stagingMemory,
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		{
 			this->device = device;
 			width = static_cast<uint32_t>(texCube.extent().x);
 			height = static_cast<uint32_t>(texCube.extent().y);
 			mipLevels = static_cast<uint32_t>(texCube.levels());
 
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs;
 
 			// Create a host-visible staging buffer that contains the raw image data
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo{};
-			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-			bufferCreateInfo.size = texCube.size();
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			// Copy texture data into staging buffer
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, texCube.data(), texCube.size());
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
+			// Staging memory is short-lived, so it's taken from a linear block
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, texCube.size(), stagingBuffer, stagingMemory, (void*)texCube.data(), nullptr, vks::AllocationStrategy::Linear, vks::MemoryCategory::Staging));
 
 			// Setup buffer copy regions for each face including all of it's miplevels
 			std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -553,16 +485,7 @@ namespace vks
 
 			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-			// Use a separate command buffer for texture loading
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory, vks::MemoryCategory::Environment);
 
 			// Image barrier for optimal image (target)
 			// Set initial layout for all array layers (faces) of the optimal (target) tiled texture
@@ -587,7 +510,7 @@ namespace vks
 			// Copy the cube map faces from the staging buffer to the optimal tiled image
 			vkCmdCopyBufferToImage(
 				copyCmd,
-				stagingBuffer,
+				*stagingBuffer,
 				image,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				static_cast<uint32_t>(bufferCopyRegions.size()),
@@ -601,14 +524,13 @@ namespace vks
 				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 				imageMemoryBarrier.newLayout = imageLayout;
 				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				// The image may be read by later commands of the same command buffer
+				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
 				imageMemoryBarrier.image = image;
 				imageMemoryBarrier.subresourceRange = subresourceRange;
 				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 			}
 
-			device->flushCommandBuffer(copyCmd, copyQueue);
-
 			// Create sampler
 			VkSamplerCreateInfo samplerCreateInfo{};
 			samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -639,13 +561,31 @@ namespace vks
 			viewCreateInfo.image = image;
 			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
-			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
 			// Update descriptor image info member that can be used for setting up descriptor sets
 			updateDescriptor();
 		}
+
+		void loadFromFile(
+			std::string filename,
+			VkFormat format,
+			vks::VulkanDevice *device,
+			VkQueue copyQueue,
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		{
+			gli::texture_cube texCube = loadData(filename);
+
+			// Use a separate command buffer for texture loading
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBuffer stagingBuffer;
+			vks::Allocation stagingMemory;
+			fromData(texCube, format, device, copyCmd, &stagingBuffer, &stagingMemory, imageUsageFlags, imageLayout);
+			device->flushCommandBuffer(copyCmd, copyQueue);
+
+			// Clean up staging resources
+			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			device->freeMemory(stagingMemory);
+		}
 	};
 
 }
\ No newline at end of file
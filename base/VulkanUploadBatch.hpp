@@ -0,0 +1,172 @@
+/*
+* Vulkan upload batch
+*
+* Collects buffer and image uploads into shared staging memory and records all transfers into a single command buffer
+* that is submitted once, instead of doing a blocking submit for every single resource
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "vulkan/vulkan.h"
+#include "macros.h"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	struct UploadBatch
+	{
+		// Staging memory is allocated in chunks, usually there is only one chunk sized to fit all uploads
+		struct StagingChunk {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			vks::Allocation memory;
+			uint8_t* mapped = nullptr;
+			VkDeviceSize size = 0;
+			VkDeviceSize offset = 0;
+		};
+
+		// A range of staging memory that data can be written to
+		struct StagingRange {
+			VkBuffer buffer;
+			VkDeviceSize offset;
+			uint8_t* mapped;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		std::vector<StagingChunk> chunks;
+		// Minimum size of a staging chunk if uploads exceed the reserved size
+		VkDeviceSize minChunkSize = 32 * 1024 * 1024;
+		// Staging size reserved up-front, used for the first chunk
+		VkDeviceSize reservedSize = 0;
+
+		struct Stats {
+			uint32_t bufferCopies = 0;
+			uint32_t imageCopies = 0;
+			VkDeviceSize bytesStaged = 0;
+		} stats;
+
+		/**
+		* Start a new batch
+		*
+		* @param device Device to create the staging memory and command buffer on
+		* @param queue Queue the batch will be submitted to
+		*/
+		void begin(vks::VulkanDevice* device, VkQueue queue)
+		{
+			assert(commandBuffer == VK_NULL_HANDLE);
+			this->device = device;
+			this->queue = queue;
+			stats = {};
+			reservedSize = 0;
+			commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		}
+
+		/**
+		* Reserve staging memory for an upload, if all uploads are reserved before the first one is staged, the batch uses a single staging allocation
+		*
+		* @param size Size of the upload in bytes
+		*/
+		void reserve(VkDeviceSize size)
+		{
+			reservedSize += size + std::max((VkDeviceSize)16, device->properties.limits.optimalBufferCopyOffsetAlignment);
+		}
+
+		/**
+		* Get a range of staging memory the caller can write to
+		*
+		* @param size Size of the range in bytes
+		* @param alignment Required alignment of the range's offset
+		*
+		* @return Staging buffer, offset and host pointer of the range
+		*/
+		StagingRange stage(VkDeviceSize size, VkDeviceSize alignment = 16)
+		{
+			alignment = std::max(alignment, device->properties.limits.optimalBufferCopyOffsetAlignment);
+			StagingChunk* chunk = chunks.empty() ? nullptr : &chunks.back();
+			VkDeviceSize offset = chunk ? alignUp(chunk->offset, alignment) : 0;
+			if (!chunk || (offset + size > chunk->size)) {
+				chunk = &addChunk(std::max(size, chunks.empty() ? reservedSize : minChunkSize));
+				offset = 0;
+			}
+			chunk->offset = offset + size;
+			stats.bytesStaged += size;
+			return { chunk->buffer, offset, chunk->mapped + offset };
+		}
+
+		/**
+		* Stage data and record a copy to a buffer
+		*
+		* @param data Pointer to the data to be copied
+		* @param size Size of the data in bytes
+		* @param dstBuffer Buffer to copy the data to
+		* @param (Optional) dstOffset Offset into the destination buffer
+		*/
+		void copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0)
+		{
+			StagingRange range = stage(size);
+			memcpy(range.mapped, data, size);
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = range.offset;
+			copyRegion.dstOffset = dstOffset;
+			copyRegion.size = size;
+			vkCmdCopyBuffer(commandBuffer, range.buffer, dstBuffer, 1, &copyRegion);
+			stats.bufferCopies++;
+		}
+
+		/**
+		* Stage data and record a copy to an image, the image must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL layout
+		*
+		* @param data Pointer to the data to be copied
+		* @param size Size of the data in bytes
+		* @param dstImage Image to copy the data to
+		* @param regions Copy regions with buffer offsets relative to data
+		*/
+		void copyToImage(const void* data, VkDeviceSize size, VkImage dstImage, std::vector<VkBufferImageCopy> regions)
+		{
+			StagingRange range = stage(size);
+			memcpy(range.mapped, data, size);
+			for (auto& region : regions) {
+				region.bufferOffset += range.offset;
+			}
+			vkCmdCopyBufferToImage(commandBuffer, range.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+			stats.imageCopies++;
+		}
+
+		/**
+		* Submit all recorded transfers, wait for them to finish and release the staging memory
+		*/
+		void submit()
+		{
+			assert(commandBuffer != VK_NULL_HANDLE);
+			device->flushCommandBuffer(commandBuffer, queue, true);
+			commandBuffer = VK_NULL_HANDLE;
+			for (auto& chunk : chunks) {
+				vkDestroyBuffer(device->logicalDevice, chunk.buffer, nullptr);
+				device->freeMemory(chunk.memory);
+			}
+			chunks.clear();
+		}
+
+	private:
+		static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		StagingChunk& addChunk(VkDeviceSize size)
+		{
+			StagingChunk chunk{};
+			chunk.size = size;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, &chunk.buffer, &chunk.memory, nullptr, nullptr, vks::AllocationStrategy::Linear, vks::MemoryCategory::Staging));
+			chunk.mapped = chunk.memory.mapped;
+			chunks.push_back(chunk);
+			return chunks.back();
+		}
+	};
+}
@@ -14,6 +14,9 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
+#include <cerrno>
+#include <sys/stat.h>
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
 #if defined(__ANDROID__)
@@ -26,49 +29,46 @@
 	Vulkan buffer object
 */
 struct Buffer {
-	VkDevice device;
+	vks::VulkanDevice *device = nullptr;
 	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
+	vks::Allocation memory;
 	VkDescriptorBufferInfo descriptor;
 	int32_t count = 0;
 	VkDeviceSize actualBufferSize{ 0 };
 	void *mapped = nullptr;
-	void create(vks::VulkanDevice *device, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, bool map = true) {
-		this->device = device->logicalDevice;
-		device->createBuffer(usageFlags, memoryPropertyFlags, size, &buffer, &memory, nullptr, &actualBufferSize);
+	void create(vks::VulkanDevice *device, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, bool map = true, vks::MemoryCategory category = vks::MemoryCategory::Other) {
+		this->device = device;
+		device->createBuffer(usageFlags, memoryPropertyFlags, size, &buffer, &memory, nullptr, &actualBufferSize, vks::AllocationStrategy::FreeList, category);
 		descriptor = { buffer, 0, size };
 		if (map) {
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, memory, 0, actualBufferSize, 0, &mapped));
+			this->map();
 		}
 	}
 	void destroy() {
+		if (buffer == VK_NULL_HANDLE) {
+			return;
+		}
 		if (mapped) {
 			unmap();
 		}
-		vkDestroyBuffer(device, buffer, nullptr);
-		vkFreeMemory(device, memory, nullptr);
+		vkDestroyBuffer(device->logicalDevice, buffer, nullptr);
+		device->freeMemory(memory);
 		buffer = VK_NULL_HANDLE;
-		memory = VK_NULL_HANDLE;
 	}
+	// Host visible memory is persistently mapped by the allocator, so mapping only hands out that pointer
 	void map() {
-		VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+		assert(memory.mapped);
+		mapped = memory.mapped;
 	}
 	void unmap() {
-		if (mapped) {
-			vkUnmapMemory(device, memory);
-			mapped = nullptr;
-		}
+		mapped = nullptr;
 	}
 	void flush(VkDeviceSize size = VK_WHOLE_SIZE) {
-		VkMappedMemoryRange mappedRange{};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.size = size;
-		VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device, 1, &mappedRange));
+		VK_CHECK_RESULT(device->flushMemory(memory, size));
 	}
 };
 
-VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename, VkShaderStageFlagBits stage)
+inline VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename, VkShaderStageFlagBits stage)
 {
 	VkPipelineShaderStageCreateInfo shaderStage{};
 	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -119,7 +119,7 @@ VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename
 	return shaderStage;
 }
 
-void readDirectory(const std::string& directory, const std::string &extension, std::map<std::string, std::string> &filelist, bool recursive)
+inline void readDirectory(const std::string& directory, const std::string &extension, std::map<std::string, std::string> &filelist, bool recursive)
 {
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	AAssetDir* assetDir = AAssetManager_openDir(androidApp->activity->assetManager, directory.c_str());
@@ -186,4 +186,93 @@ void readDirectory(const std::string& directory, const std::string &extension, s
 	}
 	closedir(dir);
 #endif
-}
\ No newline at end of file
+}
+/*
+	64 bit FNV-1a hash, used to build cache keys
+	Pass the result of a previous call as the seed to hash data spread across multiple blocks
+*/
+inline uint64_t hashData(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Hashes the contents of a file, returns 0 if the file could not be read
+inline uint64_t hashFile(const std::string& filename)
+{
+	std::vector<char> fileData;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+	if (!asset) {
+		return 0;
+	}
+	fileData.resize(AAsset_getLength(asset));
+	AAsset_read(asset, fileData.data(), fileData.size());
+	AAsset_close(asset);
+#else
+	std::ifstream is(filename, std::ios::binary | std::ios::in | std::ios::ate);
+	if (!is.is_open()) {
+		return 0;
+	}
+	fileData.resize(static_cast<size_t>(is.tellg()));
+	is.seekg(0, std::ios::beg);
+	is.read(fileData.data(), fileData.size());
+#endif
+	return hashData(fileData.data(), fileData.size());
+}
+
+// Creates a directory if it doesn't exist yet, returns true if the directory exists afterwards
+inline bool createDirectory(const std::string& directory)
+{
+#if defined(_WIN32)
+	return CreateDirectoryA(directory.c_str(), NULL) || (GetLastError() == ERROR_ALREADY_EXISTS);
+#else
+	return (mkdir(directory.c_str(), 0755) == 0) || (errno == EEXIST);
+#endif
+}
+
+// Escapes a string for use in a JSON string literal, including quotes, backslashes and control characters
+inline std::string escapeJSON(const std::string& value)
+{
+	std::string result;
+	result.reserve(value.size());
+	for (char c : value) {
+		switch (c) {
+		case '"':
+			result += "\\\"";
+			break;
+		case '\\':
+			result += "\\\\";
+			break;
+		case '\n':
+			result += "\\n";
+			break;
+		case '\r':
+			result += "\\r";
+			break;
+		case '\t':
+			result += "\\t";
+			break;
+		case '\b':
+			result += "\\b";
+			break;
+		case '\f':
+			result += "\\f";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+				result += code;
+			} else {
+				result += c;
+			}
+		}
+	}
+	return result;
+}
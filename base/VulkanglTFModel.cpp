@@ -14,10 +14,13 @@
 #define STBI_MSC_SECURE_CRT
 
 #include "VulkanglTFModel.h"
+#include "Trace.hpp"
+#include "VulkanUtils.hpp"
 
 namespace vkglTF
 {
 	// We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
+	// Decoding is deferred, the encoded file contents are stored instead and are decoded in parallel in Model::loadTextures
 	bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
 	{
 		// KTX files will be handled by our own code
@@ -27,7 +30,18 @@ namespace vkglTF
 			}
 		}
 
-		return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
+		if ((bytes == nullptr) || (size <= 0)) {
+			if (error) {
+				(*error) += "No image data for image " + std::to_string(imageIndex) + "\n";
+			}
+			return false;
+		}
+
+		// Width and height are left unset, which marks the image as not yet decoded
+		image->width = -1;
+		image->height = -1;
+		image->image.assign(bytes, bytes + size);
+		return true;
 	}
 
 	// Bounding box
@@ -64,6 +78,68 @@ namespace vkglTF
 		return BoundingBox(min, max);
 	}
 
+	// Load report
+
+	void LoadReport::addStage(const std::string& name, double time, uint64_t bytes, bool gpu)
+	{
+		stages.push_back({ name, time, bytes, gpu });
+	}
+
+	void LoadReport::print() const
+	{
+		const double toMB = 1.0 / (1024.0 * 1024.0);
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "Loading " << fileName << " (" << fileBytes * toMB << " MB, " << vertexCount << " vertices, " << indexCount << " indices) took " << totalTime << " ms\n";
+		for (auto& stage : stages) {
+			std::cout << "  " << std::left << std::setw(32) << (stage.gpu ? "GPU " + stage.name : stage.name) << std::right << std::setw(10) << stage.time << " ms";
+			if (stage.bytes > 0) {
+				std::cout << std::setw(10) << stage.bytes * toMB << " MB";
+			}
+			std::cout << "\n";
+		}
+		if (!images.empty()) {
+			std::cout << "  " << images.size() << " images decoded on " << decodeThreads << " threads:\n";
+			for (auto& image : images) {
+				std::cout << "    " << image.name << " (" << image.source << ", " << image.width << "x" << image.height << ", " << image.mipLevels << " mips): " << image.encodedBytes * toMB << " MB -> " << image.decodedBytes * toMB << " MB, " << (image.transcoded ? "transcode " : "decode ") << image.time << " ms\n";
+			}
+		}
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << std::setprecision(6);
+	}
+
+	bool LoadReport::save(const std::string& fileName) const
+	{
+		std::ofstream file(fileName);
+		if (!file.is_open()) {
+			std::cerr << "Could not write load report to \"" << fileName << "\"\n";
+			return false;
+		}
+		file << std::setprecision(6);
+		file << "{\n";
+		file << "\t\"file\": \"" << escapeJSON(this->fileName) << "\",\n";
+		file << "\t\"fileBytes\": " << fileBytes << ",\n";
+		file << "\t\"vertexCount\": " << vertexCount << ",\n";
+		file << "\t\"indexCount\": " << indexCount << ",\n";
+		file << "\t\"decodeThreads\": " << decodeThreads << ",\n";
+		file << "\t\"totalMs\": " << totalTime << ",\n";
+		file << "\t\"stages\": [\n";
+		for (size_t i = 0; i < stages.size(); i++) {
+			const Stage& stage = stages[i];
+			file << "\t\t{ \"name\": \"" << escapeJSON(stage.name) << "\", \"gpu\": " << (stage.gpu ? "true" : "false") << ", \"ms\": " << stage.time << ", \"bytes\": " << stage.bytes << " }" << ((i + 1 < stages.size()) ? "," : "") << "\n";
+		}
+		file << "\t],\n";
+		file << "\t\"images\": [\n";
+		for (size_t i = 0; i < images.size(); i++) {
+			const Image& image = images[i];
+			file << "\t\t{ \"name\": \"" << escapeJSON(image.name) << "\", \"source\": \"" << escapeJSON(image.source) << "\", \"width\": " << image.width << ", \"height\": " << image.height << ", \"mipLevels\": " << image.mipLevels;
+			file << ", \"encodedBytes\": " << image.encodedBytes << ", \"decodedBytes\": " << image.decodedBytes << ", \"" << (image.transcoded ? "transcodeMs" : "decodeMs") << "\": " << image.time << " }" << ((i + 1 < images.size()) ? "," : "") << "\n";
+		}
+		file << "\t]\n";
+		file << "}\n";
+		std::cout << "Load report written to \"" << fileName << "\"\n";
+		return true;
+	}
+
 	// Texture
 	void Texture::updateDescriptor()
 	{
@@ -76,14 +152,17 @@ namespace vkglTF
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
 		vkDestroyImage(device->logicalDevice, image, nullptr);
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		device->freeMemory(deviceMemory);
 		vkDestroySampler(device->logicalDevice, sampler, nullptr);
 	}
 
-	// Loads the image for this texture. Supports both glTF's web formats (jpg, png, embedded and external files) as well as external KTX2 files with basis universal texture compression
-	void Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, TextureSampler textureSampler, vks::VulkanDevice *device, VkQueue copyQueue)
+	// Loads the image data for a glTF image on the CPU, without touching any Vulkan objects, so this can be run on worker threads
+	// Supports both glTF's web formats (jpg, png, embedded and external files) as well as external KTX2 files with basis universal texture compression
+	ImageData Texture::loadImageData(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device)
 	{
-		this->device = device;
+		VKS_TRACE_SCOPE("Texture::loadImageData");
+		auto tStart = std::chrono::high_resolution_clock::now();
+		ImageData imageData{};
 
 		// KTX2 files need to be handled explicitly
 		bool isKtx2 = false;
@@ -93,8 +172,6 @@ namespace vkglTF
 			}
 		}
 
-		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
-
 		if (isKtx2) {
 			// Image is KTX2 using basis universal compression. Those images need to be loaded from disk and will be transcoded to a native GPU format
 
@@ -106,12 +183,15 @@ namespace vkglTF
 			}
 
 			uint32_t inputDataSize = static_cast<uint32_t>(ifs.tellg());
-			char* inputData = new char[inputDataSize];
+			std::vector<char> inputData(inputDataSize);
 
 			ifs.seekg(0, std::ios::beg);
-			ifs.read(inputData, inputDataSize);
-			
-			bool success = ktxTranscoder.init(inputData, inputDataSize);
+			ifs.read(inputData.data(), inputDataSize);
+
+			imageData.encodedSize = inputDataSize;
+			imageData.transcoded = true;
+
+			bool success = ktxTranscoder.init(inputData.data(), inputDataSize);
 			if (!success) {
 				throw std::runtime_error("Could not initialize ktx2 transcoder for image file " + filename);
 			}
@@ -129,11 +209,11 @@ namespace vkglTF
 				// BC7 is the preferred block compression if available
 				if (formatSupported(VK_FORMAT_BC7_UNORM_BLOCK)) {
 					targetFormat = basist::transcoder_texture_format::cTFBC7_RGBA;
-					format = VK_FORMAT_BC7_UNORM_BLOCK;
+					imageData.format = VK_FORMAT_BC7_UNORM_BLOCK;
 				} else {
 					if (formatSupported(VK_FORMAT_BC3_SRGB_BLOCK)) {
 						targetFormat = basist::transcoder_texture_format::cTFBC3_RGBA;
-						format = VK_FORMAT_BC3_SRGB_BLOCK;
+						imageData.format = VK_FORMAT_BC3_SRGB_BLOCK;
 					}
 				}
 			}
@@ -142,7 +222,7 @@ namespace vkglTF
 				if (formatSupported(VK_FORMAT_ASTC_4x4_SRGB_BLOCK))
 				{
 					targetFormat = basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
-					format = VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
+					imageData.format = VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
 				}
 			}
 			// Ericsson texture compression
@@ -150,7 +230,7 @@ namespace vkglTF
 				if (formatSupported(VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK))
 				{
 					targetFormat = basist::transcoder_texture_format::cTFETC2_RGBA;
-					format = VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+					imageData.format = VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
 				}
 			}
 
@@ -159,111 +239,42 @@ namespace vkglTF
 			const bool targetFormatIsUncompressed = basist::basis_transcoder_format_is_uncompressed(targetFormat);
 
 			std::vector<basist::ktx2_image_level_info> levelInfos(ktxTranscoder.get_levels());
-			mipLevels = ktxTranscoder.get_levels();
+			imageData.mipLevels = ktxTranscoder.get_levels();
 
 			// Query image level information that we need later on for several calculations
 			// We only support 2D images (no cube maps or layered images)
-			for (uint32_t i = 0; i < mipLevels; i++) {
+			for (uint32_t i = 0; i < imageData.mipLevels; i++) {
 				ktxTranscoder.get_image_level_info(levelInfos[i], i, 0, 0);
 			}
 
-			width = levelInfos[0].m_orig_width;
-			height = levelInfos[0].m_orig_height;
-
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs{};
+			imageData.width = levelInfos[0].m_orig_width;
+			imageData.height = levelInfos[0].m_orig_height;
 
-			// Create one staging buffer large enough to hold all uncompressed image levels
+			// One buffer large enough to hold all transcoded image levels
 			const uint32_t bytesPerBlockOrPixel = basist::basis_get_bytes_per_block_or_pixel(targetFormat);
 			uint32_t numBlocksOrPixels = 0;
 			VkDeviceSize totalBufferSize = 0;
-			for (uint32_t i = 0; i < mipLevels; i++) {
+			for (uint32_t i = 0; i < imageData.mipLevels; i++) {
 				// Size calculations differ for compressed/uncompressed formats
 				numBlocksOrPixels = targetFormatIsUncompressed ? levelInfos[i].m_orig_width * levelInfos[i].m_orig_height : levelInfos[i].m_total_blocks;
 				totalBufferSize += numBlocksOrPixels * bytesPerBlockOrPixel;
 			}
-
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-			VkBufferCreateInfo bufferCreateInfo{};
-			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-			bufferCreateInfo.size = totalBufferSize;
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-			uint8_t* stagingBufferMapped;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&stagingBufferMapped));
-
-			unsigned char* buffer = new unsigned char[totalBufferSize];
-			unsigned char* bufferPtr = &buffer[0];
+			imageData.data.resize(totalBufferSize);
 
 			success = ktxTranscoder.start_transcoding();
 			if (!success) {
 				throw std::runtime_error("Could not start transcoding for image file " + filename);
 			}
 
-			// Transcode all mip levels into the staging buffer
-			for (uint32_t i = 0; i < mipLevels; i++) {
+			// Transcode all mip levels
+			VkDeviceSize bufferOffset = 0;
+			for (uint32_t i = 0; i < imageData.mipLevels; i++) {
 				// Size calculations differ for compressed/uncompressed formats
 				numBlocksOrPixels = targetFormatIsUncompressed ? levelInfos[i].m_orig_width * levelInfos[i].m_orig_height : levelInfos[i].m_total_blocks;
 				uint32_t outputSize = numBlocksOrPixels * bytesPerBlockOrPixel;
-				if (!ktxTranscoder.transcode_image_level(i, 0, 0, bufferPtr, numBlocksOrPixels, targetFormat, 0)) {
+				if (!ktxTranscoder.transcode_image_level(i, 0, 0, &imageData.data[bufferOffset], numBlocksOrPixels, targetFormat, 0)) {
 					throw std::runtime_error("Could not transcode the requested image file " + filename);
 				}
-				bufferPtr += outputSize;
-			}
-
-			memcpy(stagingBufferMapped, buffer, totalBufferSize);
-
-			VkImageCreateInfo imageCreateInfo{};
-			imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageCreateInfo.format = format;
-			imageCreateInfo.mipLevels = mipLevels;
-			imageCreateInfo.arrayLayers = 1;
-			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-			imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
-			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			VkImageSubresourceRange subresourceRange = {};
-			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			subresourceRange.levelCount = mipLevels;
-			subresourceRange.layerCount = 1;
-
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = 0;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-			// Transcode and copy all image levels
-			VkDeviceSize bufferOffset = 0;
-			for (uint32_t i = 0; i < mipLevels; i++) {
-				// Size calculations differ for compressed/uncompressed formats
-				numBlocksOrPixels = targetFormatIsUncompressed ? levelInfos[i].m_orig_width * levelInfos[i].m_orig_height : levelInfos[i].m_total_blocks;
-				uint32_t outputSize = numBlocksOrPixels * bytesPerBlockOrPixel;
 
 				VkBufferImageCopy bufferCopyRegion = {};
 				bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -274,132 +285,58 @@ namespace vkglTF
 				bufferCopyRegion.imageExtent.height = levelInfos[i].m_orig_height;
 				bufferCopyRegion.imageExtent.depth = 1;
 				bufferCopyRegion.bufferOffset = bufferOffset;
-
-				vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+				imageData.copyRegions.push_back(bufferCopyRegion);
 
 				bufferOffset += outputSize;
 			}
-
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-			device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
-			delete[] buffer;
-			delete[] inputData;
 		} else {
-			// Image is a basic glTF format like png or jpg and can be loaded directly via tinyglTF
-			unsigned char* buffer = nullptr;
-			VkDeviceSize bufferSize = 0;
-			bool deleteBuffer = false;
-
-			if (gltfimage.component == 3) {
-				// Most devices don't support RGB only on Vulkan so convert if necessary
-				bufferSize = gltfimage.width * gltfimage.height * 4;
-				buffer = new unsigned char[bufferSize];
-				unsigned char* rgba = buffer;
-				unsigned char* rgb = &gltfimage.image[0];
-				for (int32_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-					for (int32_t j = 0; j < 3; ++j) {
-						rgba[j] = rgb[j];
-					}
-					rgba += 4;
-					rgb += 3;
+			// Image is a basic glTF format like png or jpg
+			// Decoding is deferred by our custom image loader, so at this point the image may still contain the encoded file contents
+			if (gltfimage.width < 1) {
+				imageData.encodedSize = gltfimage.image.size();
+				std::string error;
+				std::string warning;
+				tinygltf::Image decoded;
+				decoded.uri = gltfimage.uri;
+				decoded.mimeType = gltfimage.mimeType;
+				if (gltfimage.image.empty() || !tinygltf::LoadImageData(&decoded, 0, &error, &warning, 0, 0, gltfimage.image.data(), static_cast<int>(gltfimage.image.size()), nullptr)) {
+					throw std::runtime_error("Could not decode image " + gltfimage.uri + " " + error);
 				}
-				deleteBuffer = true;
-			}
-			else {
-				buffer = &gltfimage.image[0];
-				bufferSize = gltfimage.image.size();
+				gltfimage.width = decoded.width;
+				gltfimage.height = decoded.height;
+				gltfimage.component = decoded.component;
+				gltfimage.bits = decoded.bits;
+				gltfimage.pixel_type = decoded.pixel_type;
+				gltfimage.image.swap(decoded.image);
 			}
 
 			// PNG supports up to 64 bits
-			if (gltfimage.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-				format = VK_FORMAT_R16G16B16A16_UNORM;
+			const uint32_t bytesPerComponent = (gltfimage.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) ? 2 : 1;
+			if (bytesPerComponent == 2) {
+				imageData.format = VK_FORMAT_R16G16B16A16_UNORM;
 			}
 
-			width = gltfimage.width;
-			height = gltfimage.height;
-			mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
-
-			VkFormatProperties formatProperties;
-			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
-			assert(formatProperties.optimalTilingFeatures& VK_FORMAT_FEATURE_BLIT_SRC_BIT);
-			assert(formatProperties.optimalTilingFeatures& VK_FORMAT_FEATURE_BLIT_DST_BIT);
-
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs{};
-
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo{};
-			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-			bufferCreateInfo.size = bufferSize;
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			uint8_t* data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-			memcpy(data, buffer, bufferSize);
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
-
-			if (deleteBuffer) {
-				delete[] buffer;
-			}
-
-			VkImageCreateInfo imageCreateInfo{};
-			imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageCreateInfo.format = format;
-			imageCreateInfo.mipLevels = mipLevels;
-			imageCreateInfo.arrayLayers = 1;
-			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-			imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
-			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			VkImageSubresourceRange subresourceRange = {};
-			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			subresourceRange.levelCount = 1;
-			subresourceRange.layerCount = 1;
+			imageData.width = gltfimage.width;
+			imageData.height = gltfimage.height;
+			imageData.mipLevels = static_cast<uint32_t>(floor(log2(std::max(imageData.width, imageData.height))) + 1.0);
+			imageData.generateMipmaps = true;
 
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			if (gltfimage.component == 3) {
+				// Most devices don't support RGB only on Vulkan so convert if necessary
+				const size_t pixelCount = static_cast<size_t>(gltfimage.width) * gltfimage.height;
+				imageData.data.resize(pixelCount * 4 * bytesPerComponent);
+				unsigned char* rgba = imageData.data.data();
+				const unsigned char* rgb = gltfimage.image.data();
+				for (size_t i = 0; i < pixelCount; ++i) {
+					memcpy(rgba, rgb, 3 * bytesPerComponent);
+					memset(rgba + 3 * bytesPerComponent, 0xff, bytesPerComponent);
+					rgba += 4 * bytesPerComponent;
+					rgb += 3 * bytesPerComponent;
+				}
+				// The RGB source data is no longer required
+				std::vector<unsigned char>().swap(gltfimage.image);
+			} else {
+				imageData.data.swap(gltfimage.image);
 			}
 
 			VkBufferImageCopy bufferCopyRegion = {};
@@ -407,68 +344,93 @@ namespace vkglTF
 			bufferCopyRegion.imageSubresource.mipLevel = 0;
 			bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
 			bufferCopyRegion.imageSubresource.layerCount = 1;
-			bufferCopyRegion.imageExtent.width = width;
-			bufferCopyRegion.imageExtent.height = height;
+			bufferCopyRegion.imageExtent.width = imageData.width;
+			bufferCopyRegion.imageExtent.height = imageData.height;
 			bufferCopyRegion.imageExtent.depth = 1;
+			imageData.copyRegions.push_back(bufferCopyRegion);
+		}
 
-			vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+		imageData.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		return imageData;
+	}
 
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
+	// Creates the Vulkan image for this texture from CPU side image data, the upload is recorded into the batch and done once the batch is submitted
+	// If a profiler is passed, the GPU time of the copy and the mip generation are recorded as scopes of its current frame
+	void Texture::fromImageData(const ImageData &imageData, TextureSampler textureSampler, vks::VulkanDevice *device, vks::UploadBatch &uploadBatch, vks::GPUProfiler *profiler)
+	{
+		this->device = device;
 
-			device->flushCommandBuffer(copyCmd, copyQueue, true);
+		width = imageData.width;
+		height = imageData.height;
+		mipLevels = imageData.mipLevels;
+		layerCount = 1;
 
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		if (imageData.generateMipmaps) {
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, imageData.format, &formatProperties);
+			assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
+			assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+		}
 
-			// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-			VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-			for (uint32_t i = 1; i < mipLevels; i++) {
-				VkImageBlit imageBlit{};
+		VkImageCreateInfo imageCreateInfo{};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = imageData.format;
+		imageCreateInfo.mipLevels = mipLevels;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.extent = { width, height, 1 };
+		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+		device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory, vks::MemoryCategory::Textures);
+
+		// Copy, mip generation and layout transitions are recorded into the command buffer of the upload batch
+		VkCommandBuffer copyCmd = uploadBatch.commandBuffer;
+
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = mipLevels;
+		subresourceRange.layerCount = 1;
+
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
 
-				imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				imageBlit.srcSubresource.layerCount = 1;
-				imageBlit.srcSubresource.mipLevel = i - 1;
-				imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-				imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-				imageBlit.srcOffsets[1].z = 1;
+		if (profiler) {
+			profiler->beginScope(copyCmd, "Texture copies");
+		}
+		uploadBatch.copyToImage(imageData.data.data(), imageData.data.size(), image, imageData.copyRegions);
+		if (profiler) {
+			profiler->endScope(copyCmd);
+		}
 
-				imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				imageBlit.dstSubresource.layerCount = 1;
-				imageBlit.dstSubresource.mipLevel = i;
-				imageBlit.dstOffsets[1].x = int32_t(width >> i);
-				imageBlit.dstOffsets[1].y = int32_t(height >> i);
-				imageBlit.dstOffsets[1].z = 1;
+		VkImageLayout lastLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		VkAccessFlags lastAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
 
+		if (imageData.generateMipmaps) {
+			if (profiler) {
+				profiler->beginScope(copyCmd, "Mip generation");
+			}
+			// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
+			for (uint32_t i = 1; i < mipLevels; i++) {
 				VkImageSubresourceRange mipSubRange = {};
 				mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				mipSubRange.baseMipLevel = i;
+				mipSubRange.baseMipLevel = i - 1;
 				mipSubRange.levelCount = 1;
 				mipSubRange.layerCount = 1;
 
-				{
-					VkImageMemoryBarrier imageMemoryBarrier{};
-					imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-					imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-					imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-					imageMemoryBarrier.srcAccessMask = 0;
-					imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-					imageMemoryBarrier.image = image;
-					imageMemoryBarrier.subresourceRange = mipSubRange;
-					vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-				}
-
-				vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-
+				// Source level needs to be readable
 				{
 					VkImageMemoryBarrier imageMemoryBarrier{};
 					imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -478,26 +440,63 @@ namespace vkglTF
 					imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 					imageMemoryBarrier.image = image;
 					imageMemoryBarrier.subresourceRange = mipSubRange;
-					vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+					vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 				}
-			}
 
-			subresourceRange.levelCount = mipLevels;
-			imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				VkImageBlit imageBlit{};
+				imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageBlit.srcSubresource.layerCount = 1;
+				imageBlit.srcSubresource.mipLevel = i - 1;
+				imageBlit.srcOffsets[1].x = std::max(int32_t(width >> (i - 1)), 1);
+				imageBlit.srcOffsets[1].y = std::max(int32_t(height >> (i - 1)), 1);
+				imageBlit.srcOffsets[1].z = 1;
+				imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageBlit.dstSubresource.layerCount = 1;
+				imageBlit.dstSubresource.mipLevel = i;
+				imageBlit.dstOffsets[1].x = std::max(int32_t(width >> i), 1);
+				imageBlit.dstOffsets[1].y = std::max(int32_t(height >> i), 1);
+				imageBlit.dstOffsets[1].z = 1;
+				vkCmdBlitImage(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+			}
 
+			// The last level has only been written to, bring it in line with all other levels
 			{
+				VkImageSubresourceRange mipSubRange = {};
+				mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				mipSubRange.baseMipLevel = mipLevels - 1;
+				mipSubRange.levelCount = 1;
+				mipSubRange.layerCount = 1;
+
 				VkImageMemoryBarrier imageMemoryBarrier{};
 				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+				imageMemoryBarrier.subresourceRange = mipSubRange;
+				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			}
+			if (profiler) {
+				profiler->endScope(copyCmd);
 			}
 
-			device->flushCommandBuffer(blitCmd, copyQueue, true);
+			lastLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			lastAccess = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		}
+
+		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = lastLayout;
+			imageMemoryBarrier.newLayout = imageLayout;
+			imageMemoryBarrier.srcAccessMask = lastAccess;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 		}
 
 		VkSamplerCreateInfo samplerInfo{};
@@ -510,8 +509,6 @@ namespace vkglTF
 		samplerInfo.addressModeW = textureSampler.addressModeW;
 		samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
 		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		samplerInfo.maxAnisotropy = 1.0;
-		samplerInfo.anisotropyEnable = VK_FALSE;
 		samplerInfo.maxLod = (float)mipLevels;
 		samplerInfo.maxAnisotropy = 8.0f;
 		samplerInfo.anisotropyEnable = VK_TRUE;
@@ -521,7 +518,7 @@ namespace vkglTF
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		viewInfo.image = image;
 		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewInfo.format = format;
+		viewInfo.format = imageData.format;
 		viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		viewInfo.subresourceRange.layerCount = 1;
@@ -561,60 +558,147 @@ namespace vkglTF
 		bb.valid = true;
 	}
 
+	// TransformHierarchy
+	uint32_t TransformHierarchy::add(int32_t parent) {
+		assert(parent < (int32_t)parents.size());
+		parents.push_back(parent);
+		translations.push_back(glm::vec3(0.0f));
+		rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		scales.push_back(glm::vec3(1.0f));
+		matrices.push_back(glm::mat4(1.0f));
+		localMatrices.push_back(glm::mat4(1.0f));
+		worldMatrices.push_back(glm::mat4(1.0f));
+		subtreeSizes.push_back(1);
+		dirty.push_back(1);
+		changed.push_back(0);
+		subtreeSizesValid = false;
+		return static_cast<uint32_t>(parents.size() - 1);
+	}
+
+	void TransformHierarchy::clear() {
+		parents.clear();
+		translations.clear();
+		rotations.clear();
+		scales.clear();
+		matrices.clear();
+		localMatrices.clear();
+		worldMatrices.clear();
+		subtreeSizes.clear();
+		dirty.clear();
+		changed.clear();
+		changedRanges.clear();
+		subtreeSizesValid = false;
+	}
+
+	// Recalculates the world matrices of all dirty nodes and their descendants, clean subtrees are skipped as a whole
+	// Returns the number of world matrices that have been recalculated
+	uint32_t TransformHierarchy::update() {
+		const size_t count = parents.size();
+		if (!subtreeSizesValid) {
+			// Children are always stored after their parents, so walking backwards accumulates subtree sizes bottom-up
+			std::fill(subtreeSizes.begin(), subtreeSizes.end(), 1);
+			for (size_t i = count; i-- > 0;) {
+				if (parents[i] > -1) {
+					subtreeSizes[parents[i]] += subtreeSizes[i];
+				}
+			}
+			subtreeSizesValid = true;
+		}
+		// Only the ranges marked by the last update need to be cleared
+		for (const auto& range : changedRanges) {
+			std::fill(changed.begin() + range.first, changed.begin() + range.second, 0);
+		}
+		changedRanges.clear();
+		uint32_t updateCount = 0;
+		size_t i = 0;
+		while (i < count) {
+			if (!dirty[i]) {
+				i++;
+				continue;
+			}
+			// The whole subtree of a dirty node needs new world matrices, local matrices are only recalculated for dirty nodes
+			const size_t subtreeEnd = i + subtreeSizes[i];
+			for (size_t j = i; j < subtreeEnd; j++) {
+				if (dirty[j]) {
+					localMatrices[j] = glm::translate(glm::mat4(1.0f), translations[j]) * glm::mat4(rotations[j]) * glm::scale(glm::mat4(1.0f), scales[j]) * matrices[j];
+					dirty[j] = 0;
+				}
+				const int32_t parent = parents[j];
+				worldMatrices[j] = (parent > -1) ? worldMatrices[parent] * localMatrices[j] : localMatrices[j];
+				changed[j] = 1;
+			}
+			changedRanges.push_back({ static_cast<uint32_t>(i), static_cast<uint32_t>(subtreeEnd) });
+			updateCount += static_cast<uint32_t>(subtreeEnd - i);
+			i = subtreeEnd;
+		}
+		return updateCount;
+	}
+
 	// Node
 	glm::mat4 Node::localMatrix() {
-		if (!useCachedMatrix) {
-			cachedLocalMatrix = glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
-		};
-		return cachedLocalMatrix;
+		return transforms->localMatrices[transformIndex];
 	}
 
+	// World matrices are only valid after the transform hierarchy has been updated
 	glm::mat4 Node::getMatrix() {
-		// Use a simple caching algorithm to avoid having to recalculate matrices to often while traversing the node hierarchy
-		if (!useCachedMatrix) {
-			glm::mat4 m = localMatrix();
-			vkglTF::Node* p = parent;
-			while (p) {
-				m = p->localMatrix() * m;
-				p = p->parent;
-			}
-			cachedMatrix = m;
-			useCachedMatrix = true;
-			return m;
-		} else {
-			return cachedMatrix;
-		}
+		return transforms->worldMatrices[transformIndex];
 	}
 
-	void Node::update() {
-		useCachedMatrix = false;
-		if (mesh) {
-			glm::mat4 m = getMatrix();
-			if (skin) {
-				mesh->matrix = m;
-				// Update join matrices
-				glm::mat4 inverseTransform = glm::inverse(m);
-				size_t numJoints = std::min((uint32_t)skin->joints.size(), MAX_NUM_JOINTS);
+	void Node::setTranslation(const glm::vec3& translation) {
+		transforms->translations[transformIndex] = translation;
+		transforms->dirty[transformIndex] = 1;
+	}
+
+	void Node::setRotation(const glm::quat& rotation) {
+		transforms->rotations[transformIndex] = rotation;
+		transforms->dirty[transformIndex] = 1;
+	}
+
+	void Node::setScale(const glm::vec3& scale) {
+		transforms->scales[transformIndex] = scale;
+		transforms->dirty[transformIndex] = 1;
+	}
+
+	// Updates the mesh matrix, joint matrices and world space bounds of this node from the current world matrices
+	void Node::updateMesh() {
+		if (!mesh) {
+			return;
+		}
+		glm::mat4 m = getMatrix();
+		mesh->matrix = m;
+		aabb.valid = false;
+		if (mesh->bb.valid) {
+			aabb = mesh->bb.getAABB(m);
+			aabb.valid = true;
+		}
+		if (skin) {
+			// Update join matrices
+			glm::mat4 inverseTransform = glm::inverse(m);
+			size_t numJoints = skin->joints.size();
+			mesh->jointMatrix.resize(numJoints);
+			for (size_t i = 0; i < numJoints; i++) {
+				vkglTF::Node *jointNode = skin->joints[i];
+				glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
+				jointMat = inverseTransform * jointMat;
+				mesh->jointMatrix[i] = jointMat;
+			}
+			mesh->jointcount = static_cast<uint32_t>(numJoints);
+			// Skinned vertices are weighted sums of the bind pose positions transformed by the joints, so they are contained in
+			// the union of the mesh bounds transformed by each joint
+			if (mesh->bb.valid && numJoints > 0) {
 				for (size_t i = 0; i < numJoints; i++) {
-					vkglTF::Node *jointNode = skin->joints[i];
-					glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-					jointMat = inverseTransform * jointMat;
-					mesh->jointMatrix[i] = jointMat;
+					BoundingBox jointAABB = mesh->bb.getAABB(m * mesh->jointMatrix[i]);
+					if (i == 0) {
+						aabb = jointAABB;
+					} else {
+						aabb.min = glm::min(aabb.min, jointAABB.min);
+						aabb.max = glm::max(aabb.max, jointAABB.max);
+					}
 				}
-				mesh->jointcount = static_cast<uint32_t>(numJoints);
-				/*
-				// @todo: Move buffer copy to main.cpp (decouple)
-				memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-				*/
-			} else {
-				mesh->matrix = m;
-				// memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
+				aabb.valid = true;
 			}
 		}
-
-		for (auto& child : children) {
-			child->update();
-		}
+		mesh->version++;
 	}
 
 	Node::~Node() {
@@ -652,82 +736,127 @@ namespace vkglTF
 		return pt;
 	}
 
-	// Calculates the translation of this sampler for the given node at a given time point depending on the interpolation type
-	void AnimationSampler::translate(size_t index, float time, vkglTF::Node* node) {
-		switch (interpolation) {
-		case AnimationSampler::InterpolationType::LINEAR: {
-			float u = std::max(0.0f, time - inputs[index]) / (inputs[index + 1] - inputs[index]);
-			node->translation = glm::mix(outputsVec4[index], outputsVec4[index + 1], u);
-			break;
-		}
-		case AnimationSampler::InterpolationType::STEP: {
-			node->translation = outputsVec4[index];
-			break;
+	// Returns the key interval [index, index + 1] containing the given time, or noKey if the time is outside of the sampler's range
+	// Lookups start at the cursor of the last search, which covers regular playback where time only advances by a fraction of a key
+	// per frame, with a binary search as the fallback for seeking and looping
+	size_t AnimationSampler::findKey(float time, size_t& cursor) const
+	{
+		const size_t count = inputs.size();
+		if (count < 2 || time < inputs.front() || time > inputs.back()) {
+			return noKey;
 		}
-		case AnimationSampler::InterpolationType::CUBICSPLINE: {
-			node->translation = cubicSplineInterpolation(index, time, 3);
-			break;
+		size_t index;
+		if (uniform) {
+			// Keys are evenly spaced, so the interval can be calculated directly
+			index = std::min(static_cast<size_t>((time - inputs.front()) * uniformRate), count - 2);
+			// Correct for rounding errors
+			if (time < inputs[index] && index > 0) {
+				index--;
+			} else if (time > inputs[index + 1] && index + 2 < count) {
+				index++;
+			}
+			return index;
 		}
+		if (cursor + 1 < count) {
+			if (time >= inputs[cursor] && time <= inputs[cursor + 1]) {
+				return cursor;
+			}
+			if (cursor + 2 < count && time >= inputs[cursor + 1] && time <= inputs[cursor + 2]) {
+				return ++cursor;
+			}
 		}
+		index = static_cast<size_t>(std::upper_bound(inputs.begin(), inputs.end(), time) - inputs.begin());
+		index = std::min(std::max(index, (size_t)1) - 1, count - 2);
+		cursor = index;
+		return index;
 	}
 
-	// Calculates the scale of this sampler for the given node at a given time point depending on the interpolation type
-	void AnimationSampler::scale(size_t index, float time, vkglTF::Node* node) {
-		switch (interpolation) {
-		case AnimationSampler::InterpolationType::LINEAR: {
-			float u = std::max(0.0f, time - inputs[index]) / (inputs[index + 1] - inputs[index]);
-			node->scale = glm::mix(outputsVec4[index], outputsVec4[index + 1], u);
-			break;
-		}
-		case AnimationSampler::InterpolationType::STEP: {
-			node->scale = outputsVec4[index];
-			break;
+	// Replaces the keys of a linear or cubic spline sampler with keys evenly spaced at the given rate, so keys can be looked up without searching
+	// Step samplers are left untouched, as resampling would shift their discontinuities
+	void AnimationSampler::resample(float sampleRate, bool rotation)
+	{
+		if (interpolation == InterpolationType::STEP || inputs.size() < 2 || inputs.size() > outputsVec4.size() || sampleRate <= 0.0f) {
+			return;
 		}
-		case AnimationSampler::InterpolationType::CUBICSPLINE: {
-			node->scale = cubicSplineInterpolation(index, time, 3);
-			break;
+		const float start = inputs.front();
+		const float duration = inputs.back() - start;
+		if (duration <= 0.0f) {
+			return;
 		}
+		const size_t count = static_cast<size_t>(std::ceil(duration * sampleRate)) + 1;
+		const float step = duration / static_cast<float>(count - 1);
+		std::vector<float> uniformInputs(count);
+		std::vector<glm::vec4> uniformOutputs(count);
+		size_t cursor = 0;
+		for (size_t i = 0; i < count; i++) {
+			// Rounding of the accumulated steps must not push the time out of the key range, which findKey rejects
+			const float time = (i == count - 1) ? inputs.back() : std::min(std::max(start + step * static_cast<float>(i), inputs.front()), inputs.back());
+			uniformInputs[i] = time;
+			uniformOutputs[i] = sample(findKey(time, cursor), time, rotation);
 		}
+		inputs = std::move(uniformInputs);
+		outputsVec4 = std::move(uniformOutputs);
+		outputs.clear();
+		interpolation = InterpolationType::LINEAR;
+		uniform = true;
+		uniformRate = 1.0f / step;
 	}
 
-	// Calculates the rotation of this sampler for the given node at a given time point depending on the interpolation type
-	void AnimationSampler::rotate(size_t index, float time, vkglTF::Node* node) {
+	// Calculates the value of this sampler at a given time point depending on the interpolation type
+	// Rotations are returned as quaternion components (x, y, z, w)
+	glm::vec4 AnimationSampler::sample(size_t index, float time, bool rotation)
+	{
 		switch (interpolation) {
 		case AnimationSampler::InterpolationType::LINEAR: {
 			float u = std::max(0.0f, time - inputs[index]) / (inputs[index + 1] - inputs[index]);
-			glm::quat q1;
-			q1.x = outputsVec4[index].x;
-			q1.y = outputsVec4[index].y;
-			q1.z = outputsVec4[index].z;
-			q1.w = outputsVec4[index].w;
-			glm::quat q2;
-			q2.x = outputsVec4[index + 1].x;
-			q2.y = outputsVec4[index + 1].y;
-			q2.z = outputsVec4[index + 1].z;
-			q2.w = outputsVec4[index + 1].w;
-			node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-			break;
+			if (rotation) {
+				glm::quat q1;
+				q1.x = outputsVec4[index].x;
+				q1.y = outputsVec4[index].y;
+				q1.z = outputsVec4[index].z;
+				q1.w = outputsVec4[index].w;
+				glm::quat q2;
+				q2.x = outputsVec4[index + 1].x;
+				q2.y = outputsVec4[index + 1].y;
+				q2.z = outputsVec4[index + 1].z;
+				q2.w = outputsVec4[index + 1].w;
+				glm::quat q = glm::normalize(glm::slerp(q1, q2, u));
+				return glm::vec4(q.x, q.y, q.z, q.w);
+			}
+			return glm::mix(outputsVec4[index], outputsVec4[index + 1], u);
 		}
 		case AnimationSampler::InterpolationType::STEP: {
-			glm::quat q1;
-			q1.x = outputsVec4[index].x;
-			q1.y = outputsVec4[index].y;
-			q1.z = outputsVec4[index].z;
-			q1.w = outputsVec4[index].w;
-			node->rotation = q1;
-			break;
+			return outputsVec4[index];
 		}
 		case AnimationSampler::InterpolationType::CUBICSPLINE: {
-			glm::vec4 rot = cubicSplineInterpolation(index, time, 4);
-			glm::quat q;
-			q.x = rot.x;
-			q.y = rot.y;
-			q.z = rot.z;
-			q.w = rot.w;
-			node->rotation = glm::normalize(q);
-			break;
+			if (rotation) {
+				return glm::normalize(cubicSplineInterpolation(index, time, 4));
+			}
+			return cubicSplineInterpolation(index, time, 3);
 		}
 		}
+		return outputsVec4[index];
+	}
+
+	// Calculates the translation of this sampler for the given node at a given time point
+	void AnimationSampler::translate(size_t index, float time, vkglTF::Node* node) {
+		node->setTranslation(glm::vec3(sample(index, time, false)));
+	}
+
+	// Calculates the scale of this sampler for the given node at a given time point
+	void AnimationSampler::scale(size_t index, float time, vkglTF::Node* node) {
+		node->setScale(glm::vec3(sample(index, time, false)));
+	}
+
+	// Calculates the rotation of this sampler for the given node at a given time point
+	void AnimationSampler::rotate(size_t index, float time, vkglTF::Node* node) {
+		glm::vec4 rot = sample(index, time, true);
+		glm::quat q;
+		q.x = rot.x;
+		q.y = rot.y;
+		q.z = rot.z;
+		q.w = rot.w;
+		node->setRotation(q);
 	}
 
 	// Model
@@ -735,12 +864,12 @@ namespace vkglTF
 	{
 		if (vertices.buffer != VK_NULL_HANDLE) {
 			vkDestroyBuffer(device, vertices.buffer, nullptr);
-			vkFreeMemory(device, vertices.memory, nullptr);
+			this->device->freeMemory(vertices.memory);
 			vertices.buffer = VK_NULL_HANDLE;
 		}
 		if (indices.buffer != VK_NULL_HANDLE) {
 			vkDestroyBuffer(device, indices.buffer, nullptr);
-			vkFreeMemory(device, indices.memory, nullptr);
+			this->device->freeMemory(indices.memory);
 			indices.buffer = VK_NULL_HANDLE;
 		}
 		for (auto texture : textures) {
@@ -755,6 +884,10 @@ namespace vkglTF
 		animations.resize(0);
 		nodes.resize(0);
 		linearNodes.resize(0);
+		transforms.clear();
+		transformNodes.resize(0);
+		jointSkins.resize(0);
+		skinnedNodes.resize(0);
 		extensions.resize(0);
 		for (auto skin : skins) {
 			delete skin;
@@ -769,26 +902,24 @@ namespace vkglTF
 		newNode->parent = parent;
 		newNode->name = node.name;
 		newNode->skinIndex = node.skin;
-		newNode->matrix = glm::mat4(1.0f);
+
+		// Nodes are added to the transform hierarchy before their children, which keeps parents in front of their subtrees
+		newNode->transforms = &transforms;
+		newNode->transformIndex = transforms.add(parent ? static_cast<int32_t>(parent->transformIndex) : -1);
+		const uint32_t t = newNode->transformIndex;
 
 		// Generate local node matrix
-		glm::vec3 translation = glm::vec3(0.0f);
 		if (node.translation.size() == 3) {
-			translation = glm::make_vec3(node.translation.data());
-			newNode->translation = translation;
+			transforms.translations[t] = glm::make_vec3(node.translation.data());
 		}
-		glm::mat4 rotation = glm::mat4(1.0f);
 		if (node.rotation.size() == 4) {
-			glm::quat q = glm::make_quat(node.rotation.data());
-			newNode->rotation = glm::mat4(q);
+			transforms.rotations[t] = glm::make_quat(node.rotation.data());
 		}
-		glm::vec3 scale = glm::vec3(1.0f);
 		if (node.scale.size() == 3) {
-			scale = glm::make_vec3(node.scale.data());
-			newNode->scale = scale;
+			transforms.scales[t] = glm::make_vec3(node.scale.data());
 		}
 		if (node.matrix.size() == 16) {
-			newNode->matrix = glm::make_mat4x4(node.matrix.data());
+			transforms.matrices[t] = glm::make_mat4x4(node.matrix.data());
 		};
 
 		// Node with children
@@ -801,7 +932,7 @@ namespace vkglTF
 		// Node contains mesh data
 		if (node.mesh > -1) {
 			const tinygltf::Mesh mesh = model.meshes[node.mesh];
-			Mesh *newMesh = new Mesh(newNode->matrix);
+			Mesh *newMesh = new Mesh(transforms.matrices[t]);
 			for (size_t j = 0; j < mesh.primitives.size(); j++) {
 				const tinygltf::Primitive &primitive = mesh.primitives[j];
 				uint32_t vertexStart = static_cast<uint32_t>(loaderInfo.vertexPos);
@@ -1039,17 +1170,17 @@ namespace vkglTF
 				memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
 			}
 
-			if (newSkin->joints.size() > MAX_NUM_JOINTS) {
-				std::cerr << "[WARNING] Skin " << newSkin->name << " has " << newSkin->joints.size() << " joints, which is higher than the supported maximum of " << MAX_NUM_JOINTS << "\n";
-				std::cerr << "[WARNING] glTF scene may display wrong/incomplete\n";
-			}
-
 			skins.push_back(newSkin);
 		}
 	}
 
-	void Model::loadTextures(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue)
+	void Model::loadTextures(tinygltf::Model &gltfModel, vks::VulkanDevice *device, vks::UploadBatch &uploadBatch, vks::GPUProfiler *profiler)
 	{
+		VKS_TRACE_SCOPE("Model::loadTextures");
+		// Get the image source for all textures
+		std::vector<int> textureSources;
+		textureSources.reserve(gltfModel.textures.size());
+		std::vector<bool> imageUsed(gltfModel.images.size(), false);
 		for (tinygltf::Texture &tex : gltfModel.textures) {
 			int source = tex.source;
 			// If this texture uses the KHR_texture_basisu, we need to get the source index from the extension structure
@@ -1057,8 +1188,97 @@ namespace vkglTF
 				auto ext = tex.extensions.find("KHR_texture_basisu");
 				auto value = ext->second.Get("source");
 				source = value.Get<int>();
-			}				
-			tinygltf::Image image = gltfModel.images[source];
+			}
+			textureSources.push_back(source);
+			imageUsed[source] = true;
+		}
+
+		if (textureSources.empty()) {
+			return;
+		}
+
+		// Decoding (png, jpg) and transcoding (ktx2) of all images is done on the CPU in parallel using a pool of worker threads
+		// Vulkan objects are only created and recorded on this thread
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		std::vector<ImageData> imageData(gltfModel.images.size());
+		std::vector<std::exception_ptr> imageErrors(gltfModel.images.size());
+		std::atomic<size_t> nextImage{ 0 };
+		auto decodeImages = [&]() {
+			size_t index;
+			while ((index = nextImage++) < gltfModel.images.size()) {
+				if (!imageUsed[index]) {
+					continue;
+				}
+				try {
+					imageData[index] = Texture::loadImageData(gltfModel.images[index], filePath, device);
+				}
+				catch (...) {
+					imageErrors[index] = std::current_exception();
+				}
+			}
+		};
+
+		const uint32_t imageCount = static_cast<uint32_t>(std::count(imageUsed.begin(), imageUsed.end(), true));
+		const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), imageCount), 1u);
+		std::vector<std::thread> workers;
+		for (uint32_t i = 1; i < threadCount; i++) {
+			workers.push_back(std::thread([&decodeImages]() {
+				vks::trace::setThreadName("Image decoder");
+				decodeImages();
+			}));
+		}
+		// The calling thread also takes part in decoding
+		decodeImages();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		for (auto& imageError : imageErrors) {
+			if (imageError) {
+				std::rethrow_exception(imageError);
+			}
+		}
+
+		auto tDecoded = std::chrono::high_resolution_clock::now();
+
+		loadReport.decodeThreads = threadCount;
+		uint64_t decodedBytes = 0;
+		for (size_t i = 0; i < imageData.size(); i++) {
+			if (!imageUsed[i]) {
+				continue;
+			}
+			const tinygltf::Image& source = gltfModel.images[i];
+			LoadReport::Image image{};
+			image.name = !source.uri.empty() ? source.uri : (!source.name.empty() ? source.name : "image " + std::to_string(i));
+			if (imageData[i].transcoded) {
+				image.source = "ktx2";
+			} else if (source.mimeType.find('/') != std::string::npos) {
+				image.source = source.mimeType.substr(source.mimeType.find('/') + 1);
+			} else {
+				image.source = source.uri.substr(source.uri.find_last_of('.') + 1);
+			}
+			image.width = imageData[i].width;
+			image.height = imageData[i].height;
+			image.mipLevels = imageData[i].mipLevels;
+			image.encodedBytes = imageData[i].encodedSize;
+			image.decodedBytes = imageData[i].data.size();
+			image.time = imageData[i].decodeTime;
+			image.transcoded = imageData[i].transcoded;
+			loadReport.images.push_back(image);
+			decodedBytes += image.decodedBytes;
+		}
+
+		// Reserve staging space for all textures up-front, so the upload batch can use a single staging allocation
+		// Each texture uploads its image, so images shared by several textures are reserved once per texture
+		for (int source : textureSources) {
+			if (!imageData[source].data.empty()) {
+				uploadBatch.reserve(imageData[source].data.size());
+			}
+		}
+
+		VKS_TRACE_SCOPE("Stage textures");
+		for (size_t i = 0; i < gltfModel.textures.size(); i++) {
+			tinygltf::Texture &tex = gltfModel.textures[i];
 			vkglTF::TextureSampler textureSampler;
 			if (tex.sampler == -1) {
 				// No sampler specified, use a default one
@@ -1071,9 +1291,14 @@ namespace vkglTF
 				textureSampler = textureSamplers[tex.sampler];
 			}
 			vkglTF::Texture texture;
-			texture.fromglTfImage(image, filePath, textureSampler, device, transferQueue);
+			texture.fromImageData(imageData[textureSources[i]], textureSampler, device, uploadBatch, profiler);
 			textures.push_back(texture);
 		}
+
+		auto tRecorded = std::chrono::high_resolution_clock::now();
+
+		loadReport.addStage("Image decode/transcode", std::chrono::duration<double, std::milli>(tDecoded - tStart).count(), decodedBytes);
+		loadReport.addStage("Texture staging", std::chrono::duration<double, std::milli>(tRecorded - tDecoded).count(), uploadBatch.stats.bytesStaged);
 	}
 
 	VkSamplerAddressMode Model::getVkWrapMode(int32_t wrapMode)
@@ -1345,23 +1570,103 @@ namespace vkglTF
 
 			animations.push_back(animation);
 		}
+
+		if (animationSampleRate > 0.0f) {
+			resampleAnimations(animationSampleRate);
+		}
 	}
 
-	void Model::loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, float scale)
+	// Resamples all animations to a fixed key rate, trading memory for constant time key lookup during playback
+	void Model::resampleAnimations(float sampleRate)
 	{
-		tinygltf::Model gltfModel;
-		tinygltf::TinyGLTF gltfContext;
-
-		std::string error;
-		std::string warning;
+		for (auto& animation : animations) {
+			std::vector<bool> resampled(animation.samplers.size(), false);
+			for (auto& channel : animation.channels) {
+				if (resampled[channel.samplerIndex]) {
+					continue;
+				}
+				animation.samplers[channel.samplerIndex].resample(sampleRate, channel.path == AnimationChannel::PathType::ROTATION);
+				resampled[channel.samplerIndex] = true;
+				channel.keyCursor = 0;
+			}
+		}
+	}
 
-		this->device = device;
+	void packMeshData(const Mesh& mesh, ShaderMeshData& meshData, glm::mat3x4* jointData)
+	{
+		meshData.matrix = glm::mat3x4(glm::transpose(mesh.matrix));
+		for (uint32_t i = 0; i < meshData.jointCount; i++) {
+			jointData[meshData.jointOffset + i] = glm::mat3x4(glm::transpose(mesh.jointMatrix[i]));
+		}
+	}
 
+	bool Model::parseFile(const std::string& filename, tinygltf::Model& gltfModel, std::string& error, std::string& warning)
+	{
+		VKS_TRACE_SCOPE("Parse glTF");
+		tinygltf::TinyGLTF gltfContext;
 		bool binary = false;
 		size_t extpos = filename.rfind('.', filename.length());
 		if (extpos != std::string::npos) {
 			binary = (filename.substr(extpos + 1, filename.length() - extpos) == "glb");
 		}
+		// Images are only stored at this point, they are decoded when loading the textures
+		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+		return binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
+	}
+
+	void Model::linkNodes()
+	{
+		transformNodes.assign(transforms.size(), nullptr);
+		skinnedNodes.clear();
+		uint32_t meshIndex = 0;
+		for (auto node : linearNodes) {
+			transformNodes[node->transformIndex] = node;
+			// Assign skins
+			if (node->skinIndex > -1) {
+				node->skin = skins[node->skinIndex];
+				if (node->mesh) {
+					skinnedNodes.push_back(node);
+				}
+			}
+			if (node->mesh) {
+				node->mesh->index = meshIndex++;
+			}
+		}
+		jointSkins.assign(transforms.size(), {});
+		for (size_t i = 0; i < skins.size(); i++) {
+			for (auto joint : skins[i]->joints) {
+				jointSkins[joint->transformIndex].push_back(static_cast<uint32_t>(i));
+			}
+		}
+		skinChanged.assign(skins.size(), 0);
+		boundsQueued.assign(transforms.size(), 0);
+		boundsUpdates.clear();
+	}
+
+	void Model::loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, float scale)
+	{
+		VKS_TRACE_SCOPE("Model::loadFromFile");
+		auto tStart = std::chrono::high_resolution_clock::now();
+		auto elapsed = [](std::chrono::high_resolution_clock::time_point start) {
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		};
+
+		tinygltf::Model gltfModel;
+		vks::UploadBatch uploadBatch;
+		// GPU times of the copies and the mip generation for the load report
+		vks::GPUProfiler uploadProfiler;
+
+		loadReport = {};
+		loadReport.fileName = filename;
+		std::ifstream fileStream(filename, std::ios::binary | std::ios::ate);
+		if (fileStream.is_open()) {
+			loadReport.fileBytes = static_cast<uint64_t>(fileStream.tellg());
+		}
+
+		std::string error;
+		std::string warning;
+
+		this->device = device;
 
 		size_t pos = filename.find_last_of('/');
 		if (pos == std::string::npos) {
@@ -1369,16 +1674,21 @@ namespace vkglTF
 		}
 		filePath = filename.substr(0, pos);
 
-		// @todo
-		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
-
-		bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
+		const bool fileLoaded = parseFile(filename, gltfModel, error, warning);
+		const double parseTime = elapsed(tStart);
 
 		LoaderInfo loaderInfo{};
 		size_t vertexCount = 0;
 		size_t indexCount = 0;
 
 		if (fileLoaded) {
+			// tinygltf parses the JSON, loads (or base64 decodes) the buffers and decodes Draco compressed meshes in a single call, so these can't be timed separately
+			uint64_t bufferBytes = 0;
+			for (auto& buffer : gltfModel.buffers) {
+				bufferBytes += buffer.data.size();
+			}
+			loadReport.addStage("Parse (JSON, buffers, Draco)", parseTime, bufferBytes);
+
 			extensions = gltfModel.extensionsUsed;
 			for (auto& extension : extensions) {
 				// If this model uses basis universal compressed textures, we need to transcode them
@@ -1389,41 +1699,62 @@ namespace vkglTF
 				}
 			}
 
-			loadTextureSamplers(gltfModel);
-			loadTextures(gltfModel, device, transferQueue);
-			loadMaterials(gltfModel);
-
 			const tinygltf::Scene& scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
 
 			// Get vertex and index buffer sizes up-front
 			for (size_t i = 0; i < scene.nodes.size(); i++) {
 				getNodeProps(gltfModel.nodes[scene.nodes[i]], gltfModel, vertexCount, indexCount);
 			}
+
+			// All uploads for this model (textures, vertices and indices) are recorded into a single batch that is submitted once at the end
+			uploadBatch.begin(device, transferQueue);
+			uploadBatch.reserve(vertexCount * sizeof(Vertex));
+			uploadBatch.reserve(indexCount * sizeof(uint32_t));
+			loadReport.vertexCount = static_cast<uint32_t>(vertexCount);
+			loadReport.indexCount = static_cast<uint32_t>(indexCount);
+
+			// Each texture records up to two scopes (copy and mip generation), one more is used for the vertex and index copies
+			uploadProfiler.create(device, 1, static_cast<uint32_t>(gltfModel.textures.size()) * 2 + 2);
+			uploadProfiler.beginFrame(uploadBatch.commandBuffer, 0, "Uploads");
+
+			loadTextureSamplers(gltfModel);
+			loadTextures(gltfModel, device, uploadBatch, &uploadProfiler);
+			{
+				VKS_TRACE_SCOPE("Model::loadMaterials");
+				auto tMaterials = std::chrono::high_resolution_clock::now();
+				loadMaterials(gltfModel);
+				loadReport.addStage("Materials", elapsed(tMaterials));
+			}
+
 			loaderInfo.vertexBuffer = new Vertex[vertexCount];
 			loaderInfo.indexBuffer = new uint32_t[indexCount];
 
 			// TODO: scene handling with no default scene
-			for (size_t i = 0; i < scene.nodes.size(); i++) {
-				const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-				loadNode(nullptr, node, scene.nodes[i], gltfModel, loaderInfo, scale);
+			{
+				VKS_TRACE_SCOPE("Model::loadNode");
+				auto tNodes = std::chrono::high_resolution_clock::now();
+				for (size_t i = 0; i < scene.nodes.size(); i++) {
+					const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+					loadNode(nullptr, node, scene.nodes[i], gltfModel, loaderInfo, scale);
+				}
+				loadReport.addStage("Nodes and vertex/index conversion", elapsed(tNodes), vertexCount * sizeof(Vertex) + indexCount * sizeof(uint32_t));
 			}
 			if (gltfModel.animations.size() > 0) {
+				VKS_TRACE_SCOPE("Model::loadAnimations");
+				auto tAnimations = std::chrono::high_resolution_clock::now();
 				loadAnimations(gltfModel);
+				loadReport.addStage("Animations", elapsed(tAnimations));
 			}
-			loadSkins(gltfModel);
-
-			uint32_t meshIndex = 0;
-			for (auto node : linearNodes) {
-				// Assign skins
-				if (node->skinIndex > -1) {
-					node->skin = skins[node->skinIndex];
-				}
-				// Initial pose
-				if (node->mesh) {
-					node->mesh->index = meshIndex++;
-					node->update();
-				}
+			{
+				VKS_TRACE_SCOPE("Model::loadSkins");
+				auto tSkins = std::chrono::high_resolution_clock::now();
+				loadSkins(gltfModel);
+				loadReport.addStage("Skins", elapsed(tSkins));
 			}
+
+			linkNodes();
+			// Initial pose
+			updateTransforms(true);
 		}
 		else {
 			// TODO: throw
@@ -1436,30 +1767,7 @@ namespace vkglTF
 
 		assert(vertexBufferSize > 0);
 
-		struct StagingBuffer {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-		} vertexStaging, indexStaging;
-
-		// Create staging buffers
-		// Vertex data
-		VK_CHECK_RESULT(device->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			vertexBufferSize,
-			&vertexStaging.buffer,
-			&vertexStaging.memory,
-			loaderInfo.vertexBuffer));
-		// Index data
-		if (indexBufferSize > 0) {
-			VK_CHECK_RESULT(device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				indexBufferSize,
-				&indexStaging.buffer,
-				&indexStaging.memory,
-				loaderInfo.indexBuffer));
-		}
+		auto tBuffers = std::chrono::high_resolution_clock::now();
 
 		// Create device local buffers
 		// Vertex buffer
@@ -1468,7 +1776,11 @@ namespace vkglTF
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			vertexBufferSize,
 			&vertices.buffer,
-			&vertices.memory));
+			&vertices.memory,
+			nullptr,
+			nullptr,
+			vks::AllocationStrategy::FreeList,
+			vks::MemoryCategory::Geometry));
 		// Index buffer
 		if (indexBufferSize > 0) {
 			VK_CHECK_RESULT(device->createBuffer(
@@ -1476,35 +1788,43 @@ namespace vkglTF
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				indexBufferSize,
 				&indices.buffer,
-				&indices.memory));
+				&indices.memory,
+				nullptr,
+				nullptr,
+				vks::AllocationStrategy::FreeList,
+				vks::MemoryCategory::Geometry));
 		}
 
-		// Copy from staging buffers
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		VkBufferCopy copyRegion = {};
-
-		copyRegion.size = vertexBufferSize;
-		vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
+		// Copy from staging
+		uploadProfiler.beginScope(uploadBatch.commandBuffer, "Buffer copies");
+		uploadBatch.copyToBuffer(loaderInfo.vertexBuffer, vertexBufferSize, vertices.buffer);
 		if (indexBufferSize > 0) {
-			copyRegion.size = indexBufferSize;
-			vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+			uploadBatch.copyToBuffer(loaderInfo.indexBuffer, indexBufferSize, indices.buffer);
 		}
-
-		device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-		vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-		vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-		if (indexBufferSize > 0) {
-			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+		uploadProfiler.endScope(uploadBatch.commandBuffer);
+		loadReport.addStage("Vertex/index buffer staging", elapsed(tBuffers), vertexBufferSize + indexBufferSize);
+
+		// Submit all uploads of this model at once
+		uploadProfiler.endFrame(uploadBatch.commandBuffer);
+		auto tSubmit = std::chrono::high_resolution_clock::now();
+		{
+			VKS_TRACE_SCOPE("Submit uploads");
+			uploadBatch.submit();
+		}
+		loadReport.addStage("Upload submit and wait", elapsed(tSubmit), uploadBatch.stats.bytesStaged);
+		if (uploadProfiler.readResults(0, true)) {
+			for (auto& result : uploadProfiler.getResults()) {
+				loadReport.addStage(result.name, result.time, 0, true);
+			}
 		}
+		uploadProfiler.destroy();
 
 		delete[] loaderInfo.vertexBuffer;
 		delete[] loaderInfo.indexBuffer;
 
 		getSceneDimensions();
+
+		loadReport.totalTime = elapsed(tStart);
 	}
 
 	void Model::drawNode(Node *node, VkCommandBuffer commandBuffer)
@@ -1529,35 +1849,9 @@ namespace vkglTF
 		}
 	}
 
-	void Model::calculateBoundingBox(Node *node, Node *parent) {
-		BoundingBox parentBvh = parent ? parent->bvh : BoundingBox(dimensions.min, dimensions.max);
-
-		if (node->mesh) {
-			if (node->mesh->bb.valid) {
-				node->aabb = node->mesh->bb.getAABB(node->getMatrix());
-				if (node->children.size() == 0) {
-					node->bvh.min = node->aabb.min;
-					node->bvh.max = node->aabb.max;
-					node->bvh.valid = true;
-				}
-			}
-		}
-
-		parentBvh.min = glm::min(parentBvh.min, node->bvh.min);
-		parentBvh.max = glm::min(parentBvh.max, node->bvh.max);
-
-		for (auto &child : node->children) {
-			calculateBoundingBox(child, node);
-		}
-	}
-
 	void Model::getSceneDimensions()
 	{
-		// Calculate binary volume hierarchy for all nodes in the scene
-		for (auto node : linearNodes) {
-			calculateBoundingBox(node, nullptr);
-		}
-
+		// Node bounds are up to date after the initial transform update
 		dimensions.min = glm::vec3(FLT_MAX);
 		dimensions.max = glm::vec3(-FLT_MAX);
 
@@ -1577,6 +1871,7 @@ namespace vkglTF
 
 	void Model::updateAnimation(uint32_t index, float time)
 	{
+		VKS_TRACE_SCOPE("Model::updateAnimation");
 		if (animations.empty()) {
 			std::cout << ".glTF does not contain animation." << std::endl;
 			return;
@@ -1594,29 +1889,103 @@ namespace vkglTF
 				continue;
 			}
 
-			for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
-				if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-					float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-					if (u <= 1.0f) {
-						switch (channel.path) {
-						case vkglTF::AnimationChannel::PathType::TRANSLATION:
-							sampler.translate(i, time, channel.node);
-							break;
-						case vkglTF::AnimationChannel::PathType::SCALE:
-							sampler.scale(i, time, channel.node);
-							break;
-						case vkglTF::AnimationChannel::PathType::ROTATION:
-							sampler.rotate(i, time, channel.node);
-							break;
-						}
-						updated = true;
-					}
-				}
+			const size_t i = sampler.findKey(time, channel.keyCursor);
+			if (i == AnimationSampler::noKey) {
+				continue;
+			}
+			switch (channel.path) {
+			case vkglTF::AnimationChannel::PathType::TRANSLATION:
+				sampler.translate(i, time, channel.node);
+				break;
+			case vkglTF::AnimationChannel::PathType::SCALE:
+				sampler.scale(i, time, channel.node);
+				break;
+			case vkglTF::AnimationChannel::PathType::ROTATION:
+				sampler.rotate(i, time, channel.node);
+				break;
 			}
+			updated = true;
 		}
 		if (updated) {
-			for (auto &node : nodes) {
-				node->update();
+			updateTransforms();
+		}
+	}
+
+	// Updates all changed world matrices and the meshes that depend on them
+	// Only the nodes in the ranges changed by the transform update are visited, and bounds are only merged along the ancestors of updated meshes
+	void Model::updateTransforms(bool updateAllMeshes)
+	{
+		if (transforms.update() == 0 && !updateAllMeshes) {
+			return;
+		}
+		if (updateAllMeshes) {
+			for (auto node : linearNodes) {
+				node->updateMesh();
+			}
+			updateBounds();
+			return;
+		}
+		// Queues the bounds of a node and all of its ancestors for an update, stops at the first ancestor that has already been queued
+		auto queueBounds = [this](Node* node) {
+			for (; node && !boundsQueued[node->transformIndex]; node = node->parent) {
+				boundsQueued[node->transformIndex] = 1;
+				boundsUpdates.push_back(node->transformIndex);
+			}
+		};
+		for (const auto& range : transforms.changedRanges) {
+			for (uint32_t i = range.first; i < range.second; i++) {
+				// Skinned meshes also need to be updated if any of their joints moved
+				for (uint32_t skinIndex : jointSkins[i]) {
+					skinChanged[skinIndex] = 1;
+				}
+				Node* node = transformNodes[i];
+				if (node->mesh) {
+					node->updateMesh();
+					queueBounds(node);
+				}
+			}
+		}
+		for (auto node : skinnedNodes) {
+			if (skinChanged[node->skinIndex] && !transforms.changed[node->transformIndex]) {
+				node->updateMesh();
+				queueBounds(node);
+			}
+		}
+		std::fill(skinChanged.begin(), skinChanged.end(), 0);
+		// Children are stored after their parents in the transform hierarchy, so merging in descending order updates children before their parents
+		std::sort(boundsUpdates.begin(), boundsUpdates.end(), std::greater<uint32_t>());
+		for (uint32_t i : boundsUpdates) {
+			updateNodeBounds(transformNodes[i]);
+			boundsQueued[i] = 0;
+		}
+		boundsUpdates.clear();
+	}
+
+	// Rebuilds the bounding volume hierarchy, where the bvh of a node encloses its own mesh and all of its descendants
+	// Linear nodes store children in front of their parents, so all bounds can be merged bottom-up in a single pass
+	void Model::updateBounds()
+	{
+		for (auto node : linearNodes) {
+			updateNodeBounds(node);
+		}
+	}
+
+	// Merges the bounds of a node's mesh with the bvhs of its children, which need to be up to date
+	void Model::updateNodeBounds(Node* node)
+	{
+		node->bvh = BoundingBox();
+		if (node->mesh && node->aabb.valid) {
+			node->bvh = node->aabb;
+		}
+		for (auto child : node->children) {
+			if (!child->bvh.valid) {
+				continue;
+			}
+			if (!node->bvh.valid) {
+				node->bvh = child->bvh;
+			} else {
+				node->bvh.min = glm::min(node->bvh.min, child->bvh.min);
+				node->bvh.max = glm::max(node->bvh.max, child->bvh.max);
 			}
 		}
 	}
@@ -12,10 +12,19 @@
 #include <stdlib.h>
 #include <string>
 #include <fstream>
+#include <iomanip>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <functional>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
+#include "VulkanUploadBatch.hpp"
+#include "GPUProfiler.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -42,9 +51,6 @@
 
 #include "tiny_gltf.h"
 
-// Changing this value here also requires changing it in the vertex shader
-#define MAX_NUM_JOINTS 128u
-
 namespace vkglTF
 {
 	struct Node;
@@ -66,11 +72,67 @@ namespace vkglTF
 		VkSamplerAddressMode addressModeW;
 	};
 
+	// Image data decoded or transcoded on the CPU, ready to be uploaded to the GPU
+	struct ImageData {
+		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 1;
+		std::vector<unsigned char> data;
+		// Regions for all mip levels stored in data
+		std::vector<VkBufferImageCopy> copyRegions;
+		// If true, only the first mip level is stored in data and the remaining levels are generated on the GPU
+		bool generateMipmaps = false;
+		// Size of the encoded (png, jpg) or compressed (ktx2) source and the time it took to decode or transcode it
+		size_t encodedSize = 0;
+		double decodeTime = 0.0;
+		bool transcoded = false;
+	};
+
+	// Breakdown of where the time of loading a model went, filled by Model::loadFromFile
+	// Applications can add their own stages for work done after loading (e.g. creating material buffers)
+	struct LoadReport {
+		struct Stage {
+			std::string name;
+			// Time in milliseconds, GPU stages are measured with timestamps and run as part of the upload submit
+			double time = 0.0;
+			uint64_t bytes = 0;
+			bool gpu = false;
+		};
+		struct Image {
+			std::string name;
+			// Source format (png, jpeg, ktx2)
+			std::string source;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t mipLevels = 0;
+			uint64_t encodedBytes = 0;
+			uint64_t decodedBytes = 0;
+			// Decode (png, jpeg) or transcode (ktx2) time in milliseconds on a single worker thread
+			double time = 0.0;
+			bool transcoded = false;
+		};
+		std::string fileName;
+		uint64_t fileBytes = 0;
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		uint32_t decodeThreads = 0;
+		// Wall clock time of the whole load in milliseconds, includes stages added by the application
+		double totalTime = 0.0;
+		std::vector<Stage> stages;
+		std::vector<Image> images;
+
+		void addStage(const std::string& name, double time, uint64_t bytes = 0, bool gpu = false);
+		void print() const;
+		/** @brief Writes the report as JSON */
+		bool save(const std::string& fileName) const;
+	};
+
 	struct Texture {
 		vks::VulkanDevice *device;
 		VkImage image;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
+		vks::Allocation deviceMemory;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -79,7 +141,8 @@ namespace vkglTF
 		VkSampler sampler;
 		void updateDescriptor();
 		void destroy();
-		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, TextureSampler textureSampler, vks::VulkanDevice* device, VkQueue copyQueue);
+		static ImageData loadImageData(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device);
+		void fromImageData(const ImageData& imageData, TextureSampler textureSampler, vks::VulkanDevice* device, vks::UploadBatch& uploadBatch, vks::GPUProfiler* profiler = nullptr);
 	};
 
 	struct Material {		
@@ -136,14 +199,34 @@ namespace vkglTF
 		BoundingBox bb;
 		BoundingBox aabb;
 		glm::mat4 matrix;
-		glm::mat4 jointMatrix[MAX_NUM_JOINTS]{};
+		std::vector<glm::mat4> jointMatrix;
 		uint32_t jointcount{ 0 };
 		uint32_t index;
+		// Incremented whenever the matrix or the joint matrices change
+		uint32_t version{ 0 };
 		Mesh(glm::mat4 matrix);
 		~Mesh();
 		void setBoundingBox(glm::vec3 min, glm::vec3 max);
 	};
 
+	// Per mesh data passed to the shaders, all meshes of a scene are stored in a single buffer
+	// Matrices are affine and stored transposed as 3x4 matrices (three rows of the 4x4 matrix)
+	struct alignas(16) ShaderMeshData {
+		glm::mat3x4 matrix;
+		// Range of this mesh's joint matrices in the joint palette buffer
+		uint32_t jointOffset{ 0 };
+		uint32_t jointCount{ 0 };
+	};
+
+	/**
+	* Copy the current matrices of a mesh into its shader data
+	*
+	* @param mesh Mesh to copy the matrix and joint matrices from
+	* @param meshData Shader data of the mesh, the joint range needs to be set
+	* @param jointData Start of the joint palette the joint range refers to
+	*/
+	void packMeshData(const Mesh& mesh, ShaderMeshData& meshData, glm::mat3x4* jointData);
+
 	struct Skin {
 		std::string name;
 		Node *skeletonRoot = nullptr;
@@ -151,26 +234,51 @@ namespace vkglTF
 		std::vector<Node*> joints;
 	};
 
+	// Node transforms of a model stored as flat arrays (structure of arrays)
+	// Nodes are sorted depth-first with parents always stored before their children, so the transforms of a subtree are contiguous and world matrices can be updated in a single linear pass
+	struct TransformHierarchy {
+		std::vector<int32_t> parents;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		// Static node matrices as stored in the glTF file
+		std::vector<glm::mat4> matrices;
+		std::vector<glm::mat4> localMatrices;
+		std::vector<glm::mat4> worldMatrices;
+		// Number of transforms in the subtree starting at a node (including the node)
+		std::vector<uint32_t> subtreeSizes;
+		// Set if the local transform of a node has changed since the last update
+		std::vector<uint8_t> dirty;
+		// Set by update for every node whose world matrix has been recalculated
+		std::vector<uint8_t> changed;
+		// Ranges (first, end) of the nodes marked as changed by the last update
+		std::vector<std::pair<uint32_t, uint32_t>> changedRanges;
+		bool subtreeSizesValid = false;
+		uint32_t add(int32_t parent);
+		void clear();
+		uint32_t update();
+		size_t size() const { return parents.size(); }
+	};
+
 	struct Node {
 		Node *parent;
 		uint32_t index;
 		std::vector<Node*> children;
-		glm::mat4 matrix;
 		std::string name;
 		Mesh *mesh;
 		Skin *skin;
 		int32_t skinIndex = -1;
-		glm::vec3 translation{};
-		glm::vec3 scale{ 1.0f };
-		glm::quat rotation{};
+		// Transform of this node in the model's transform hierarchy
+		TransformHierarchy *transforms = nullptr;
+		uint32_t transformIndex = 0;
 		BoundingBox bvh;
 		BoundingBox aabb;
-		bool useCachedMatrix{ false };
-		glm::mat4 cachedLocalMatrix{ glm::mat4(1.0f) };
-		glm::mat4 cachedMatrix{ glm::mat4(1.0f) };
 		glm::mat4 localMatrix();
 		glm::mat4 getMatrix();
-		void update();
+		void setTranslation(const glm::vec3& translation);
+		void setRotation(const glm::quat& rotation);
+		void setScale(const glm::vec3& scale);
+		void updateMesh();
 		~Node();
 	};
 
@@ -179,6 +287,8 @@ namespace vkglTF
 		PathType path;
 		Node *node;
 		uint32_t samplerIndex;
+		// Key found by the last lookup, playback usually stays on the same key or advances to the next one
+		size_t keyCursor = 0;
 	};
 
 	struct AnimationSampler {
@@ -187,7 +297,14 @@ namespace vkglTF
 		std::vector<float> inputs;
 		std::vector<glm::vec4> outputsVec4;
 		std::vector<float> outputs;
+		// Set if the keys have been resampled to a fixed rate, which allows looking up keys without searching
+		bool uniform = false;
+		float uniformRate = 0.0f;
+		static const size_t noKey = SIZE_MAX;
+		size_t findKey(float time, size_t& cursor) const;
+		void resample(float sampleRate, bool rotation);
 		glm::vec4 cubicSplineInterpolation(size_t index, float time, uint32_t stride);
+		glm::vec4 sample(size_t index, float time, bool rotation);
 		void translate(size_t index, float time, vkglTF::Node* node);
 		void scale(size_t index, float time, vkglTF::Node* node);
 		void rotate(size_t index, float time, vkglTF::Node* node);
@@ -217,17 +334,28 @@ namespace vkglTF
 
 		struct Vertices {
 			VkBuffer buffer = VK_NULL_HANDLE;
-			VkDeviceMemory memory;
+			vks::Allocation memory;
 		} vertices;
 		struct Indices {
 			VkBuffer buffer = VK_NULL_HANDLE;
-			VkDeviceMemory memory;
+			vks::Allocation memory;
 		} indices;
 
 		glm::mat4 aabb;
 
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		TransformHierarchy transforms;
+		// Set up by linkNodes for incremental updates of meshes and bounds
+		// Nodes indexed by their transform index
+		std::vector<Node*> transformNodes;
+		// Skins using the node with a given transform index as a joint
+		std::vector<std::vector<uint32_t>> jointSkins;
+		std::vector<Node*> skinnedNodes;
+		// Scratch storage of updateTransforms, kept to avoid allocations per update
+		std::vector<uint8_t> skinChanged;
+		std::vector<uint8_t> boundsQueued;
+		std::vector<uint32_t> boundsUpdates;
 
 		std::vector<Skin*> skins;
 
@@ -237,6 +365,9 @@ namespace vkglTF
 		std::vector<Animation> animations;
 		std::vector<std::string> extensions;
 
+		// If > 0, animation samplers are resampled to this many keys per second at load time for constant time key lookup
+		float animationSampleRate = 0.0f;
+
 		struct Dimensions {
 			glm::vec3 min = glm::vec3(FLT_MAX);
 			glm::vec3 max = glm::vec3(-FLT_MAX);
@@ -251,21 +382,30 @@ namespace vkglTF
 
 		std::string filePath;
 
+		LoadReport loadReport;
+
 		void destroy(VkDevice device);
 		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, LoaderInfo& loaderInfo, float globalscale);
 		void getNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, size_t& vertexCount, size_t& indexCount);
 		void loadSkins(tinygltf::Model& gltfModel);
-		void loadTextures(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
+		void loadTextures(tinygltf::Model& gltfModel, vks::VulkanDevice* device, vks::UploadBatch& uploadBatch, vks::GPUProfiler* profiler = nullptr);
 		VkSamplerAddressMode getVkWrapMode(int32_t wrapMode);
 		VkFilter getVkFilterMode(int32_t filterMode);
 		void loadTextureSamplers(tinygltf::Model& gltfModel);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
+		void resampleAnimations(float sampleRate);
+		/** @brief Parses a glTF (.gltf or .glb) file without decoding its images, this doesn't need a device */
+		static bool parseFile(const std::string& filename, tinygltf::Model& gltfModel, std::string& error, std::string& warning);
+		/** @brief Assigns skins to nodes and indices to meshes once all nodes and skins have been loaded, needs to be called before updating transforms */
+		void linkNodes();
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, float scale = 1.0f);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer);
 		void draw(VkCommandBuffer commandBuffer);
-		void calculateBoundingBox(Node* node, Node* parent);
 		void getSceneDimensions();
+		void updateTransforms(bool updateAllMeshes = false);
+		void updateBounds();
+		void updateNodeBounds(Node* node);
 		void updateAnimation(uint32_t index, float time);
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
@@ -0,0 +1,136 @@
+/*
+* View frustum culling class
+*
+* Planes are stored as structure of arrays, so axis aligned boxes can be tested against four planes at once using SSE or NEON
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define VKS_FRUSTUM_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VKS_FRUSTUM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace vks
+{
+	class Frustum
+	{
+	public:
+		enum Result { OUTSIDE, INTERSECTING, INSIDE };
+		// Left, right, bottom, top, near and far plane (xyz = normal, w = distance), not normalized
+		std::array<glm::vec4, 6> planes;
+
+		/**
+		* Extract the frustum planes from a combined projection and view matrix
+		*
+		* @param matrix Matrix transforming points from the space of the boxes to be tested to clip space (depth range [0..1])
+		*/
+		void update(const glm::mat4& matrix)
+		{
+			const glm::vec4 row0 = glm::vec4(matrix[0].x, matrix[1].x, matrix[2].x, matrix[3].x);
+			const glm::vec4 row1 = glm::vec4(matrix[0].y, matrix[1].y, matrix[2].y, matrix[3].y);
+			const glm::vec4 row2 = glm::vec4(matrix[0].z, matrix[1].z, matrix[2].z, matrix[3].z);
+			const glm::vec4 row3 = glm::vec4(matrix[0].w, matrix[1].w, matrix[2].w, matrix[3].w);
+			planes = {
+				row3 + row0,	// Left
+				row3 - row0,	// Right
+				row3 + row1,	// Bottom
+				row3 - row1,	// Top
+				row2,			// Near
+				row3 - row2		// Far
+			};
+			// The two unused slots are filled with planes that never reject anything
+			for (size_t i = 0; i < 8; i++) {
+				const glm::vec4 plane = (i < planes.size()) ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				planeX[i] = plane.x;
+				planeY[i] = plane.y;
+				planeZ[i] = plane.z;
+				planeW[i] = plane.w;
+				absPlaneX[i] = std::abs(plane.x);
+				absPlaneY[i] = std::abs(plane.y);
+				absPlaneZ[i] = std::abs(plane.z);
+			}
+		}
+
+		/**
+		* Test an axis aligned bounding box against the frustum
+		*
+		* @param min Minimum corner of the box
+		* @param max Maximum corner of the box
+		*
+		* @return OUTSIDE if the box is completely outside, INSIDE if it's completely inside of the frustum, INTERSECTING otherwise
+		*/
+		Result checkBox(const glm::vec3& min, const glm::vec3& max) const
+		{
+			// The box is tested using its center and extent: It's outside of a plane if the distance of the center to the plane is
+			// lower than the negated projected extent, and inside if it's larger than the projected extent
+			const glm::vec3 center = (min + max) * 0.5f;
+			const glm::vec3 extent = (max - min) * 0.5f;
+			bool intersecting = false;
+#if defined(VKS_FRUSTUM_SSE)
+			const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+			const __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+			for (size_t i = 0; i < 8; i += 4) {
+				__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_load_ps(&planeX[i]), cx), _mm_load_ps(&planeW[i]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(&planeY[i]), cy));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(&planeZ[i]), cz));
+				__m128 radius = _mm_mul_ps(_mm_load_ps(&absPlaneX[i]), ex);
+				radius = _mm_add_ps(radius, _mm_mul_ps(_mm_load_ps(&absPlaneY[i]), ey));
+				radius = _mm_add_ps(radius, _mm_mul_ps(_mm_load_ps(&absPlaneZ[i]), ez));
+				if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())) != 0) {
+					return OUTSIDE;
+				}
+				intersecting |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps())) != 0;
+			}
+#elif defined(VKS_FRUSTUM_NEON)
+			const float32x4_t cx = vdupq_n_f32(center.x), cy = vdupq_n_f32(center.y), cz = vdupq_n_f32(center.z);
+			const float32x4_t ex = vdupq_n_f32(extent.x), ey = vdupq_n_f32(extent.y), ez = vdupq_n_f32(extent.z);
+			const float32x4_t zero = vdupq_n_f32(0.0f);
+			for (size_t i = 0; i < 8; i += 4) {
+				float32x4_t distance = vmlaq_f32(vld1q_f32(&planeW[i]), vld1q_f32(&planeX[i]), cx);
+				distance = vmlaq_f32(distance, vld1q_f32(&planeY[i]), cy);
+				distance = vmlaq_f32(distance, vld1q_f32(&planeZ[i]), cz);
+				float32x4_t radius = vmulq_f32(vld1q_f32(&absPlaneX[i]), ex);
+				radius = vmlaq_f32(radius, vld1q_f32(&absPlaneY[i]), ey);
+				radius = vmlaq_f32(radius, vld1q_f32(&absPlaneZ[i]), ez);
+				const uint32x4_t outside = vcltq_f32(vaddq_f32(distance, radius), zero);
+				if ((vgetq_lane_u32(outside, 0) | vgetq_lane_u32(outside, 1) | vgetq_lane_u32(outside, 2) | vgetq_lane_u32(outside, 3)) != 0) {
+					return OUTSIDE;
+				}
+				const uint32x4_t crossing = vcltq_f32(vsubq_f32(distance, radius), zero);
+				intersecting |= (vgetq_lane_u32(crossing, 0) | vgetq_lane_u32(crossing, 1) | vgetq_lane_u32(crossing, 2) | vgetq_lane_u32(crossing, 3)) != 0;
+			}
+#else
+			for (size_t i = 0; i < 8; i++) {
+				const float distance = planeX[i] * center.x + planeY[i] * center.y + planeZ[i] * center.z + planeW[i];
+				const float radius = absPlaneX[i] * extent.x + absPlaneY[i] * extent.y + absPlaneZ[i] * extent.z;
+				if (distance + radius < 0.0f) {
+					return OUTSIDE;
+				}
+				intersecting |= (distance - radius < 0.0f);
+			}
+#endif
+			return intersecting ? INTERSECTING : INSIDE;
+		}
+
+	private:
+		alignas(16) float planeX[8];
+		alignas(16) float planeY[8];
+		alignas(16) float planeZ[8];
+		alignas(16) float planeW[8];
+		alignas(16) float absPlaneX[8];
+		alignas(16) float absPlaneY[8];
+		alignas(16) float absPlaneZ[8];
+	};
+}
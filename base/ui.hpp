@@ -9,6 +9,7 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <functional>
 
 #include "vulkan/vulkan.h"
 #include "imgui/imgui.h"
@@ -42,7 +43,8 @@ public:
 		glm::vec2 translate;
 	} pushConstBlock;
 
-	UI(vks::VulkanDevice *vulkanDevice, VkRenderPass renderPass, VkQueue queue, VkPipelineCache pipelineCache, VkSampleCountFlagBits multiSampleCount) {
+	// Pipeline creation is passed in, so it goes through the application's pipeline cache and creation timing
+	UI(vks::VulkanDevice *vulkanDevice, VkRenderPass renderPass, VkQueue queue, const std::function<VkResult(const VkGraphicsPipelineCreateInfo&, VkPipeline*)>& createPipeline, VkSampleCountFlagBits multiSampleCount) {
 
 		this->device = vulkanDevice->logicalDevice;
 
@@ -228,7 +230,7 @@ public:
 			loadShader(device, "ui.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
 			loadShader(device, "ui.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
 		};
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+		VK_CHECK_RESULT(createPipeline(pipelineCI, &pipeline));
 
 		for (auto shaderStage : shaderStages) {
 			vkDestroyShaderModule(device, shaderStage.module, nullptr);
@@ -0,0 +1,111 @@
+/*
+ * CPU benchmark for the glTF loader and animation
+ *
+ * Runs without a GPU, so loader and animation performance can be tracked on build machines
+ *
+ * Usage: Vulkan-glTF-PBR-benchmark [options] [files]
+ *   --iterations <n>      Number of times each asset is loaded (default 10)
+ *   --frames <n>          Number of simulated frames for the per-frame stages (default 1000)
+ *   --characters <n>      Number of skinned characters in the synthetic scene (default 64)
+ *   --joints <n>          Number of joints per synthetic character (default 64)
+ *   --grid <n>            Vertices along each side of the synthetic skinned mesh (default 64)
+ *   --keys <n>            Number of keys per synthetic animation channel (default 300)
+ *   --lookup-keys <n>     Number of keys per channel for the keyframe lookup comparison (default 10000)
+ *   --no-samples          Don't load the sample models from the data directory
+ *   --no-synthetic        Don't run the synthetic scene
+ *   --no-lookup           Don't run the keyframe lookup comparison
+ *   --output <file>       Write the results as JSON
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "VulkanglTFModel.h"
+#include "LoaderBenchmark.hpp"
+
+int main(int argc, char* argv[])
+{
+	vkglTF::benchmark::LoaderBenchmark benchmark;
+	uint32_t characterCount = 64;
+	uint32_t jointCount = 64;
+	uint32_t gridSize = 64;
+	uint32_t keyCount = 300;
+	uint32_t lookupKeyCount = 10000;
+	bool samples = true;
+	bool synthetic = true;
+	bool lookup = true;
+	std::string outputFileName;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+		if ((arg == "--iterations") && hasValue) {
+			benchmark.iterations = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+		} else if ((arg == "--frames") && hasValue) {
+			benchmark.frameCount = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+		} else if ((arg == "--characters") && hasValue) {
+			characterCount = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+		} else if ((arg == "--joints") && hasValue) {
+			jointCount = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+		} else if ((arg == "--grid") && hasValue) {
+			gridSize = std::max(static_cast<uint32_t>(atoi(argv[++i])), 2u);
+		} else if ((arg == "--keys") && hasValue) {
+			keyCount = std::max(static_cast<uint32_t>(atoi(argv[++i])), 2u);
+		} else if ((arg == "--lookup-keys") && hasValue) {
+			lookupKeyCount = std::max(static_cast<uint32_t>(atoi(argv[++i])), 2u);
+		} else if (arg == "--no-samples") {
+			samples = false;
+		} else if (arg == "--no-synthetic") {
+			synthetic = false;
+		} else if (arg == "--no-lookup") {
+			lookup = false;
+		} else if ((arg == "--output") && hasValue) {
+			outputFileName = argv[++i];
+		} else if (arg.compare(0, 2, "--") == 0) {
+			std::cerr << "Unknown argument \"" << arg << "\"\n";
+			return EXIT_FAILURE;
+		} else {
+			files.push_back(arg);
+		}
+	}
+
+	if (samples) {
+		const std::string assetPath = VK_EXAMPLE_DATA_DIR;
+		files.insert(files.begin(), {
+			assetPath + "models/Box/glTF-Embedded/Box.gltf",
+			assetPath + "models/DamagedHelmet/glTF-Embedded/DamagedHelmet.gltf"
+		});
+	}
+	for (auto& file : files) {
+		std::cout << "Running \"" << file << "\"\n";
+		benchmark.runFile(file);
+	}
+
+	if (synthetic) {
+		tinygltf::Model gltfModel;
+		vkglTF::benchmark::createSyntheticScene(gltfModel, characterCount, jointCount, gridSize, keyCount);
+		const std::string name = "Synthetic (" + std::to_string(characterCount) + " characters, " + std::to_string(jointCount) + " joints, " + std::to_string(gridSize * gridSize) + " vertices, " + std::to_string(keyCount) + " keys)";
+		std::cout << "Running " << name << "\n";
+		benchmark.run(name, gltfModel);
+	}
+
+	if (lookup) {
+		std::cout << "Running keyframe lookup (" << lookupKeyCount << " keys)\n";
+		benchmark.runKeyframeLookup(64, lookupKeyCount);
+	}
+
+	if (benchmark.assets.empty()) {
+		std::cerr << "No assets have been benchmarked\n";
+		return EXIT_FAILURE;
+	}
+	benchmark.print();
+	if (!outputFileName.empty() && !benchmark.save(outputFileName)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+# Compiles GLSL shaders to SPIR-V at build time, using glslangValidator or glslc
+# Binaries are written next to their sources in data/shaders, which is where the application loads them from (and the asset directory of the Android build)
+
+find_program(GLSLANG_VALIDATOR NAMES glslangValidator HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin")
+if(NOT GLSLANG_VALIDATOR)
+	# The Android NDK ships glslc
+	file(GLOB GLSLC_HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin" "${ANDROID_NDK}/shader-tools/*")
+	find_program(GLSLC NAMES glslc HINTS ${GLSLC_HINTS})
+	if(NOT GLSLC)
+		message(FATAL_ERROR "Neither glslangValidator nor glslc found, both are required to compile the shaders (install the Vulkan SDK or set VULKAN_SDK)")
+	endif()
+endif()
+
+get_filename_component(SHADER_DIR "${CMAKE_CURRENT_LIST_DIR}/../data/shaders" ABSOLUTE)
+file(GLOB SHADER_INCLUDE_FILES "${SHADER_DIR}/includes/*.glsl")
+
+# compile_shader(<source> <output> [defines...])
+# Adds a command compiling <source> from data/shaders to <output> with the given preprocessor defines
+# The binary is appended to SHADER_BINARIES in the calling scope
+function(compile_shader SOURCE OUTPUT)
+	set(DEFINES "")
+	foreach(DEFINE ${ARGN})
+		list(APPEND DEFINES "-D${DEFINE}")
+	endforeach()
+	if(GLSLANG_VALIDATOR)
+		set(COMPILE_COMMAND ${GLSLANG_VALIDATOR} -V ${DEFINES} -o "${SHADER_DIR}/${OUTPUT}" "${SHADER_DIR}/${SOURCE}")
+	else()
+		set(COMPILE_COMMAND ${GLSLC} ${DEFINES} -o "${SHADER_DIR}/${OUTPUT}" "${SHADER_DIR}/${SOURCE}")
+	endif()
+	add_custom_command(
+		OUTPUT "${SHADER_DIR}/${OUTPUT}"
+		COMMAND ${COMPILE_COMMAND}
+		DEPENDS "${SHADER_DIR}/${SOURCE}" ${SHADER_INCLUDE_FILES}
+		COMMENT "Compiling shader ${OUTPUT}"
+		VERBATIM)
+	set(SHADER_BINARIES ${SHADER_BINARIES} "${SHADER_DIR}/${OUTPUT}" PARENT_SCOPE)
+endfunction()
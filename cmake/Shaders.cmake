@@ -0,0 +1,20 @@
+# Shaders used by the application, shared by the desktop and Android builds
+# Requires CompileShaders to be included first
+compile_shader(skybox.frag skybox.frag.spv)
+compile_shader(skybox.vert skybox.vert.spv)
+compile_shader(ui.frag ui.frag.spv)
+compile_shader(ui.vert ui.vert.spv)
+compile_shader(pbr.vert pbr.vert.spv)
+compile_shader(cull.comp cull.comp.spv)
+compile_shader(material_pbr.frag material_pbr.frag.spv)
+compile_shader(material_unlit.frag material_unlit.frag.spv)
+compile_shader(material_pbr.frag material_pbr_bindless.frag.spv BINDLESS)
+compile_shader(material_unlit.frag material_unlit_bindless.frag.spv BINDLESS)
+compile_shader(genbrdflut.comp genbrdflut.comp.spv)
+compile_shader(genbrdflut.comp genbrdflut_rgba16f.comp.spv OUTPUT_RGBA16F)
+compile_shader(irradiancecube.comp irradiancecube.comp.spv)
+compile_shader(prefilterenvmap.comp prefilterenvmap.comp.spv)
+compile_shader(irradiancecube.comp irradiancecube_packed.comp.spv OUTPUT_PACKED)
+compile_shader(prefilterenvmap.comp prefilterenvmap_packed.comp.spv OUTPUT_PACKED)
+compile_shader(shirradiance.comp shirradiance.comp.spv)
+add_custom_target(shaders DEPENDS ${SHADER_BINARIES})
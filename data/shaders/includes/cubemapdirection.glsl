@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: MIT */
+
+// Returns the (unnormalized) direction of a cube map texel, with z = face index in the order +X, -X, +Y, -Y, +Z, -Z
+vec3 cubeMapDirection(uvec3 texel, ivec2 size)
+{
+	vec2 uv = (vec2(texel.xy) + 0.5) / vec2(size) * 2.0 - 1.0;
+	switch (texel.z) {
+		case 0: return vec3(1.0, -uv.y, -uv.x);
+		case 1: return vec3(-1.0, -uv.y, uv.x);
+		case 2: return vec3(uv.x, 1.0, uv.y);
+		case 3: return vec3(uv.x, -1.0, -uv.y);
+		case 4: return vec3(uv.x, -uv.y, 1.0);
+		default: return vec3(-uv.x, -uv.y, -1.0);
+	}
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: MIT */
+
+// Material feature bitmask, set by the application per pipeline using a specialization constant
+// As the value is constant at pipeline creation time, branches on features are resolved by the driver and unused code paths are removed
+
+layout (constant_id = 0) const uint MATERIAL_FEATURES = 0;
+
+#define MATERIAL_FEATURE_BASE_COLOR_TEXTURE (1u << 0)
+#define MATERIAL_FEATURE_PHYSICAL_DESCRIPTOR_TEXTURE (1u << 1)
+#define MATERIAL_FEATURE_NORMAL_TEXTURE (1u << 2)
+#define MATERIAL_FEATURE_OCCLUSION_TEXTURE (1u << 3)
+#define MATERIAL_FEATURE_EMISSIVE_TEXTURE (1u << 4)
+#define MATERIAL_FEATURE_SPECULAR_GLOSSINESS (1u << 5)
+#define MATERIAL_FEATURE_ALPHA_MASK (1u << 6)
+#define MATERIAL_FEATURE_DEBUG_VIEW (1u << 7)
+
+bool hasMaterialFeature(uint feature)
+{
+	return (MATERIAL_FEATURES & feature) != 0u;
+}
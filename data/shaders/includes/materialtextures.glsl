@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: MIT */
+
+// Material texture bindings
+// If BINDLESS is defined (e.g. glslc -DBINDLESS material_pbr.frag -o material_pbr_bindless.frag.spv), all textures of the scene are
+// accessed through a single array indexed with the texture indices stored in the material, otherwise each material binds its own set
+// The names below are used like regular samplers and require a ShaderMaterial named "material" in the calling scope
+
+#ifdef BINDLESS
+
+// Index 0 is an empty texture used for materials without a texture
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+#define colorMap textures[nonuniformEXT(material.baseColorTextureIndex)]
+#define physicalDescriptorMap textures[nonuniformEXT(material.physicalDescriptorTextureIndex)]
+#define normalMap textures[nonuniformEXT(material.normalTextureIndex)]
+#define aoMap textures[nonuniformEXT(material.occlusionTextureIndex)]
+#define emissiveMap textures[nonuniformEXT(material.emissiveTextureIndex)]
+
+#else
+
+layout (set = 1, binding = 0) uniform sampler2D colorMap;
+layout (set = 1, binding = 1) uniform sampler2D physicalDescriptorMap;
+layout (set = 1, binding = 2) uniform sampler2D normalMap;
+layout (set = 1, binding = 3) uniform sampler2D aoMap;
+layout (set = 1, binding = 4) uniform sampler2D emissiveMap;
+
+#endif
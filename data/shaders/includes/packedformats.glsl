@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT */
+
+// Packing functions for unsigned float formats that can't be written as storage images directly
+
+// VK_FORMAT_B10G11R11_UFLOAT_PACK32: Channels are converted to half floats, with the mantissa truncated to 6 (red, green) or 5 (blue) bits
+uint packB10G11R11(vec3 color)
+{
+	color = clamp(color, vec3(0.0), vec3(65000.0));
+	uint rg = packHalf2x16(color.rg);
+	uint b = packHalf2x16(vec2(color.b, 0.0));
+	uint r11 = (rg >> 4) & 0x7FFu;
+	uint g11 = (rg >> 20) & 0x7FFu;
+	uint b10 = (b >> 5) & 0x3FFu;
+	return r11 | (g11 << 11) | (b10 << 22);
+}
+
+// VK_FORMAT_E5B9G9R9_UFLOAT_PACK32: Three 9 bit mantissas with a shared 5 bit exponent (EXT_texture_shared_exponent)
+uint packE5B9G9R9(vec3 color)
+{
+	const float maxValue = 65408.0;
+	color = clamp(color, vec3(0.0), vec3(maxValue));
+	float maxChannel = max(color.r, max(color.g, color.b));
+	int sharedExponent = max(-16, int(floor(log2(max(maxChannel, 1.0e-30))))) + 16;
+	float denominator = exp2(float(sharedExponent - 24));
+	if (floor(maxChannel / denominator + 0.5) >= 512.0) {
+		denominator *= 2.0;
+		sharedExponent += 1;
+	}
+	uvec3 mantissa = uvec3(floor(color / denominator + 0.5));
+	return mantissa.r | (mantissa.g << 9) | (mantissa.b << 18) | (uint(sharedExponent) << 27);
+}
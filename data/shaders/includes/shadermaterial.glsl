@@ -20,4 +20,10 @@ struct ShaderMaterial {
 	float alphaMask;	
 	float alphaMaskCutoff;
 	float emissiveStrength;
+	// Indices into the bindless texture array
+	int baseColorTextureIndex;
+	int physicalDescriptorTextureIndex;
+	int normalTextureIndex;
+	int occlusionTextureIndex;
+	int emissiveTextureIndex;
 };
\ No newline at end of file
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: MIT */
+
+// Real L2 spherical harmonics basis (9 coefficients) for a normalized direction
+void shBasis(vec3 n, out float basis[9])
+{
+	basis[0] = 0.282095;
+	basis[1] = 0.488603 * n.y;
+	basis[2] = 0.488603 * n.z;
+	basis[3] = 0.488603 * n.x;
+	basis[4] = 1.092548 * n.x * n.y;
+	basis[5] = 1.092548 * n.y * n.z;
+	basis[6] = 0.315392 * (3.0 * n.z * n.z - 1.0);
+	basis[7] = 1.092548 * n.x * n.z;
+	basis[8] = 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// Evaluates coefficients that already contain the cosine lobe convolution, so the result matches the irradiance cube map
+vec3 evaluateSH9(vec4 coefficients[9], vec3 n)
+{
+	float basis[9];
+	shBasis(n, basis);
+	vec3 result = vec3(0.0);
+	for (int i = 0; i < 9; i++) {
+		result += coefficients[i].rgb * basis[i];
+	}
+	return max(result, vec3(0.0));
+}
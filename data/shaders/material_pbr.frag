@@ -10,12 +10,16 @@
 
 #version 450
 #extension GL_GOOGLE_include_directive : require
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV0;
 layout (location = 3) in vec2 inUV1;
 layout (location = 4) in vec4 inColor0;
+layout (location = 5) flat in int inMaterialIndex;
 
 // Scene bindings
 
@@ -34,6 +38,10 @@ layout (set = 0, binding = 1) uniform UBOParams {
 	float scaleIBLAmbient;
 	float debugViewInputs;
 	float debugViewEquation;
+	// If > 0, diffuse irradiance is evaluated from the spherical harmonics coefficients instead of the irradiance cube map
+	float shIrradiance;
+	float _pad0;
+	vec4 shCoefficients[9];
 } uboParams;
 
 layout (set = 0, binding = 2) uniform samplerCube samplerIrradiance;
@@ -42,28 +50,20 @@ layout (set = 0, binding = 4) uniform sampler2D samplerBRDFLUT;
 
 // Material bindings
 
-// Textures
-
-layout (set = 1, binding = 0) uniform sampler2D colorMap;
-layout (set = 1, binding = 1) uniform sampler2D physicalDescriptorMap;
-layout (set = 1, binding = 2) uniform sampler2D normalMap;
-layout (set = 1, binding = 3) uniform sampler2D aoMap;
-layout (set = 1, binding = 4) uniform sampler2D emissiveMap;
-
 // Properties
 
 #include "includes/shadermaterial.glsl"
 
+// Textures
+
+#include "includes/materialtextures.glsl"
+#include "includes/materialfeatures.glsl"
+
 layout(std430, set = 3, binding = 0) readonly buffer SSBO
 {
    ShaderMaterial materials[ ];
 };
 
-layout (push_constant) uniform PushConstants {
-	int meshIndex;
-	int materialIndex;
-} pushConstants;
-
 layout (location = 0) out vec4 outColor;
 
 // Encapsulate the various inputs used by the various functions in the shading equation
@@ -88,11 +88,9 @@ struct PBRInfo
 const float M_PI = 3.141592653589793;
 const float c_MinRoughness = 0.04;
 
-const float PBR_WORKFLOW_METALLIC_ROUGHNESS = 0.0;
-const float PBR_WORKFLOW_SPECULAR_GLOSSINESS = 1.0;
-
 #include "includes/tonemapping.glsl"
 #include "includes/srgbtolinear.glsl"
+#include "includes/sphericalharmonics.glsl"
 
 // Find the normal for this fragment, pulling either from a predefined normal map
 // or from the interpolated mesh normal and tangent attributes.
@@ -122,7 +120,8 @@ vec3 getIBLContribution(PBRInfo pbrInputs, vec3 n, vec3 reflection)
 	float lod = (pbrInputs.perceptualRoughness * uboParams.prefilteredCubeMipLevels);
 	// retrieve a scale and bias to F0. See [1], Figure 3
 	vec3 brdf = (texture(samplerBRDFLUT, vec2(pbrInputs.NdotV, 1.0 - pbrInputs.perceptualRoughness))).rgb;
-	vec3 diffuseLight = SRGBtoLINEAR(tonemap(texture(samplerIrradiance, n))).rgb;
+	vec4 irradiance = (uboParams.shIrradiance > 0.0) ? vec4(evaluateSH9(uboParams.shCoefficients, n), 1.0) : texture(samplerIrradiance, n);
+	vec3 diffuseLight = SRGBtoLINEAR(tonemap(irradiance)).rgb;
 
 	vec3 specularLight = SRGBtoLINEAR(tonemap(textureLod(prefilteredMap, reflection, lod))).rgb;
 
@@ -193,7 +192,7 @@ float convertMetallic(vec3 diffuse, vec3 specular, float maxSpecular) {
 
 void main()
 {
-	ShaderMaterial material = materials[pushConstants.materialIndex];
+	ShaderMaterial material = materials[inMaterialIndex];
 
 	float perceptualRoughness;
 	float metallic;
@@ -202,8 +201,8 @@ void main()
 
 	vec3 f0 = vec3(0.04);
 
-	if (material.alphaMask == 1.0f) {
-		if (material.baseColorTextureSet > -1) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_ALPHA_MASK)) {
+		if (hasMaterialFeature(MATERIAL_FEATURE_BASE_COLOR_TEXTURE)) {
 			baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
 		} else {
 			baseColor = material.baseColorFactor;
@@ -213,13 +212,13 @@ void main()
 		}
 	}
 
-	if (material.workflow == PBR_WORKFLOW_METALLIC_ROUGHNESS) {
+	if (!hasMaterialFeature(MATERIAL_FEATURE_SPECULAR_GLOSSINESS)) {
 		// Metallic and Roughness material properties are packed together
 		// In glTF, these factors can be specified by fixed scalar values
 		// or from a metallic-roughness map
 		perceptualRoughness = material.roughnessFactor;
 		metallic = material.metallicFactor;
-		if (material.physicalDescriptorTextureSet > -1) {
+		if (hasMaterialFeature(MATERIAL_FEATURE_PHYSICAL_DESCRIPTOR_TEXTURE)) {
 			// Roughness is stored in the 'g' channel, metallic is stored in the 'b' channel.
 			// This layout intentionally reserves the 'r' channel for (optional) occlusion map data
 			vec4 mrSample = texture(physicalDescriptorMap, material.physicalDescriptorTextureSet == 0 ? inUV0 : inUV1);
@@ -233,16 +232,16 @@ void main()
 		// convert to material roughness by squaring the perceptual roughness [2].
 
 		// The albedo may be defined from a base texture or a flat color
-		if (material.baseColorTextureSet > -1) {
+		if (hasMaterialFeature(MATERIAL_FEATURE_BASE_COLOR_TEXTURE)) {
 			baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
 		} else {
 			baseColor = material.baseColorFactor;
 		}
 	}
 
-	if (material.workflow == PBR_WORKFLOW_SPECULAR_GLOSSINESS) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_SPECULAR_GLOSSINESS)) {
 		// Values from specular glossiness workflow are converted to metallic roughness
-		if (material.physicalDescriptorTextureSet > -1) {
+		if (hasMaterialFeature(MATERIAL_FEATURE_PHYSICAL_DESCRIPTOR_TEXTURE)) {
 			perceptualRoughness = 1.0 - texture(physicalDescriptorMap, material.physicalDescriptorTextureSet == 0 ? inUV0 : inUV1).a;
 		} else {
 			perceptualRoughness = 0.0;
@@ -282,7 +281,7 @@ void main()
 	vec3 specularEnvironmentR0 = specularColor.rgb;
 	vec3 specularEnvironmentR90 = vec3(1.0, 1.0, 1.0) * reflectance90;
 
-	vec3 n = (material.normalTextureSet > -1) ? getNormal(material) : normalize(inNormal);
+	vec3 n = (hasMaterialFeature(MATERIAL_FEATURE_NORMAL_TEXTURE)) ? getNormal(material) : normalize(inNormal);
 	n.y *= -1.0f;
 	vec3 v = normalize(ubo.camPos - inWorldPos);    // Vector from surface point to camera
 	vec3 l = normalize(uboParams.lightDir.xyz);     // Vector from surface point to light
@@ -328,13 +327,13 @@ void main()
 
 	const float u_OcclusionStrength = 1.0f;
 	// Apply optional PBR terms for additional (optional) shading
-	if (material.occlusionTextureSet > -1) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_OCCLUSION_TEXTURE)) {
 		float ao = texture(aoMap, (material.occlusionTextureSet == 0 ? inUV0 : inUV1)).r;
 		color = mix(color, color * ao, u_OcclusionStrength);
 	}
 
 	vec3 emissive = material.emissiveFactor.rgb * material.emissiveStrength;
-	if (material.emissiveTextureSet > -1) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_EMISSIVE_TEXTURE)) {
 		emissive *= SRGBtoLINEAR(texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1)).rgb;
 	};
 	color += emissive;
@@ -342,20 +341,20 @@ void main()
 	outColor = vec4(color, baseColor.a);
 
 	// Shader inputs debug visualization
-	if (uboParams.debugViewInputs > 0.0) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_DEBUG_VIEW) && (uboParams.debugViewInputs > 0.0)) {
 		int index = int(uboParams.debugViewInputs);
 		switch (index) {
 			case 1:
-				outColor.rgba = material.baseColorTextureSet > -1 ? texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1) : vec4(1.0f);
+				outColor.rgba = hasMaterialFeature(MATERIAL_FEATURE_BASE_COLOR_TEXTURE) ? texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1) : vec4(1.0f);
 				break;
 			case 2:
-				outColor.rgb = (material.normalTextureSet > -1) ? texture(normalMap, material.normalTextureSet == 0 ? inUV0 : inUV1).rgb : normalize(inNormal);
+				outColor.rgb = (hasMaterialFeature(MATERIAL_FEATURE_NORMAL_TEXTURE)) ? texture(normalMap, material.normalTextureSet == 0 ? inUV0 : inUV1).rgb : normalize(inNormal);
 				break;
 			case 3:
-				outColor.rgb = (material.occlusionTextureSet > -1) ? texture(aoMap, material.occlusionTextureSet == 0 ? inUV0 : inUV1).rrr : vec3(0.0f);
+				outColor.rgb = (hasMaterialFeature(MATERIAL_FEATURE_OCCLUSION_TEXTURE)) ? texture(aoMap, material.occlusionTextureSet == 0 ? inUV0 : inUV1).rrr : vec3(0.0f);
 				break;
 			case 4:
-				outColor.rgb = (material.emissiveTextureSet > -1) ? texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1).rgb : vec3(0.0f);
+				outColor.rgb = (hasMaterialFeature(MATERIAL_FEATURE_EMISSIVE_TEXTURE)) ? texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1).rgb : vec3(0.0f);
 				break;
 			case 5:
 				outColor.rgb = texture(physicalDescriptorMap, inUV0).bbb;
@@ -369,7 +368,7 @@ void main()
 
 	// PBR equation debug visualization
 	// "none", "Diff (l,n)", "F (l,h)", "G (l,v,h)", "D (h)", "Specular"
-	if (uboParams.debugViewEquation > 0.0) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_DEBUG_VIEW) && (uboParams.debugViewEquation > 0.0)) {
 		int index = int(uboParams.debugViewEquation);
 		switch (index) {
 			case 1:
@@ -6,12 +6,16 @@
 
 #version 450
 #extension GL_GOOGLE_include_directive : require
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV0;
 layout (location = 3) in vec2 inUV1;
 layout (location = 4) in vec4 inColor0;
+layout (location = 5) flat in int inMaterialIndex;
 
 // Scene bindings
 
@@ -38,42 +42,34 @@ layout (set = 0, binding = 4) uniform sampler2D samplerBRDFLUT;
 
 // Material bindings
 
-// Textures
-
-layout (set = 1, binding = 0) uniform sampler2D colorMap;
-layout (set = 1, binding = 1) uniform sampler2D physicalDescriptorMap;
-layout (set = 1, binding = 2) uniform sampler2D normalMap;
-layout (set = 1, binding = 3) uniform sampler2D aoMap;
-layout (set = 1, binding = 4) uniform sampler2D emissiveMap;
-
 // Properties
 
 #include "includes/shadermaterial.glsl"
 
+// Textures
+
+#include "includes/materialtextures.glsl"
+#include "includes/materialfeatures.glsl"
+
 layout(std430, set = 3, binding = 0) readonly buffer SSBO
 {
    ShaderMaterial materials[ ];
 };
 
-layout (push_constant) uniform PushConstants {
-	int meshIndex;
-	int materialIndex;
-} pushConstants;
-
 layout (location = 0) out vec4 outColor;
 
 #include "includes/srgbtolinear.glsl"
 
 void main()
 {
-	ShaderMaterial material = materials[pushConstants.materialIndex];
+	ShaderMaterial material = materials[inMaterialIndex];
 
 	float perceptualRoughness;
 	float metallic;
 	vec3 diffuseColor;
 	vec4 baseColor;
 
-	if (material.baseColorTextureSet > -1) {
+	if (hasMaterialFeature(MATERIAL_FEATURE_BASE_COLOR_TEXTURE)) {
 		baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
 	} else {
 		baseColor = material.baseColorFactor;
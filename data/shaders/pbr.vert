@@ -22,11 +22,10 @@ layout (set = 0, binding = 0) uniform UBO
 	vec3 camPos;
 } ubo;
 
-#define MAX_NUM_JOINTS 128
-
+// Matrices are affine and stored transposed as 3x4 to save space
 struct MeshShaderDataBlock {
-	mat4 matrix;
-	mat4 jointMatrix[MAX_NUM_JOINTS];
+	mat3x4 matrix;
+	uint jointOffset;
 	uint jointCount;
 };
 
@@ -35,6 +34,36 @@ layout(std430, set = 2, binding = 0) readonly buffer SSBO
    MeshShaderDataBlock meshData[];
 };
 
+// Joint matrices of all skinned meshes
+layout(std430, set = 2, binding = 1) readonly buffer JointSSBO
+{
+   mat3x4 jointMatrices[];
+};
+
+// Per primitive draw records used by indirect draws
+struct DrawRecord {
+	vec4 bbMin;
+	vec4 bbMax;
+	uint firstIndex;
+	uint indexCount;
+	uint meshIndex;
+	uint materialIndex;
+	uint bucket;
+	uint commandOffset;
+	uint flags;
+	uint padding;
+};
+
+layout(std430, set = 2, binding = 2) readonly buffer DrawRecordSSBO
+{
+   DrawRecord drawRecords[];
+};
+
+mat4 unpackMatrix(mat3x4 m)
+{
+	return mat4(transpose(m));
+}
+
 layout (push_constant) uniform PushConstants {
 	int meshIndex;
 	int materialIndex;
@@ -45,25 +74,36 @@ layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec2 outUV0;
 layout (location = 3) out vec2 outUV1;
 layout (location = 4) out vec4 outColor0;
+layout (location = 5) flat out int outMaterialIndex;
 
 void main() 
 {
 	outColor0 = inColor0;
 
+	// A negative mesh index is passed for indirect draws, which pass the index of their draw record as the first instance instead
+	int meshIndex = pushConstants.meshIndex;
+	outMaterialIndex = pushConstants.materialIndex;
+	if (meshIndex < 0) {
+		meshIndex = int(drawRecords[gl_InstanceIndex].meshIndex);
+		outMaterialIndex = int(drawRecords[gl_InstanceIndex].materialIndex);
+	}
+
 	vec4 locPos;
-	if (meshData[pushConstants.meshIndex].jointCount > 0) {
+	MeshShaderDataBlock mesh = meshData[meshIndex];
+	mat4 meshMatrix = unpackMatrix(mesh.matrix);
+	if (mesh.jointCount > 0) {
 		// Mesh is skinned
-		mat4 skinMat = 
-			inWeight0.x * meshData[pushConstants.meshIndex].jointMatrix[inJoint0.x] +
-			inWeight0.y * meshData[pushConstants.meshIndex].jointMatrix[inJoint0.y] +
-			inWeight0.z * meshData[pushConstants.meshIndex].jointMatrix[inJoint0.z] +
-			inWeight0.w * meshData[pushConstants.meshIndex].jointMatrix[inJoint0.w];
+		mat4 skinMat = unpackMatrix(
+			inWeight0.x * jointMatrices[mesh.jointOffset + inJoint0.x] +
+			inWeight0.y * jointMatrices[mesh.jointOffset + inJoint0.y] +
+			inWeight0.z * jointMatrices[mesh.jointOffset + inJoint0.z] +
+			inWeight0.w * jointMatrices[mesh.jointOffset + inJoint0.w]);
 
-		locPos = ubo.model * meshData[pushConstants.meshIndex].matrix * skinMat * vec4(inPos, 1.0);
-		outNormal = normalize(transpose(inverse(mat3(ubo.model * meshData[pushConstants.meshIndex].matrix * skinMat))) * inNormal);
+		locPos = ubo.model * meshMatrix * skinMat * vec4(inPos, 1.0);
+		outNormal = normalize(transpose(inverse(mat3(ubo.model * meshMatrix * skinMat))) * inNormal);
 	} else {
-		locPos = ubo.model * meshData[pushConstants.meshIndex].matrix * vec4(inPos, 1.0);
-		outNormal = normalize(transpose(inverse(mat3(ubo.model * meshData[pushConstants.meshIndex].matrix))) * inNormal);
+		locPos = ubo.model * meshMatrix * vec4(inPos, 1.0);
+		outNormal = normalize(transpose(inverse(mat3(ubo.model * meshMatrix))) * inNormal);
 	}
 	locPos.y = -locPos.y;
 	outWorldPos = locPos.xyz / locPos.w;
@@ -17,6 +17,9 @@
 #include <chrono>
 #include <map>
 #include <unordered_map>
+#include <iomanip>
+#include <thread>
+#include <atomic>
 #include "algorithm"
 
 #include <vulkan/vulkan.h>
@@ -24,6 +27,11 @@
 #include "VulkanTexture.hpp"
 #include "VulkanglTFModel.h"
 #include "VulkanUtils.hpp"
+#include "VulkanStagingRing.hpp"
+#include "frustum.hpp"
+#include "FrameBenchmark.hpp"
+#include "GPUProfiler.hpp"
+#include "Trace.hpp"
 #include "ui.hpp"
 
 #define GLM_FORCE_RADIANS
@@ -71,12 +79,159 @@ public:
 		float scaleIBLAmbient = 1.0f;
 		float debugViewInputs = 0;
 		float debugViewEquation = 0;
+		// If > 0, diffuse irradiance is evaluated from spherical harmonics instead of sampling the irradiance cube map
+		float shIrradiance = 0.0f;
+		float _pad0;
+		// L2 spherical harmonics coefficients of the environment, already convolved with the cosine lobe
+		glm::vec4 shCoefficients[9];
 	} shaderValuesParams;
 
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 
 	std::unordered_map<std::string, VkPipeline> pipelines;
-	VkPipeline boundPipeline{ VK_NULL_HANDLE };
+
+	// Material features passed to the material shaders as a specialization constant, so pipelines only contain the code paths used by a material
+	enum MaterialFeatures {
+		MATERIAL_FEATURE_BASE_COLOR_TEXTURE = 1 << 0,
+		MATERIAL_FEATURE_PHYSICAL_DESCRIPTOR_TEXTURE = 1 << 1,
+		MATERIAL_FEATURE_NORMAL_TEXTURE = 1 << 2,
+		MATERIAL_FEATURE_OCCLUSION_TEXTURE = 1 << 3,
+		MATERIAL_FEATURE_EMISSIVE_TEXTURE = 1 << 4,
+		MATERIAL_FEATURE_SPECULAR_GLOSSINESS = 1 << 5,
+		MATERIAL_FEATURE_ALPHA_MASK = 1 << 6,
+		MATERIAL_FEATURE_DEBUG_VIEW = 1 << 7,
+	};
+	// Shaders of a material pipeline set, pipelines for the feature combinations used by a scene are created on first use
+	struct MaterialPipelineSet {
+		std::string vertexShader;
+		std::string fragmentShader;
+		// Features evaluated by the fragment shader, other bits are masked out to avoid creating identical pipelines
+		uint32_t supportedFeatures;
+	};
+	std::unordered_map<std::string, MaterialPipelineSet> materialPipelineSets;
+
+	// All primitives of the scene in the order they are drawn, sorted by alpha mode, pipeline, material and mesh to minimize state changes
+	struct RenderItem {
+		uint64_t sortKey;
+		uint32_t pipelineIndex;
+		vkglTF::Node* node;
+		vkglTF::Primitive* primitive;
+		// Set if the item is drawn by the GPU driven path, as part of the bucket with the given index
+		bool indirect = false;
+		uint32_t bucket = 0;
+	};
+	std::vector<RenderItem> renderList;
+	// Pipelines referenced by render items, resolved to pipeline handles once per frame
+	struct RenderPipeline {
+		std::string set;
+		// Empty (back-face culling), "_double_sided" or "_alpha_blending"
+		std::string variant;
+		uint32_t materialFeatures;
+		bool operator==(const RenderPipeline& other) const { return (set == other.set) && (variant == other.variant) && (materialFeatures == other.materialFeatures); }
+	};
+	std::vector<RenderPipeline> renderPipelines;
+	struct RenderStats {
+		uint32_t draws = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorSetBinds = 0;
+	} renderStats;
+
+	// Optional GPU driven rendering: A compute shader frustum culls all indexed primitives and writes indirect draw commands, which are
+	// then drawn with one indirect call per bucket (consecutive render list items sharing the same pipeline and material)
+	struct alignas(16) ShaderDrawRecord {
+		glm::vec4 bbMin;
+		glm::vec4 bbMax;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t meshIndex;
+		uint32_t materialIndex;
+		uint32_t bucket;
+		// First command of the bucket, or the command of this record for ordered buckets
+		uint32_t commandOffset;
+		uint32_t flags;
+		uint32_t padding;
+	};
+	struct GPUDriven {
+		enum Flags { ALWAYS_VISIBLE = 1, ORDERED = 2 };
+		struct Bucket {
+			uint32_t pipelineIndex;
+			const vkglTF::Material* material;
+			uint32_t firstCommand;
+			uint32_t maxDrawCount;
+			// Transparent primitives must keep their order, so commands of these buckets are not compacted
+			bool ordered;
+		};
+		bool requested = false;
+		bool supported = false;
+		bool enabled = false;
+		PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR{ nullptr };
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		std::vector<VkDescriptorSet> descriptorSets;
+		// Draw records of all indexed primitives, the vertex shader fetches mesh and material indices from these
+		Buffer drawRecords;
+		std::vector<Buffer> drawCommands;
+		// Host visible, so the number of visible draws can be read back once a frame has completed
+		std::vector<Buffer> drawCounts;
+		std::vector<Bucket> buckets;
+		uint32_t drawCount = 0;
+		uint32_t visibleDraws = 0;
+	} gpuDriven;
+
+	// Optional bindless material textures: All textures of the scene are stored in one descriptor array that's indexed using the texture indices
+	// from the material buffer, so all materials share the same descriptor set and changing materials only requires a push constant
+	struct Bindless {
+		bool requested = false;
+		bool enabled = false;
+		// Size of the texture array in the descriptor set layout, needs to be the same for all scenes as pipelines are only created once
+		uint32_t maxTextures = 0;
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+	} bindless;
+
+	// Generated image based lighting maps are stored as KTX files and loaded instead of being generated again if their cache key matches
+	struct IBLCache {
+		bool enabled = true;
+		// Needs to be incremented whenever the output of the generation shaders changes
+		const uint32_t version = 1;
+	} iblCache;
+
+	// Optional packed 32 bit formats for the generated cube maps, these can't be used as storage images so they're written to R32_UINT images and copied
+	struct IBLFormats {
+		VkFormat requested = VK_FORMAT_UNDEFINED;
+		VkFormat irradiance = VK_FORMAT_R32G32B32A32_SFLOAT;
+		VkFormat prefiltered = VK_FORMAT_R16G16B16A16_SFLOAT;
+		// Memory used by the generated cube maps, and by the same maps in the default formats
+		VkDeviceSize size = 0;
+		VkDeviceSize defaultSize = 0;
+	} iblFormats;
+
+	// Heap budgets and usage of the process are reported along with the allocator's own accounting if VK_EXT_memory_budget is supported
+	bool memoryBudgetSupported = false;
+
+	// GPU times of the passes of each frame, read back once the frame's fence has signaled
+	vks::GPUProfiler gpuProfiler;
+	std::vector<vks::GPUProfiler::Result> gpuProfilerResults;
+	// Index of the benchmark sample measured by each frame in flight, -1 if none
+	std::vector<int64_t> profiledBenchmarkSamples;
+	// GPU times of the stages of the last image based lighting generation
+	std::vector<vks::GPUProfiler::Result> iblGenerationTimes;
+
+	// Renders a fixed number of frames with a fixed animation time step and a scripted camera orbit, and exports frame time statistics
+	struct Benchmark : public vks::FrameBenchmark {
+		size_t frameSeries = 0;
+		size_t cpuSeries = 0;
+		// One series per profiler scope
+		std::map<std::string, size_t> gpuSeries;
+		std::chrono::high_resolution_clock::time_point tLastFrame;
+		glm::vec3 cameraRotation;
+	} benchmark;
+	std::string sceneFileName;
+
+	// CPU scope trace is written to this file on exit if set
+	std::string traceFileName;
+	// The load report of each scene is written to this file (as JSON) if set, it's always printed to stdout
+	std::string loadReportFileName;
 
 	struct DescriptorSetLayouts {
 		VkDescriptorSetLayout scene{ VK_NULL_HANDLE };
@@ -139,8 +294,16 @@ public:
 		float alphaMask;
 		float alphaMaskCutoff;
 		float emissiveStrength;
+		// Indices into the bindless texture array
+		int colorTextureIndex;
+		int physicalDescriptorTextureIndex;
+		int normalTextureIndex;
+		int occlusionTextureIndex;
+		int emissiveTextureIndex;
 	};
 	Buffer shaderMaterialBuffer;
+	// Uploads done while rendering are staged in this ring and copied from within the frame's command buffer
+	vks::StagingRing stagingRing;
 	VkDescriptorSet descriptorSetMaterials{ VK_NULL_HANDLE };
 
 	struct MeshPushConstantBlock {
@@ -149,12 +312,25 @@ public:
 	};
 
 	// We use a large buffer to store all per mesh data that needs to be passed to the shader
-	struct alignas(16) ShaderMeshData {
-		glm::mat4 matrix;
-		glm::mat4 jointMatrix[MAX_NUM_JOINTS]{};
-		uint32_t jointcount{ 0 };
-	};
+	using ShaderMeshData = vkglTF::ShaderMeshData;
 	std::vector<Buffer> shaderMeshDataBuffers;
+	// Joint matrices of all skinned meshes tightly packed into one buffer (palette)
+	std::vector<Buffer> shaderJointBuffers;
+	// CPU side copies of the buffer contents and the meshes they were created from (in mesh index order)
+	std::vector<ShaderMeshData> shaderMeshData;
+	std::vector<glm::mat3x4> shaderJointData;
+	std::vector<vkglTF::Mesh*> shaderMeshes;
+	// Mesh versions last written to the buffers of each frame in flight, only meshes that changed since are updated
+	std::vector<std::vector<uint32_t>> shaderMeshVersions;
+
+	// View frustum culling, visibility is stored per node using the node's transform index
+	vks::Frustum frustum;
+	bool frustumCulling = true;
+	std::vector<uint8_t> nodeVisible;
+	struct CullingStats {
+		uint32_t visible = 0;
+		uint32_t culled = 0;
+	} cullingStats;
 	std::vector<VkDescriptorSet> descriptorSetsMeshData;
 
 	std::map<std::string, std::string> environments;
@@ -183,6 +359,72 @@ public:
 #if defined(TINYGLTF_ENABLE_DRACO)
 		std::cout << "Draco mesh compression is enabled" << std::endl;
 #endif
+		// Required to query the descriptor indexing features and heap budgets
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		for (size_t i = 0; i < args.size(); i++) {
+			// Resample animations to a fixed key rate for constant time key lookup
+			if ((args[i] == std::string("--animation-sample-rate")) && (i + 1 < args.size())) {
+				models.scene.animationSampleRate = static_cast<float>(atof(args[i + 1]));
+			}
+			// Cull and draw on the GPU with indirect draws (if supported)
+			if (args[i] == std::string("--gpu-driven")) {
+				gpuDriven.requested = true;
+			}
+			// Access all material textures through a single descriptor array (if supported)
+			if (args[i] == std::string("--bindless")) {
+				bindless.requested = true;
+			}
+			// Always generate the image based lighting maps instead of loading them from the cache
+			if (args[i] == std::string("--no-ibl-cache")) {
+				iblCache.enabled = false;
+			}
+			// Store the generated cube maps in a packed format (b10g11r11 or e5b9g9r9)
+			if ((args[i] == std::string("--ibl-format")) && (i + 1 < args.size())) {
+				const std::string format = args[i + 1];
+				if (format == "b10g11r11") {
+					iblFormats.requested = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+				} else if (format == "e5b9g9r9") {
+					iblFormats.requested = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+				} else {
+					std::cerr << "Unknown image based lighting format \"" << format << "\", using default formats" << std::endl;
+				}
+			}
+			// Use spherical harmonics for diffuse irradiance, no irradiance cube map is generated
+			if (args[i] == std::string("--sh-irradiance")) {
+				shaderValuesParams.shIrradiance = 1.0f;
+			}
+			// Render a fixed sequence of frames and write frame time statistics
+			if (args[i] == std::string("--benchmark")) {
+				benchmark.active = true;
+			}
+			if ((args[i] == std::string("--benchmark-warmup")) && (i + 1 < args.size())) {
+				benchmark.warmupFrames = static_cast<uint32_t>(atoi(args[i + 1]));
+			}
+			if ((args[i] == std::string("--benchmark-frames")) && (i + 1 < args.size())) {
+				benchmark.frameCount = std::max(static_cast<uint32_t>(atoi(args[i + 1])), 1u);
+			}
+			if ((args[i] == std::string("--benchmark-timestep")) && (i + 1 < args.size())) {
+				benchmark.timestep = static_cast<float>(atof(args[i + 1]));
+			}
+			if ((args[i] == std::string("--benchmark-orbit")) && (i + 1 < args.size())) {
+				benchmark.orbitSpeed = static_cast<float>(atof(args[i + 1]));
+			}
+			if ((args[i] == std::string("--benchmark-output")) && (i + 1 < args.size())) {
+				benchmark.outputFileName = args[i + 1];
+			}
+			// Record CPU scopes and save them as a Chrome trace (chrome://tracing, Perfetto) on exit
+			if (args[i] == std::string("--trace")) {
+				traceFileName = ((i + 1 < args.size()) && (args[i + 1][0] != '-')) ? args[i + 1] : "trace.json";
+				vks::trace::enable();
+			}
+			if ((args[i] == std::string("--load-report")) && (i + 1 < args.size())) {
+				loadReportFileName = args[i + 1];
+			}
+		}
+		// The headless render loop needs to cover all frames of the benchmark
+		if (benchmark.active && settings.headless) {
+			settings.headlessFrameCount = benchmark.warmupFrames + benchmark.frameCount;
+		}
 	}
 
 	~VulkanApplication()
@@ -197,8 +439,29 @@ public:
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.materialBuffer, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.meshDataBuffer, nullptr);
 
+		for (auto& buffer : shaderMeshDataBuffers) {
+			buffer.destroy();
+		}
+		for (auto& buffer : shaderJointBuffers) {
+			buffer.destroy();
+		}
+		gpuProfiler.destroy();
+		gpuDriven.drawRecords.destroy();
+		for (auto& buffer : gpuDriven.drawCommands) {
+			buffer.destroy();
+		}
+		for (auto& buffer : gpuDriven.drawCounts) {
+			buffer.destroy();
+		}
+		if (gpuDriven.pipeline != VK_NULL_HANDLE) {
+			vkDestroyPipeline(device, gpuDriven.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, gpuDriven.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, gpuDriven.descriptorSetLayout, nullptr);
+		}
+
 		models.scene.destroy(device);
 		models.skybox.destroy(device);
+		stagingRing.destroy();
 
 		for (auto buffer : uniformBuffers) {
 			buffer.params.destroy();
@@ -215,13 +478,24 @@ public:
 			vkDestroySemaphore(device, semaphore, nullptr);
 		}
 
-		textures.environmentCube.destroy();
-		textures.irradianceCube.destroy();
-		textures.prefilteredCube.destroy();
+		if (environmentLoader.thread.joinable()) {
+			environmentLoader.thread.join();
+		}
+		if (environmentLoader.generation.fence != VK_NULL_HANDLE) {
+			finishIBLGeneration(environmentLoader.generation);
+		}
+		destroyEnvironmentMaps(environmentLoader.environmentCube, environmentLoader.irradianceCube, environmentLoader.prefilteredCube);
+		destroyEnvironmentMaps(environmentLoader.retiredEnvironmentCube, environmentLoader.retiredIrradianceCube, environmentLoader.retiredPrefilteredCube);
+		destroyEnvironmentMaps(textures.environmentCube, textures.irradianceCube, textures.prefilteredCube);
 		textures.lutBrdf.destroy();
 		textures.empty.destroy();
 
 		delete ui;
+
+		// All threads recording scopes have been joined at this point
+		if (!traceFileName.empty()) {
+			vks::trace::save(traceFileName);
+		}
 	}
 
 	void resetCamera() {
@@ -230,67 +504,282 @@ public:
 		camera.updateViewMatrix();
 	}
 
-	void renderNode(vkglTF::Node *node, uint32_t cbIndex, vkglTF::Material::AlphaMode alphaMode) {
+	// Nodes whose bounds are completely inside or outside of the frustum decide visibility for their whole subtree
+	void cullNode(vkglTF::Node* node, bool inside)
+	{
+		if (!inside && node->bvh.valid) {
+			const vks::Frustum::Result result = frustum.checkBox(node->bvh.min, node->bvh.max);
+			if (result == vks::Frustum::OUTSIDE) {
+				return;
+			}
+			inside = (result == vks::Frustum::INSIDE);
+		}
 		if (node->mesh) {
-			// Render mesh primitives
-			for (vkglTF::Primitive * primitive : node->mesh->primitives) {
-				if (primitive->material.alphaMode == alphaMode) {
-					std::string pipelineName = "pbr";
-					std::string pipelineVariant = "";
-
-					if (primitive->material.unlit) {
-						// KHR_materials_unlit
-						pipelineName = "unlit";
-					};
+			// For nodes without children the bvh only contains the node's mesh
+			bool visible = inside || node->children.empty() || !node->aabb.valid || (frustum.checkBox(node->aabb.min, node->aabb.max) != vks::Frustum::OUTSIDE);
+			if (visible) {
+				nodeVisible[node->transformIndex] = 1;
+				cullingStats.visible++;
+			}
+		}
+		for (auto child : node->children) {
+			cullNode(child, inside);
+		}
+	}
 
-					// Material properties define if we e.g. need to bind a pipeline variant with culling disabled (double sided)
-					if (alphaMode == vkglTF::Material::ALPHAMODE_BLEND) {
-						pipelineVariant = "_alpha_blending";
-					} else {
-						if (primitive->material.doubleSided) {
-							pipelineVariant = "_double_sided";
-						}
-					}
+	void cullScene()
+	{
+		vkglTF::Model& model = models.scene;
+		const uint32_t meshCount = static_cast<uint32_t>(shaderMeshes.size());
+		cullingStats = {};
+		// Node bounds are in model space, and the vertex shader flips the y axis after applying the model matrix
+		const glm::mat4 flipY = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+		frustum.update(camera.matrices.perspective * camera.matrices.view * flipY * shaderValuesScene.model);
+		if (!frustumCulling) {
+			nodeVisible.assign(model.transforms.size(), 1);
+			cullingStats.visible = meshCount;
+			return;
+		}
+		nodeVisible.assign(model.transforms.size(), 0);
+		for (auto node : model.nodes) {
+			cullNode(node, false);
+		}
+		cullingStats.culled = meshCount - cullingStats.visible;
+	}
 
-					const VkPipeline pipeline = pipelines[pipelineName + pipelineVariant];
+	uint32_t getMaterialFeatures(const vkglTF::Material& material)
+	{
+		uint32_t features = 0;
+		const bool specularGlossiness = !material.pbrWorkflows.metallicRoughness && material.pbrWorkflows.specularGlossiness;
+		if (specularGlossiness) {
+			features |= MATERIAL_FEATURE_SPECULAR_GLOSSINESS;
+			features |= material.extension.diffuseTexture ? MATERIAL_FEATURE_BASE_COLOR_TEXTURE : 0;
+			features |= material.extension.specularGlossinessTexture ? MATERIAL_FEATURE_PHYSICAL_DESCRIPTOR_TEXTURE : 0;
+		} else {
+			features |= material.baseColorTexture ? MATERIAL_FEATURE_BASE_COLOR_TEXTURE : 0;
+			features |= material.metallicRoughnessTexture ? MATERIAL_FEATURE_PHYSICAL_DESCRIPTOR_TEXTURE : 0;
+		}
+		features |= material.normalTexture ? MATERIAL_FEATURE_NORMAL_TEXTURE : 0;
+		features |= material.occlusionTexture ? MATERIAL_FEATURE_OCCLUSION_TEXTURE : 0;
+		features |= material.emissiveTexture ? MATERIAL_FEATURE_EMISSIVE_TEXTURE : 0;
+		features |= (material.alphaMode == vkglTF::Material::ALPHAMODE_MASK) ? MATERIAL_FEATURE_ALPHA_MASK : 0;
+		return features;
+	}
 
-					if (pipeline != boundPipeline) {
-						vkCmdBindPipeline(commandBuffers[cbIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-						boundPipeline = pipeline;
-					}
+	std::string getPipelineName(const std::string& set, const std::string& variant, uint32_t materialFeatures)
+	{
+		std::stringstream name;
+		name << set << variant;
+		if (materialFeatures != 0) {
+			name << "_" << std::hex << materialFeatures;
+		}
+		return name.str();
+	}
 
-					const std::vector<VkDescriptorSet> descriptorsets = {
-						descriptorSets[cbIndex].scene,
-						primitive->material.descriptorSet,
-						// @todo: per frame-in-flight
-						descriptorSetsMeshData[cbIndex],
-						descriptorSetMaterials
-					};
-					vkCmdBindDescriptorSets(commandBuffers[cbIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
+	// Returns the pipeline for a render pipeline, the pipeline set for a new material feature combination is created on first use
+	VkPipeline getRenderPipeline(const RenderPipeline& renderPipeline)
+	{
+		const MaterialPipelineSet& pipelineSet = materialPipelineSets[renderPipeline.set];
+		uint32_t materialFeatures = renderPipeline.materialFeatures;
+		// Debug views are evaluated at runtime, only the pipelines used while they are active contain the code for them
+		if ((debugViewInputs > 0) || (debugViewEquation > 0)) {
+			materialFeatures |= MATERIAL_FEATURE_DEBUG_VIEW & pipelineSet.supportedFeatures;
+		}
+		const std::string name = getPipelineName(renderPipeline.set, renderPipeline.variant, materialFeatures);
+		auto it = pipelines.find(name);
+		if (it != pipelines.end()) {
+			return it->second;
+		}
+		addPipelineSet(renderPipeline.set, pipelineSet.vertexShader, pipelineSet.fragmentShader, materialFeatures);
+		return pipelines[name];
+	}
 
-					// Pass material index for this primitive using a push constant, the shader uses this to index into the material buffer
-					MeshPushConstantBlock pushConstantBlock{};
-					// @todo: index
-					pushConstantBlock.meshIndex = node->mesh->index;
-					pushConstantBlock.materialIndex = primitive->material.index;
-					vkCmdPushConstants(commandBuffers[cbIndex], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPushConstantBlock), &pushConstantBlock);
+	// Creates the pipelines of all render pipelines used by the current render list up-front instead of on the first draw
+	void prepareRenderPipelines()
+	{
+		for (const RenderPipeline& renderPipeline : renderPipelines) {
+			getRenderPipeline(renderPipeline);
+		}
+	}
 
-					if (primitive->hasIndices) {
-						vkCmdDrawIndexed(commandBuffers[cbIndex], primitive->indexCount, 1, primitive->firstIndex, 0, 0);
-					} else {
-						vkCmdDraw(commandBuffers[cbIndex], primitive->vertexCount, 1, 0, 0);
-					}
+	// Builds the sorted list of all primitives to be drawn, needs to be called whenever the scene changes
+	void buildRenderList()
+	{
+		renderList.clear();
+		renderPipelines.clear();
+		uint64_t sequence = 0;
+		for (auto node : models.scene.linearNodes) {
+			if (!node->mesh) {
+				continue;
+			}
+			for (vkglTF::Primitive* primitive : node->mesh->primitives) {
+				const vkglTF::Material& material = primitive->material;
+				RenderPipeline renderPipeline{};
+				renderPipeline.set = material.unlit ? "unlit" : "pbr";
+				// Material properties define if we e.g. need to bind a pipeline variant with culling disabled (double sided)
+				if (material.alphaMode == vkglTF::Material::ALPHAMODE_BLEND) {
+					renderPipeline.variant = "_alpha_blending";
+				} else if (material.doubleSided) {
+					renderPipeline.variant = "_double_sided";
+				}
+				renderPipeline.materialFeatures = getMaterialFeatures(material) & materialPipelineSets[renderPipeline.set].supportedFeatures;
+				auto it = std::find(renderPipelines.begin(), renderPipelines.end(), renderPipeline);
+				const uint32_t pipelineIndex = static_cast<uint32_t>(it - renderPipelines.begin());
+				if (it == renderPipelines.end()) {
+					renderPipelines.push_back(renderPipeline);
 				}
+				// Sort key layout: alpha mode (2 bits), pipeline (8 bits), material (24 bits), mesh (30 bits)
+				// Opaque primitives are drawn first, then alpha masked and finally transparent primitives
+				uint64_t sortKey = (static_cast<uint64_t>(material.alphaMode) << 62) | (static_cast<uint64_t>(pipelineIndex & 0xFF) << 54);
+				if (material.alphaMode == vkglTF::Material::ALPHAMODE_BLEND) {
+					// @todo: Depth sorting, for now transparent primitives keep the order of the scene graph
+					sortKey |= sequence & ((1ull << 54) - 1);
+				} else {
+					sortKey |= (static_cast<uint64_t>(material.index & 0xFFFFFF) << 30) | (node->mesh->index & 0x3FFFFFFF);
+				}
+				sequence++;
+				renderList.push_back({ sortKey, pipelineIndex, node, primitive });
+			}
+		}
+		std::stable_sort(renderList.begin(), renderList.end(), [](const RenderItem& a, const RenderItem& b) { return a.sortKey < b.sortKey; });
+	}
+
+	// Records all visible render items, pipelines, descriptor sets and push constants are only changed if they differ from the last draw
+	void drawRenderList(VkCommandBuffer commandBuffer)
+	{
+		renderStats = {};
+		std::vector<VkPipeline> pipelineHandles(renderPipelines.size());
+		for (size_t i = 0; i < renderPipelines.size(); i++) {
+			pipelineHandles[i] = getRenderPipeline(renderPipelines[i]);
+		}
+
+		// The scene, mesh data and material buffer sets are the same for all draws
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[frameIndex].scene, 0, nullptr);
+		const std::array<VkDescriptorSet, 2> sharedSets = { descriptorSetsMeshData[frameIndex], descriptorSetMaterials };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, static_cast<uint32_t>(sharedSets.size()), sharedSets.data(), 0, nullptr);
+		renderStats.descriptorSetBinds += 2;
+
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		VkDescriptorSet boundMaterialSet = VK_NULL_HANDLE;
+		MeshPushConstantBlock pushedConstants{ -1, -1 };
+		bool constantsPushed = false;
+
+		auto bindPipelineAndMaterial = [&](uint32_t pipelineIndex, VkDescriptorSet materialSet) {
+			const VkPipeline pipeline = pipelineHandles[pipelineIndex];
+			if (pipeline != boundPipeline) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+				renderStats.pipelineBinds++;
+			}
+			if (materialSet != boundMaterialSet) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &materialSet, 0, nullptr);
+				boundMaterialSet = materialSet;
+				renderStats.descriptorSetBinds++;
+			}
+		};
+
+		auto pushConstants = [&](const MeshPushConstantBlock& pushConstantBlock) {
+			if (!constantsPushed || (pushConstantBlock.meshIndex != pushedConstants.meshIndex) || (pushConstantBlock.materialIndex != pushedConstants.materialIndex)) {
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPushConstantBlock), &pushConstantBlock);
+				pushedConstants = pushConstantBlock;
+				constantsPushed = true;
 			}
+		};
 
+		// GPU time is profiled per alpha mode, render items are sorted by alpha mode so each mode is a contiguous range of draws
+		const std::array<const char*, 3> alphaModeScopes = { "Opaque", "Mask", "Blend" };
+		int32_t profiledAlphaMode = -1;
+		auto profileAlphaMode = [&](int32_t alphaMode) {
+			if (alphaMode != profiledAlphaMode) {
+				if (profiledAlphaMode >= 0) {
+					gpuProfiler.endScope(commandBuffer);
+				}
+				gpuProfiler.beginScope(commandBuffer, alphaModeScopes[alphaMode]);
+				profiledAlphaMode = alphaMode;
+			}
 		};
-		for (auto child : node->children) {
-			renderNode(child, cbIndex, alphaMode);
+
+		// Buckets of the GPU driven path are drawn at the position of their first item, so indirect and CPU draws keep the order of the render list
+		uint32_t drawnBucket = UINT32_MAX;
+		for (const RenderItem& item : renderList) {
+			if (gpuDriven.enabled && item.indirect) {
+				if (item.bucket == drawnBucket) {
+					continue;
+				}
+				drawnBucket = item.bucket;
+				const GPUDriven::Bucket& bucket = gpuDriven.buckets[item.bucket];
+				profileAlphaMode(bucket.material->alphaMode);
+				bindPipelineAndMaterial(bucket.pipelineIndex, bucket.material->descriptorSet);
+				// A negative mesh index makes the vertex shader fetch mesh and material index from the draw record passed as the first instance
+				pushConstants({ -1, -1 });
+				const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+				const VkDeviceSize offset = bucket.firstCommand * stride;
+				if (bucket.ordered) {
+					vkCmdDrawIndexedIndirect(commandBuffer, gpuDriven.drawCommands[frameIndex].buffer, offset, bucket.maxDrawCount, stride);
+				} else {
+					gpuDriven.vkCmdDrawIndexedIndirectCountKHR(commandBuffer, gpuDriven.drawCommands[frameIndex].buffer, offset, gpuDriven.drawCounts[frameIndex].buffer, item.bucket * sizeof(uint32_t), bucket.maxDrawCount, stride);
+				}
+				renderStats.draws++;
+				continue;
+			}
+			if (!nodeVisible[item.node->transformIndex]) {
+				continue;
+			}
+			const vkglTF::Primitive* primitive = item.primitive;
+			profileAlphaMode(primitive->material.alphaMode);
+			bindPipelineAndMaterial(item.pipelineIndex, primitive->material.descriptorSet);
+			// Pass mesh and material index for this primitive using a push constant, the shader uses this to index into the mesh data and material buffers
+			MeshPushConstantBlock pushConstantBlock{};
+			pushConstantBlock.meshIndex = item.node->mesh->index;
+			pushConstantBlock.materialIndex = primitive->material.index;
+			pushConstants(pushConstantBlock);
+			if (primitive->hasIndices) {
+				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+			} else {
+				vkCmdDraw(commandBuffer, primitive->vertexCount, 1, 0, 0);
+			}
+			renderStats.draws++;
+		}
+		if (profiledAlphaMode >= 0) {
+			gpuProfiler.endScope(commandBuffer);
+		}
+	}
+
+	// Frustum culls all draw records on the GPU and compacts the commands of visible primitives per bucket
+	void recordDrawCulling(VkCommandBuffer commandBuffer)
+	{
+		vkCmdFillBuffer(commandBuffer, gpuDriven.drawCounts[frameIndex].buffer, 0, VK_WHOLE_SIZE, 0);
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		if (gpuDriven.drawCount > 0) {
+			struct PushConstants {
+				glm::vec4 frustumPlanes[6];
+				uint32_t drawCount;
+			} pushConstants{};
+			for (size_t i = 0; i < frustum.planes.size(); i++) {
+				// Planes that never reject anything if culling is disabled
+				pushConstants.frustumPlanes[i] = frustumCulling ? frustum.planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			}
+			pushConstants.drawCount = gpuDriven.drawCount;
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuDriven.pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuDriven.pipelineLayout, 0, 1, &gpuDriven.descriptorSets[frameIndex], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, gpuDriven.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (gpuDriven.drawCount + 63) / 64, 1, 1);
 		}
+
+		// Draw counts are also read back on the host once the frame has completed
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 	}
 
 	void recordCommandBuffer()
 	{
+		VKS_TRACE_SCOPE("recordCommandBuffer");
 		vkResetCommandBuffer(commandBuffers[frameIndex], 0);
 
 		VkCommandBufferBeginInfo cmdBufferBeginInfo{};
@@ -321,6 +810,21 @@ public:
 		VkCommandBuffer currentCB = commandBuffers[frameIndex];
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(currentCB, &cmdBufferBeginInfo));
+
+		gpuProfiler.beginFrame(currentCB, frameIndex);
+
+		// Copy buffer data staged since the last frame
+		gpuProfiler.beginScope(currentCB, "Staging copies");
+		stagingRing.recordCopies(currentCB, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		gpuProfiler.endScope(currentCB);
+
+		cullScene();
+		if (gpuDriven.enabled) {
+			gpuProfiler.beginScope(currentCB, "Culling");
+			recordDrawCulling(currentCB);
+			gpuProfiler.endScope(currentCB);
+		}
+
 		vkCmdBeginRenderPass(currentCB, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport{};
@@ -337,9 +841,11 @@ public:
 		VkDeviceSize offsets[1] = { 0 };
 
 		if (displayBackground) {
+			gpuProfiler.beginScope(currentCB, "Skybox");
 			vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[frameIndex].skybox, 0, nullptr);
 			vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines["skybox"]);
 			models.skybox.draw(currentCB);
+			gpuProfiler.endScope(currentCB);
 		}
 
 		vkglTF::Model &model = models.scene;
@@ -349,29 +855,102 @@ public:
 			vkCmdBindIndexBuffer(currentCB, model.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 		}
 
-		boundPipeline = VK_NULL_HANDLE;
-
-		// Opaque primitives first
-		for (auto node : model.nodes) {
-			renderNode(node, frameIndex, vkglTF::Material::ALPHAMODE_OPAQUE);
-		}
-		// Alpha masked primitives
-		for (auto node : model.nodes) {
-			renderNode(node, frameIndex, vkglTF::Material::ALPHAMODE_MASK);
-		}
-		// Transparent primitives
-		// TODO: Correct depth sorting
-		for (auto node : model.nodes) {
-			renderNode(node, frameIndex, vkglTF::Material::ALPHAMODE_BLEND);
-		}
+		drawRenderList(currentCB);
 
 		// User interface
+		gpuProfiler.beginScope(currentCB, "UI");
 		ui->draw(currentCB);
+		gpuProfiler.endScope(currentCB);
 
 		vkCmdEndRenderPass(currentCB);
+
+		gpuProfiler.endFrame(currentCB);
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(currentCB));
 	}
 
+	// Creates the draw records for all indexed primitives of the render list and the buffers for the GPU driven path
+	// Consecutive render items with the same pipeline and material set are put into one bucket, which is drawn with a single indirect draw
+	// Items drawn from the CPU also end a bucket, so buckets cover contiguous ranges of the render list and can be drawn in its order
+	void createDrawBuffers()
+	{
+		std::vector<ShaderDrawRecord> drawRecords;
+		gpuDriven.buckets.clear();
+		bool previousIndirect = false;
+		for (RenderItem& item : renderList) {
+			item.indirect = false;
+			const vkglTF::Primitive* primitive = item.primitive;
+			// Non-indexed primitives are always drawn from the CPU
+			if (!primitive->hasIndices) {
+				previousIndirect = false;
+				continue;
+			}
+			const vkglTF::Material& material = primitive->material;
+			const bool ordered = (material.alphaMode == vkglTF::Material::ALPHAMODE_BLEND);
+			// With bindless textures all materials share one descriptor set, so only pipeline changes start a new bucket
+			const bool materialChanged = !bindless.enabled && (gpuDriven.buckets.empty() || (gpuDriven.buckets.back().material != &material));
+			if (!previousIndirect || (gpuDriven.buckets.back().pipelineIndex != item.pipelineIndex) || materialChanged) {
+				gpuDriven.buckets.push_back({ item.pipelineIndex, &material, static_cast<uint32_t>(drawRecords.size()), 0, ordered });
+			}
+			GPUDriven::Bucket& bucket = gpuDriven.buckets.back();
+			ShaderDrawRecord drawRecord{};
+			drawRecord.bbMin = glm::vec4(primitive->bb.min, 1.0f);
+			drawRecord.bbMax = glm::vec4(primitive->bb.max, 1.0f);
+			drawRecord.firstIndex = primitive->firstIndex;
+			drawRecord.indexCount = primitive->indexCount;
+			drawRecord.meshIndex = item.node->mesh->index;
+			drawRecord.materialIndex = material.index;
+			drawRecord.bucket = static_cast<uint32_t>(gpuDriven.buckets.size() - 1);
+			drawRecord.commandOffset = ordered ? bucket.firstCommand + bucket.maxDrawCount : bucket.firstCommand;
+			// Bounds of skinned primitives change with the joints and aren't known on the GPU
+			if (item.node->skin || !primitive->bb.valid) {
+				drawRecord.flags |= GPUDriven::ALWAYS_VISIBLE;
+			}
+			if (ordered) {
+				drawRecord.flags |= GPUDriven::ORDERED;
+			}
+			bucket.maxDrawCount++;
+			drawRecords.push_back(drawRecord);
+			item.indirect = true;
+			item.bucket = drawRecord.bucket;
+			previousIndirect = true;
+		}
+		gpuDriven.drawCount = static_cast<uint32_t>(drawRecords.size());
+
+		// The draw records are always bound to the vertex shader, so the buffer is also created if the GPU driven path isn't used
+		createMeshStorageBuffer(gpuDriven.drawRecords, drawRecords.data(), drawRecords.size() * sizeof(ShaderDrawRecord), std::max(drawRecords.size(), (size_t)1) * sizeof(ShaderDrawRecord));
+
+		if (!gpuDriven.supported) {
+			return;
+		}
+		const VkDeviceSize drawCommandsSize = std::max(gpuDriven.drawCount, 1u) * sizeof(VkDrawIndexedIndirectCommand);
+		const VkDeviceSize drawCountsSize = std::max(gpuDriven.buckets.size(), (size_t)1) * sizeof(uint32_t);
+		for (size_t i = 0; i < gpuDriven.drawCommands.size(); i++) {
+			gpuDriven.drawCommands[i].destroy();
+			gpuDriven.drawCommands[i].create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandsSize, false, vks::MemoryCategory::DrawCommands);
+			gpuDriven.drawCounts[i].destroy();
+			gpuDriven.drawCounts[i].create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, drawCountsSize, true, vks::MemoryCategory::DrawCommands);
+			memset(gpuDriven.drawCounts[i].mapped, 0, drawCountsSize);
+		}
+		gpuDriven.visibleDraws = 0;
+	}
+
+	// Number of descriptors in the bindless texture array, index 0 is used for the empty texture
+	uint32_t bindlessTextureCount()
+	{
+		return std::min(static_cast<uint32_t>(models.scene.textures.size()) + 1, bindless.maxTextures);
+	}
+
+	// Textures exceeding the size of the bindless texture array fall back to the empty texture
+	int bindlessTextureIndex(const vkglTF::Texture* texture)
+	{
+		if (!texture) {
+			return 0;
+		}
+		const uint32_t index = static_cast<uint32_t>(texture - models.scene.textures.data()) + 1;
+		return (index < bindlessTextureCount()) ? static_cast<int>(index) : 0;
+	}
+
 	// We place all materials for the current scene into a shader storage buffer stored on the GPU
 	// This allows us to use arbitrary large material defintions
 	// The fragment shader then get's the index into this material array from a push constant set per primitive
@@ -411,6 +990,15 @@ public:
 				}
 			}
 
+			if (bindless.enabled) {
+				const bool metallicRoughness = material.pbrWorkflows.metallicRoughness;
+				shaderMaterial.colorTextureIndex = bindlessTextureIndex(metallicRoughness ? material.baseColorTexture : material.extension.diffuseTexture);
+				shaderMaterial.physicalDescriptorTextureIndex = bindlessTextureIndex(metallicRoughness ? material.metallicRoughnessTexture : material.extension.specularGlossinessTexture);
+				shaderMaterial.normalTextureIndex = bindlessTextureIndex(material.normalTexture);
+				shaderMaterial.occlusionTextureIndex = bindlessTextureIndex(material.occlusionTexture);
+				shaderMaterial.emissiveTextureIndex = bindlessTextureIndex(material.emissiveTexture);
+			}
+
 			shaderMaterials.push_back(shaderMaterial);
 		}
 
@@ -418,121 +1006,159 @@ public:
 			shaderMaterialBuffer.destroy();
 		}
 		VkDeviceSize bufferSize = shaderMaterials.size() * sizeof(ShaderMaterial);
-		Buffer stagingBuffer;
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize, &stagingBuffer.buffer, &stagingBuffer.memory, shaderMaterials.data()));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bufferSize, &shaderMaterialBuffer.buffer, &shaderMaterialBuffer.memory));
-
-		// Copy from staging buffers
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion{};
-		copyRegion.size = bufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, shaderMaterialBuffer.buffer, 1, &copyRegion);
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-		stagingBuffer.device = device;
-		stagingBuffer.destroy();
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bufferSize, &shaderMaterialBuffer.buffer, &shaderMaterialBuffer.memory, nullptr, nullptr, vks::AllocationStrategy::FreeList, vks::MemoryCategory::Materials));
+
+		// The copy is recorded into the command buffer of the next frame
+		stagingRing.copyToBuffer(shaderMaterials.data(), bufferSize, shaderMaterialBuffer.buffer);
 
 		// Update descriptor
 		shaderMaterialBuffer.descriptor.buffer = shaderMaterialBuffer.buffer;
 		shaderMaterialBuffer.descriptor.offset = 0;
 		shaderMaterialBuffer.descriptor.range = bufferSize;
-		shaderMaterialBuffer.device = device;
+		shaderMaterialBuffer.device = vulkanDevice;
 	}
 
 	// We place all the shader data blocks for all meshes (node) into a single buffer 
 	// This allows us to use one singular allocation instead of having to do lots of small allocations per mesh
 	// The vertex shader then get's the index into this buffer from a push constant set per mesh
-	// @todo: Needs to be adjusted to work with frames-in-flight (duplicate buffer)
-	// @todo: Update
+	// Joint matrices are stored in a separate buffer, so unskinned meshes don't take up space for them
 	void createMeshDataBuffer()
 	{
-		std::vector<ShaderMeshData> shaderMeshData{};
+		shaderMeshData.clear();
+		shaderJointData.clear();
+		shaderMeshes.clear();
 		for (auto& node : models.scene.linearNodes) {
-			ShaderMeshData meshData{};
 			if (node->mesh) {
-				memcpy(meshData.jointMatrix, node->mesh->jointMatrix, sizeof(glm::mat4) * MAX_NUM_JOINTS);
-				meshData.jointcount = node->mesh->jointcount;
-				meshData.matrix = node->mesh->matrix;
+				ShaderMeshData meshData{};
+				meshData.jointOffset = static_cast<uint32_t>(shaderJointData.size());
+				meshData.jointCount = node->mesh->jointcount;
+				shaderJointData.resize(shaderJointData.size() + node->mesh->jointcount);
 				shaderMeshData.push_back(meshData);
+				shaderMeshes.push_back(node->mesh);
+				packMeshData(shaderMeshes.size() - 1);
 			}
 		}
 
-		for (auto& shaderMeshDataBuffer : shaderMeshDataBuffers) {
-			if (shaderMeshDataBuffer.buffer != VK_NULL_HANDLE) {
-				shaderMeshDataBuffer.destroy();
+		// Vulkan does not allow empty buffers
+		VkDeviceSize meshDataSize = std::max(shaderMeshData.size(), (size_t)1) * sizeof(ShaderMeshData);
+		VkDeviceSize jointDataSize = std::max(shaderJointData.size(), (size_t)1) * sizeof(glm::mat3x4);
+		for (size_t i = 0; i < shaderMeshDataBuffers.size(); i++) {
+			createMeshStorageBuffer(shaderMeshDataBuffers[i], shaderMeshData.data(), shaderMeshData.size() * sizeof(ShaderMeshData), meshDataSize);
+			createMeshStorageBuffer(shaderJointBuffers[i], shaderJointData.data(), shaderJointData.size() * sizeof(glm::mat3x4), jointDataSize);
+		}
+
+		shaderMeshVersions.resize(shaderMeshDataBuffers.size());
+		for (auto& versions : shaderMeshVersions) {
+			versions.resize(shaderMeshes.size());
+			for (size_t i = 0; i < shaderMeshes.size(); i++) {
+				versions[i] = shaderMeshes[i]->version;
 			}
-			VkDeviceSize bufferSize = shaderMeshData.size() * sizeof(ShaderMeshData);
-			if (!vulkanDevice->requiresStaging) {
-				// Prefer a host visible device buffer (ReBAR/SAM on discreate GPUs, always available on integrated GPUs)
-				VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize, &shaderMeshDataBuffer.buffer, &shaderMeshDataBuffer.memory));
-				shaderMeshDataBuffer.device = device;
-				shaderMeshDataBuffer.map();
-				memcpy(shaderMeshDataBuffer.mapped, shaderMeshData.data(), bufferSize);
-			} else {
-				Buffer stagingBuffer;
-				VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize, &stagingBuffer.buffer, &stagingBuffer.memory, shaderMeshData.data()));
-				VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bufferSize, &shaderMeshDataBuffer.buffer, &shaderMeshDataBuffer.memory));
-				// Copy from staging buffers
-				VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-				VkBufferCopy copyRegion{};
-				copyRegion.size = bufferSize;
-				vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, shaderMeshDataBuffer.buffer, 1, &copyRegion);
-				vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-				stagingBuffer.device = device;
-				stagingBuffer.destroy();
-			}
-			// Update descriptor
-			shaderMeshDataBuffer.descriptor.buffer = shaderMeshDataBuffer.buffer;
-			shaderMeshDataBuffer.descriptor.offset = 0;
-			shaderMeshDataBuffer.descriptor.range = bufferSize;
-			shaderMeshDataBuffer.device = device;
 		}
 	}
 
-	void updateMeshDataBuffer(uint32_t index)
+	void createMeshStorageBuffer(Buffer& buffer, const void* data, VkDeviceSize dataSize, VkDeviceSize bufferSize)
 	{
-		// @todo: optimize (no push, use fixed size)
-		std::vector<ShaderMeshData> shaderMeshData{};
-		for (auto& node : models.scene.linearNodes) {
-			ShaderMeshData meshData{};
-			if (node->mesh) {
-				memcpy(meshData.jointMatrix, node->mesh->jointMatrix, sizeof(glm::mat4) * MAX_NUM_JOINTS);
-				meshData.jointcount = node->mesh->jointcount;
-				meshData.matrix = node->mesh->matrix;
-				shaderMeshData.push_back(meshData);
+		if (buffer.buffer != VK_NULL_HANDLE) {
+			buffer.destroy();
+		}
+		if (!vulkanDevice->requiresStaging) {
+			// Prefer a host visible device buffer (ReBAR/SAM on discreate GPUs, always available on integrated GPUs)
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize, &buffer.buffer, &buffer.memory, nullptr, nullptr, vks::AllocationStrategy::FreeList, vks::MemoryCategory::MeshData));
+			buffer.device = vulkanDevice;
+			buffer.map();
+			if (dataSize > 0) {
+				memcpy(buffer.mapped, data, dataSize);
+			}
+		} else {
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bufferSize, &buffer.buffer, &buffer.memory, nullptr, nullptr, vks::AllocationStrategy::FreeList, vks::MemoryCategory::MeshData));
+			// Scenes are only (re)loaded with the device idle, so all buffers can be initialized from the next frame's command buffer
+			if (dataSize > 0) {
+				stagingRing.copyToBuffer(data, dataSize, buffer.buffer);
 			}
 		}
+		// Update descriptor
+		buffer.descriptor.buffer = buffer.buffer;
+		buffer.descriptor.offset = 0;
+		buffer.descriptor.range = bufferSize;
+		buffer.device = vulkanDevice;
+	}
 
-		VkDeviceSize bufferSize = shaderMeshData.size() * sizeof(ShaderMeshData);
+	// Copies the current matrices of a mesh into the CPU side shader data
+	void packMeshData(size_t meshIndex)
+	{
+		vkglTF::packMeshData(*shaderMeshes[meshIndex], shaderMeshData[meshIndex], shaderJointData.data());
+	}
 
+	// Writes a range of the CPU side shader data to the buffer of the given frame
+	void writeMeshDataRange(Buffer& buffer, const void* data, VkDeviceSize offset, VkDeviceSize size)
+	{
+		if (size == 0) {
+			return;
+		}
 		if (!vulkanDevice->requiresStaging) {
-			memcpy(shaderMeshDataBuffers[index].mapped, shaderMeshData.data(), bufferSize);
+			memcpy(static_cast<uint8_t*>(buffer.mapped) + offset, data, size);
+		} else {
+			// Recorded into the frame's command buffer, the buffer for this frame is no longer in use as its fence has been waited on
+			stagingRing.copyToBuffer(data, size, buffer.buffer, offset);
 		}
-		else {
-			Buffer stagingBuffer;
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize, &stagingBuffer.buffer, &stagingBuffer.memory, shaderMeshData.data()));
-			// Copy from staging buffers
-			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-			VkBufferCopy copyRegion{};
-			copyRegion.size = bufferSize;
-			vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, shaderMeshDataBuffers[index].buffer, 1, &copyRegion);
-			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-			stagingBuffer.device = device;
-			stagingBuffer.destroy();
+	}
+
+	// Updates the mesh data and joint palette buffers of a frame in flight, consecutive changed meshes are written as one range
+	void updateMeshDataBuffer(uint32_t index)
+	{
+		VKS_TRACE_SCOPE("updateMeshDataBuffer");
+		std::vector<uint32_t>& versions = shaderMeshVersions[index];
+		size_t i = 0;
+		while (i < shaderMeshes.size()) {
+			if (versions[i] == shaderMeshes[i]->version) {
+				i++;
+				continue;
+			}
+			const size_t first = i;
+			while ((i < shaderMeshes.size()) && (versions[i] != shaderMeshes[i]->version)) {
+				packMeshData(i);
+				versions[i] = shaderMeshes[i]->version;
+				i++;
+			}
+			writeMeshDataRange(shaderMeshDataBuffers[index], &shaderMeshData[first], first * sizeof(ShaderMeshData), (i - first) * sizeof(ShaderMeshData));
+			// Joint ranges are assigned in mesh order, so the joints of consecutive meshes are also consecutive
+			const uint32_t jointFirst = shaderMeshData[first].jointOffset;
+			const uint32_t jointEnd = shaderMeshData[i - 1].jointOffset + shaderMeshData[i - 1].jointCount;
+			writeMeshDataRange(shaderJointBuffers[index], &shaderJointData[jointFirst], jointFirst * sizeof(glm::mat3x4), (jointEnd - jointFirst) * sizeof(glm::mat3x4));
 		}
 	}
 
 	void loadScene(std::string filename)
 	{
+		VKS_TRACE_SCOPE("loadScene");
 		std::cout << "Loading scene from " << filename << std::endl;
+		sceneFileName = filename;
 		models.scene.destroy(device);
 		animationIndex = 0;
 		animationTimer = 0.0f;
 		auto tStart = std::chrono::high_resolution_clock::now();
 		models.scene.loadFromFile(filename, vulkanDevice, queue);
+		vkglTF::LoadReport& loadReport = models.scene.loadReport;
+		auto tStage = std::chrono::high_resolution_clock::now();
 		createMaterialBuffer();
+		loadReport.addStage("Material buffer", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStage).count(), shaderMaterialBuffer.descriptor.range);
+		tStage = std::chrono::high_resolution_clock::now();
 		createMeshDataBuffer();
-		auto tFileLoad = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
-		std::cout << "Loading took " << tFileLoad << " ms" << std::endl;
+		VkDeviceSize meshDataBytes = 0;
+		for (size_t i = 0; i < shaderMeshDataBuffers.size(); i++) {
+			meshDataBytes += shaderMeshDataBuffers[i].descriptor.range + shaderJointBuffers[i].descriptor.range;
+		}
+		loadReport.addStage("Mesh data buffers", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStage).count(), meshDataBytes);
+		tStage = std::chrono::high_resolution_clock::now();
+		buildRenderList();
+		createDrawBuffers();
+		loadReport.addStage("Render list and draw buffers", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStage).count());
+		loadReport.totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		loadReport.print();
+		if (!loadReportFileName.empty()) {
+			loadReport.save(loadReportFileName);
+		}
+		vulkanDevice->memoryAllocator->printStats();
 		// Check and list unsupported extensions
 		for (auto& ext : models.scene.extensions) {
 			if (std::find(supportedExtensions.begin(), supportedExtensions.end(), ext) == supportedExtensions.end()) {
@@ -542,16 +1168,90 @@ public:
 		resetCamera();
 	}
 
+	static void destroyEnvironmentMaps(vks::TextureCubeMap& environmentCube, vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& prefilteredCube)
+	{
+		// The irradiance cube map isn't created with spherical harmonics irradiance
+		for (vks::TextureCubeMap* texture : { &environmentCube, &irradianceCube, &prefilteredCube }) {
+			if (texture->image) {
+				texture->destroy();
+			}
+			*texture = vks::TextureCubeMap();
+		}
+	}
+
+	// Load an environment and generate its image based lighting maps, waits until everything is ready
 	void loadEnvironment(std::string filename)
 	{
 		std::cout << "Loading environment from " << filename << std::endl;
-		if (textures.environmentCube.image) {
-			textures.environmentCube.destroy();
-			textures.irradianceCube.destroy();
-			textures.prefilteredCube.destroy();
+		destroyEnvironmentMaps(textures.environmentCube, textures.irradianceCube, textures.prefilteredCube);
+		gli::texture_cube environmentData = vks::TextureCubeMap::loadData(filename);
+		const uint64_t environmentHash = iblCache.enabled ? hashFile(filename) : 0;
+		IBLGeneration generation;
+		beginIBLGeneration(generation, environmentData, environmentHash, textures.environmentCube, textures.irradianceCube, textures.prefilteredCube);
+		finishIBLGeneration(generation);
+	}
+
+	/*
+		Switch to a different environment without stalling rendering
+		The file is read on a worker thread, the maps are then generated in a submission interleaved with the frames while the current environment is still used for rendering
+		Once the generation has finished, the new maps replace the current ones in the descriptor sets of each frame (see updateEnvironmentLoader)
+	*/
+	void loadEnvironmentAsync(const std::string& filename)
+	{
+		if (environmentLoader.busy) {
+			// Only the most recent request is loaded once the current one has finished
+			environmentLoader.queuedFileName = filename;
+			return;
+		}
+		std::cout << "Loading environment from " << filename << std::endl;
+		environmentLoader.busy = true;
+		environmentLoader.dataLoaded = false;
+		environmentLoader.thread = std::thread([this, filename]() {
+			vks::trace::setThreadName("Environment loader");
+			VKS_TRACE_SCOPE("Load environment");
+			environmentLoader.data = vks::TextureCubeMap::loadData(filename);
+			environmentLoader.hash = iblCache.enabled ? hashFile(filename) : 0;
+			environmentLoader.dataLoaded = true;
+		});
+	}
+
+	// Called once per frame after the frame's fence has been waited on, so descriptor sets and resources of that frame are no longer in use by the GPU
+	void updateEnvironmentLoader()
+	{
+		EnvironmentLoader& loader = environmentLoader;
+		if (loader.busy) {
+			if (loader.thread.joinable() && loader.dataLoaded) {
+				loader.thread.join();
+				beginIBLGeneration(loader.generation, loader.data, loader.hash, loader.environmentCube, loader.irradianceCube, loader.prefilteredCube);
+				loader.data = gli::texture_cube();
+			} else if ((loader.generation.fence != VK_NULL_HANDLE) && (loader.outdatedFrames == 0) && (vkGetFenceStatus(device, loader.generation.fence) == VK_SUCCESS)) {
+				finishIBLGeneration(loader.generation);
+				// The current maps may still be used by other frames in flight, so they're only destroyed after all frames have switched to the new maps
+				loader.retiredEnvironmentCube = textures.environmentCube;
+				loader.retiredIrradianceCube = textures.irradianceCube;
+				loader.retiredPrefilteredCube = textures.prefilteredCube;
+				textures.environmentCube = loader.environmentCube;
+				textures.irradianceCube = loader.irradianceCube;
+				textures.prefilteredCube = loader.prefilteredCube;
+				loader.environmentCube = vks::TextureCubeMap();
+				loader.irradianceCube = vks::TextureCubeMap();
+				loader.prefilteredCube = vks::TextureCubeMap();
+				loader.outdatedFrames = (1u << renderAhead) - 1;
+				loader.busy = false;
+				if (!loader.queuedFileName.empty()) {
+					std::string fileName = loader.queuedFileName;
+					loader.queuedFileName.clear();
+					loadEnvironmentAsync(fileName);
+				}
+			}
+		}
+		if (loader.outdatedFrames & (1u << frameIndex)) {
+			updateEnvironmentDescriptors(frameIndex);
+			loader.outdatedFrames &= ~(1u << frameIndex);
+			if (loader.outdatedFrames == 0) {
+				destroyEnvironmentMaps(loader.retiredEnvironmentCube, loader.retiredIrradianceCube, loader.retiredPrefilteredCube);
+			}
 		}
-		textures.environmentCube.loadFromFile(filename, VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
-		generateCubemaps();
 	}
 
 	void loadAssets()
@@ -599,6 +1299,61 @@ public:
 		loadEnvironment(envMapFile.c_str());
 	}
 
+	// All materials share one descriptor set containing all textures of the scene, the shaders select textures using the indices in the material buffer
+	void setupBindlessMaterialDescriptors()
+	{
+		VkDescriptorSetLayoutBinding setLayoutBinding{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindless.maxTextures, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+		// The actual number of textures is set at allocation time, and unused elements of the array don't need to be written
+		VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT setLayoutBindingFlagsCI{};
+		setLayoutBindingFlagsCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		setLayoutBindingFlagsCI.bindingCount = 1;
+		setLayoutBindingFlagsCI.pBindingFlags = &bindingFlags;
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+		descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorSetLayoutCI.pNext = &setLayoutBindingFlagsCI;
+		descriptorSetLayoutCI.pBindings = &setLayoutBinding;
+		descriptorSetLayoutCI.bindingCount = 1;
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.material));
+
+		const uint32_t textureCount = bindlessTextureCount();
+		if (textureCount < models.scene.textures.size() + 1) {
+			std::cerr << "[WARN] Scene uses " << models.scene.textures.size() << " textures, but the bindless texture array can only store " << textureCount - 1 << std::endl;
+		}
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableDescriptorCountAllocInfo{};
+		variableDescriptorCountAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+		variableDescriptorCountAllocInfo.descriptorSetCount = 1;
+		variableDescriptorCountAllocInfo.pDescriptorCounts = &textureCount;
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptorSetAllocInfo.pNext = &variableDescriptorCountAllocInfo;
+		descriptorSetAllocInfo.descriptorPool = descriptorPool;
+		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
+		descriptorSetAllocInfo.descriptorSetCount = 1;
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSet));
+
+		std::vector<VkDescriptorImageInfo> imageDescriptors(textureCount);
+		imageDescriptors[0] = textures.empty.descriptor;
+		for (uint32_t i = 1; i < textureCount; i++) {
+			imageDescriptors[i] = models.scene.textures[i - 1].descriptor;
+		}
+		VkWriteDescriptorSet writeDescriptorSet{};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDescriptorSet.descriptorCount = textureCount;
+		writeDescriptorSet.dstSet = descriptorSet;
+		writeDescriptorSet.dstBinding = 0;
+		writeDescriptorSet.pImageInfo = imageDescriptors.data();
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+
+		// Render list and draw buckets compare material sets, so sharing one set removes all material set binds
+		for (auto& material : models.scene.materials) {
+			material.descriptorSet = descriptorSet;
+		}
+	}
+
 	void setupDescriptors()
 	{
 		/*
@@ -614,7 +1369,7 @@ public:
 		std::vector<vkglTF::Model*> modellist = { &models.skybox, &models.scene };
 		for (auto &model : modellist) {
 			for (auto &material : model->materials) {
-				imageSamplerCount += 5;
+				imageSamplerCount += bindless.enabled ? 0 : 5;
 				materialCount++;
 			}
 			for (auto node : model->linearNodes) {
@@ -624,17 +1379,21 @@ public:
 			}
 		}
 
+		if (bindless.enabled) {
+			imageSamplerCount += bindlessTextureCount();
+		}
+
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (4 + meshCount) * swapChain.imageCount },
 			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageSamplerCount * swapChain.imageCount },
-			// One SSBO for the shader material buffer and one SSBO for the mesh data buffer
-			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 + static_cast<uint32_t>(shaderMeshDataBuffers.size())}
+			// One SSBO for the shader material buffer, three SSBOs (mesh data, joint palette and draw records) per frame and four per frame for draw culling
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 + (gpuDriven.supported ? 7 : 3) * static_cast<uint32_t>(shaderMeshDataBuffers.size())}
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolCI{};
 		descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 		descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 		descriptorPoolCI.pPoolSizes = poolSizes.data();
-		descriptorPoolCI.maxSets = (2 + materialCount + meshCount) * swapChain.imageCount;
+		descriptorPoolCI.maxSets = (2 + materialCount + meshCount) * swapChain.imageCount + static_cast<uint32_t>(gpuDriven.descriptorSets.size());
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
 
 		/*
@@ -686,7 +1445,8 @@ public:
 				writeDescriptorSets[2].descriptorCount = 1;
 				writeDescriptorSets[2].dstSet = descriptorSets[i].scene;
 				writeDescriptorSets[2].dstBinding = 2;
-				writeDescriptorSets[2].pImageInfo = &textures.irradianceCube.descriptor;
+				// The irradiance binding isn't used with spherical harmonics irradiance, but still needs to be a valid cube map
+				writeDescriptorSets[2].pImageInfo = (shaderValuesParams.shIrradiance > 0.0f) ? &textures.prefilteredCube.descriptor : &textures.irradianceCube.descriptor;
 
 				writeDescriptorSets[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 				writeDescriptorSets[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -708,65 +1468,69 @@ public:
 
 		// Material (samplers)
 		{
-			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-				{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-				{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-				{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-				{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-			};
-			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
-			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
-			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.material));
-
-			// Per-Material descriptor sets
-			for (auto &material : models.scene.materials) {
-				VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-				descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-				descriptorSetAllocInfo.descriptorPool = descriptorPool;
-				descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
-				descriptorSetAllocInfo.descriptorSetCount = 1;
-				VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &material.descriptorSet));
-
-				std::vector<VkDescriptorImageInfo> imageDescriptors = {
-					textures.empty.descriptor,
-					textures.empty.descriptor,
-					material.normalTexture ? material.normalTexture->descriptor : textures.empty.descriptor,
-					material.occlusionTexture ? material.occlusionTexture->descriptor : textures.empty.descriptor,
-					material.emissiveTexture ? material.emissiveTexture->descriptor : textures.empty.descriptor
+			if (bindless.enabled) {
+				setupBindlessMaterialDescriptors();
+			} else {
+				std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+					{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+					{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+					{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+					{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+					{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
 				};
+				VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+				descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+				descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+				descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+				VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.material));
 
-				if (material.pbrWorkflows.metallicRoughness) {
-					if (material.baseColorTexture) {
-						imageDescriptors[0] = material.baseColorTexture->descriptor;
-					}
-					if (material.metallicRoughnessTexture) {
-						imageDescriptors[1] = material.metallicRoughnessTexture->descriptor;
-					}
-				} else {
-					if (material.pbrWorkflows.specularGlossiness) {
-						if (material.extension.diffuseTexture) {
-							imageDescriptors[0] = material.extension.diffuseTexture->descriptor;
+				// Per-Material descriptor sets
+				for (auto &material : models.scene.materials) {
+					VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+					descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+					descriptorSetAllocInfo.descriptorPool = descriptorPool;
+					descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
+					descriptorSetAllocInfo.descriptorSetCount = 1;
+					VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &material.descriptorSet));
+
+					std::vector<VkDescriptorImageInfo> imageDescriptors = {
+						textures.empty.descriptor,
+						textures.empty.descriptor,
+						material.normalTexture ? material.normalTexture->descriptor : textures.empty.descriptor,
+						material.occlusionTexture ? material.occlusionTexture->descriptor : textures.empty.descriptor,
+						material.emissiveTexture ? material.emissiveTexture->descriptor : textures.empty.descriptor
+					};
+
+					if (material.pbrWorkflows.metallicRoughness) {
+						if (material.baseColorTexture) {
+							imageDescriptors[0] = material.baseColorTexture->descriptor;
+						}
+						if (material.metallicRoughnessTexture) {
+							imageDescriptors[1] = material.metallicRoughnessTexture->descriptor;
 						}
-						if (material.extension.specularGlossinessTexture) {
-							imageDescriptors[1] = material.extension.specularGlossinessTexture->descriptor;
+					} else {
+						if (material.pbrWorkflows.specularGlossiness) {
+							if (material.extension.diffuseTexture) {
+								imageDescriptors[0] = material.extension.diffuseTexture->descriptor;
+							}
+							if (material.extension.specularGlossinessTexture) {
+								imageDescriptors[1] = material.extension.specularGlossinessTexture->descriptor;
+							}
 						}
 					}
-				}
 
-				std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
-				for (size_t i = 0; i < imageDescriptors.size(); i++) {
-					writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-					writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-					writeDescriptorSets[i].descriptorCount = 1;
-					writeDescriptorSets[i].dstSet = material.descriptorSet;
-					writeDescriptorSets[i].dstBinding = static_cast<uint32_t>(i);
-					writeDescriptorSets[i].pImageInfo = &imageDescriptors[i];
-				}
+					std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
+					for (size_t i = 0; i < imageDescriptors.size(); i++) {
+						writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+						writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+						writeDescriptorSets[i].descriptorCount = 1;
+						writeDescriptorSets[i].dstSet = material.descriptorSet;
+						writeDescriptorSets[i].dstBinding = static_cast<uint32_t>(i);
+						writeDescriptorSets[i].pImageInfo = &imageDescriptors[i];
+					}
 
-				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+					vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+				}
 			}
 
 			// Material buffer
@@ -801,6 +1565,8 @@ public:
 			{
 				std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 					{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+					{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+					{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
 				};
 				VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
 				descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -816,15 +1582,53 @@ public:
 					descriptorSetAllocInfo.descriptorSetCount = 1;
 					VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSetsMeshData[i]));
 
-					VkWriteDescriptorSet writeDescriptorSet{};
-					writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-					writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-					writeDescriptorSet.descriptorCount = 1;
-					writeDescriptorSet.dstSet = descriptorSetsMeshData[i];
-					writeDescriptorSet.dstBinding = 0;
-					writeDescriptorSet.pBufferInfo = &shaderMeshDataBuffers[i].descriptor;
-					vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+					std::array<VkWriteDescriptorSet, 3> writeDescriptorSets{};
+					writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writeDescriptorSets[0].descriptorCount = 1;
+					writeDescriptorSets[0].dstSet = descriptorSetsMeshData[i];
+					writeDescriptorSets[0].dstBinding = 0;
+					writeDescriptorSets[0].pBufferInfo = &shaderMeshDataBuffers[i].descriptor;
+
+					writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writeDescriptorSets[1].descriptorCount = 1;
+					writeDescriptorSets[1].dstSet = descriptorSetsMeshData[i];
+					writeDescriptorSets[1].dstBinding = 1;
+					writeDescriptorSets[1].pBufferInfo = &shaderJointBuffers[i].descriptor;
+
+					writeDescriptorSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					writeDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writeDescriptorSets[2].descriptorCount = 1;
+					writeDescriptorSets[2].dstSet = descriptorSetsMeshData[i];
+					writeDescriptorSets[2].dstBinding = 2;
+					writeDescriptorSets[2].pBufferInfo = &gpuDriven.drawRecords.descriptor;
+					vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+				}
+			}
+		}
+
+		// Draw culling (draw records, mesh data, draw commands and draw counts)
+		if (gpuDriven.supported) {
+			for (auto i = 0; i < gpuDriven.descriptorSets.size(); i++) {
+				VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+				descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				descriptorSetAllocInfo.descriptorPool = descriptorPool;
+				descriptorSetAllocInfo.pSetLayouts = &gpuDriven.descriptorSetLayout;
+				descriptorSetAllocInfo.descriptorSetCount = 1;
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &gpuDriven.descriptorSets[i]));
+
+				const std::array<VkDescriptorBufferInfo*, 4> bufferInfos = { &gpuDriven.drawRecords.descriptor, &shaderMeshDataBuffers[i].descriptor, &gpuDriven.drawCommands[i].descriptor, &gpuDriven.drawCounts[i].descriptor };
+				std::array<VkWriteDescriptorSet, 4> writeDescriptorSets{};
+				for (size_t j = 0; j < writeDescriptorSets.size(); j++) {
+					writeDescriptorSets[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					writeDescriptorSets[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writeDescriptorSets[j].descriptorCount = 1;
+					writeDescriptorSets[j].dstSet = gpuDriven.descriptorSets[i];
+					writeDescriptorSets[j].dstBinding = static_cast<uint32_t>(j);
+					writeDescriptorSets[j].pBufferInfo = bufferInfos[j];
 				}
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 			}
 		}
 
@@ -864,8 +1668,38 @@ public:
 		}
 	}
 
+	// Point the environment bindings of a frame's scene and skybox descriptor sets to the current maps
+	void updateEnvironmentDescriptors(uint32_t frame)
+	{
+		std::array<VkWriteDescriptorSet, 3> writeDescriptorSets{};
+
+		writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDescriptorSets[0].descriptorCount = 1;
+		writeDescriptorSets[0].dstSet = descriptorSets[frame].scene;
+		writeDescriptorSets[0].dstBinding = 2;
+		writeDescriptorSets[0].pImageInfo = (shaderValuesParams.shIrradiance > 0.0f) ? &textures.prefilteredCube.descriptor : &textures.irradianceCube.descriptor;
+
+		writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDescriptorSets[1].descriptorCount = 1;
+		writeDescriptorSets[1].dstSet = descriptorSets[frame].scene;
+		writeDescriptorSets[1].dstBinding = 3;
+		writeDescriptorSets[1].pImageInfo = &textures.prefilteredCube.descriptor;
+
+		writeDescriptorSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDescriptorSets[2].descriptorCount = 1;
+		writeDescriptorSets[2].dstSet = descriptorSets[frame].skybox;
+		writeDescriptorSets[2].dstBinding = 2;
+		writeDescriptorSets[2].pImageInfo = &textures.prefilteredCube.descriptor;
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	// Depending on material setting, we need different pipeline variants per set, e.g. one with back-face culling, one without and one with alpha-blending enabled. This function generates such a set.
-	void addPipelineSet(const std::string prefix, const std::string vertexShader, const std::string fragmentShader)
+	// The material features are passed to the fragment shader as a specialization constant
+	void addPipelineSet(const std::string prefix, const std::string vertexShader, const std::string fragmentShader, uint32_t materialFeatures = 0)
 	{
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
 		inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -916,20 +1750,22 @@ public:
 		dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
 		dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
 
-		// Pipeline layout
-		const std::vector<VkDescriptorSetLayout> setLayouts = {
-			descriptorSetLayouts.scene, descriptorSetLayouts.material, descriptorSetLayouts.meshDataBuffer, descriptorSetLayouts.materialBuffer
-		};
-		VkPipelineLayoutCreateInfo pipelineLayoutCI{};
-		pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
-		pipelineLayoutCI.pSetLayouts = setLayouts.data();
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.size = sizeof(MeshPushConstantBlock);
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pipelineLayoutCI.pushConstantRangeCount = 1;
-		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+		// Pipeline layout (shared by all pipeline sets)
+		if (pipelineLayout == VK_NULL_HANDLE) {
+			const std::vector<VkDescriptorSetLayout> setLayouts = {
+				descriptorSetLayouts.scene, descriptorSetLayouts.material, descriptorSetLayouts.meshDataBuffer, descriptorSetLayouts.materialBuffer
+			};
+			VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+			pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+			pipelineLayoutCI.pSetLayouts = setLayouts.data();
+			VkPushConstantRange pushConstantRange{};
+			pushConstantRange.size = sizeof(MeshPushConstantBlock);
+			pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+			pipelineLayoutCI.pushConstantRangeCount = 1;
+			pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+		}
 
 		// Vertex bindings and attributes
 		VkVertexInputBindingDescription vertexInputBinding = { 0, sizeof(vkglTF::Model::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
@@ -971,14 +1807,18 @@ public:
 		shaderStages[0] = loadShader(device, vertexShader, VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(device, fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT);
 
+		VkSpecializationMapEntry specializationMapEntry{ 0, 0, sizeof(uint32_t) };
+		VkSpecializationInfo specializationInfo{ 1, &specializationMapEntry, sizeof(uint32_t), &materialFeatures };
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
+
 		VkPipeline pipeline{};
 		// Default pipeline with back-face culling
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-		pipelines[prefix] = pipeline;
+		VK_CHECK_RESULT(createGraphicsPipeline(pipelineCI, &pipeline));
+		pipelines[getPipelineName(prefix, "", materialFeatures)] = pipeline;
 		// Double sided
 		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-		pipelines[prefix + "_double_sided"] = pipeline;
+		VK_CHECK_RESULT(createGraphicsPipeline(pipelineCI, &pipeline));
+		pipelines[getPipelineName(prefix, "_double_sided", materialFeatures)] = pipeline;
 		// Alpha blending
 		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
 		blendAttachmentState.blendEnable = VK_TRUE;
@@ -989,843 +1829,823 @@ public:
 		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-		pipelines[prefix + "_alpha_blending"] = pipeline;
+		VK_CHECK_RESULT(createGraphicsPipeline(pipelineCI, &pipeline));
+		pipelines[getPipelineName(prefix, "_alpha_blending", materialFeatures)] = pipeline;
 
 		for (auto shaderStage : shaderStages) {
 			vkDestroyShaderModule(device, shaderStage.module, nullptr);
 		}
 	};
 
+	// PBR and KHR_materials_unlit pipelines are created for the material features used by the scene when they're first drawn
+	// Needs to be called before loading a scene, as the render list masks material features with the ones supported by a set
+	void prepareMaterialPipelineSets()
+	{
+		materialPipelineSets["pbr"] = { "pbr.vert.spv", bindless.enabled ? "material_pbr_bindless.frag.spv" : "material_pbr.frag.spv", ~0u };
+		materialPipelineSets["unlit"] = { "pbr.vert.spv", bindless.enabled ? "material_unlit_bindless.frag.spv" : "material_unlit.frag.spv", MATERIAL_FEATURE_BASE_COLOR_TEXTURE };
+	}
+
 	void preparePipelines()
 	{
 		// Skybox pipeline (background cube)
 		addPipelineSet("skybox", "skybox.vert.spv", "skybox.frag.spv");
-		// PBR pipelines
-		addPipelineSet("pbr", "pbr.vert.spv", "material_pbr.frag.spv");
-		// KHR_materials_unlit
-		addPipelineSet("unlit", "pbr.vert.spv", "material_unlit.frag.spv");
 	}
 
-	/*
-		Generate a BRDF integration map storing roughness/NdotV as a look-up-table
-	*/
-	void generateBRDFLUT()
+	// Compute pipeline for culling the draw records of the GPU driven path
+	void prepareGPUDriven()
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
+		gpuDriven.vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+		if (!gpuDriven.vkCmdDrawIndexedIndirectCountKHR) {
+			std::cerr << "Could not get a valid function pointer for vkCmdDrawIndexedIndirectCountKHR, GPU driven rendering disabled" << std::endl;
+			gpuDriven.supported = false;
+			return;
+		}
 
-		const VkFormat format = VK_FORMAT_R16G16_SFLOAT;
-		const int32_t dim = 512;
-
-		// Image
-		VkImageCreateInfo imageCI{};
-		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
-		imageCI.format = format;
-		imageCI.extent.width = dim;
-		imageCI.extent.height = dim;
-		imageCI.extent.depth = 1;
-		imageCI.mipLevels = 1;
-		imageCI.arrayLayers = 1;
-		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.lutBrdf.image));
-		VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(device, textures.lutBrdf.image, &memReqs);
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &textures.lutBrdf.deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device, textures.lutBrdf.image, textures.lutBrdf.deviceMemory, 0));
-
-		// View
-		VkImageViewCreateInfo viewCI{};
-		viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewCI.format = format;
-		viewCI.subresourceRange = {};
-		viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		viewCI.subresourceRange.levelCount = 1;
-		viewCI.subresourceRange.layerCount = 1;
-		viewCI.image = textures.lutBrdf.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &textures.lutBrdf.view));
-
-		// Sampler
-		VkSamplerCreateInfo samplerCI{};
-		samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-		samplerCI.magFilter = VK_FILTER_LINEAR;
-		samplerCI.minFilter = VK_FILTER_LINEAR;
-		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		samplerCI.minLod = 0.0f;
-		samplerCI.maxLod = 1.0f;
-		samplerCI.maxAnisotropy = 1.0f;
-		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &textures.lutBrdf.sampler));
-
-		// FB, Att, RP, Pipe, etc.
-		VkAttachmentDescription attDesc{};
-		// Color attachment
-		attDesc.format = format;
-		attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-		attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attDesc.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-		VkSubpassDescription subpassDescription{};
-		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpassDescription.colorAttachmentCount = 1;
-		subpassDescription.pColorAttachments = &colorReference;
-
-		// Use subpass dependencies for layout transitions
-		std::array<VkSubpassDependency, 2> dependencies;
-		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-		dependencies[1].srcSubpass = 0;
-		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		// Create the actual renderpass
-		VkRenderPassCreateInfo renderPassCI{};
-		renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassCI.attachmentCount = 1;
-		renderPassCI.pAttachments = &attDesc;
-		renderPassCI.subpassCount = 1;
-		renderPassCI.pSubpasses = &subpassDescription;
-		renderPassCI.dependencyCount = 2;
-		renderPassCI.pDependencies = dependencies.data();
-
-		VkRenderPass renderpass;
-		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCI, nullptr, &renderpass));
-
-		VkFramebufferCreateInfo framebufferCI{};
-		framebufferCI.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferCI.renderPass = renderpass;
-		framebufferCI.attachmentCount = 1;
-		framebufferCI.pAttachments = &textures.lutBrdf.view;
-		framebufferCI.width = dim;
-		framebufferCI.height = dim;
-		framebufferCI.layers = 1;
-
-		VkFramebuffer framebuffer;
-		VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferCI, nullptr, &framebuffer));
-
-		// Desriptors
-		VkDescriptorSetLayout descriptorsetlayout;
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		};
 		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
 		descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorsetlayout));
+		descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+		descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &gpuDriven.descriptorSetLayout));
 
-		// Pipeline layout
-		VkPipelineLayout pipelinelayout;
+		// Frustum planes and number of draw records
+		VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec4) * 6 + sizeof(uint32_t) };
 		VkPipelineLayoutCreateInfo pipelineLayoutCI{};
 		pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutCI.setLayoutCount = 1;
-		pipelineLayoutCI.pSetLayouts = &descriptorsetlayout;
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelinelayout));
-
-		// Pipeline
-		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
-		inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-		VkPipelineRasterizationStateCreateInfo rasterizationStateCI{};
-		rasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-		rasterizationStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizationStateCI.lineWidth = 1.0f;
-
-		VkPipelineColorBlendAttachmentState blendAttachmentState{};
-		blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		blendAttachmentState.blendEnable = VK_FALSE;
-
-		VkPipelineColorBlendStateCreateInfo colorBlendStateCI{};
-		colorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlendStateCI.attachmentCount = 1;
-		colorBlendStateCI.pAttachments = &blendAttachmentState;
+		pipelineLayoutCI.pSetLayouts = &gpuDriven.descriptorSetLayout;
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &gpuDriven.pipelineLayout));
 
-		VkPipelineDepthStencilStateCreateInfo depthStencilStateCI{};
-		depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthStencilStateCI.depthTestEnable = VK_FALSE;
-		depthStencilStateCI.depthWriteEnable = VK_FALSE;
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthStencilStateCI.front = depthStencilStateCI.back;
-		depthStencilStateCI.back.compareOp = VK_COMPARE_OP_ALWAYS;
+		VkComputePipelineCreateInfo computePipelineCI{};
+		computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineCI.layout = gpuDriven.pipelineLayout;
+		computePipelineCI.stage = loadShader(device, "cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(createComputePipeline(computePipelineCI, &gpuDriven.pipeline));
+		vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
 
-		VkPipelineViewportStateCreateInfo viewportStateCI{};
-		viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportStateCI.viewportCount = 1;
-		viewportStateCI.scissorCount = 1;
+		gpuDriven.enabled = true;
+	}
 
-		VkPipelineMultisampleStateCreateInfo multisampleStateCI{};
-		multisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	// KTX file storing a generated image based lighting map, the name contains a hash of all inputs that affect the generated data
+	std::string getIBLCacheFileName(const std::string& name, uint64_t key)
+	{
+		std::stringstream fileName;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+		fileName << androidApp->activity->internalDataPath << "/";
+#endif
+		fileName << "iblcache/" << name << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".ktx";
+		return fileName.str();
+	}
 
-		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-		VkPipelineDynamicStateCreateInfo dynamicStateCI{};
-		dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
-		dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-		
-		VkPipelineVertexInputStateCreateInfo emptyInputStateCI{};
-		emptyInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	static gli::format getGliFormat(VkFormat format)
+	{
+		switch (format) {
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				return gli::FORMAT_RGBA32_SFLOAT_PACK32;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				return gli::FORMAT_RGBA16_SFLOAT_PACK16;
+			case VK_FORMAT_R16G16_SFLOAT:
+				return gli::FORMAT_RG16_SFLOAT_PACK16;
+			case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+				return gli::FORMAT_RG11B10_UFLOAT_PACK32;
+			case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+				return gli::FORMAT_RGB9E5_UFLOAT_PACK32;
+			default:
+				return gli::FORMAT_UNDEFINED;
+		}
+	}
 
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+	static uint32_t getFormatSize(VkFormat format)
+	{
+		switch (format) {
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				return 16;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				return 8;
+			case VK_FORMAT_R16G16_SFLOAT:
+			case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+			case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+				return 4;
+			default:
+				return 0;
+		}
+	}
 
-		VkGraphicsPipelineCreateInfo pipelineCI{};
-		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineCI.layout = pipelinelayout;
-		pipelineCI.renderPass = renderpass;
-		pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
-		pipelineCI.pVertexInputState = &emptyInputStateCI;
-		pipelineCI.pRasterizationState = &rasterizationStateCI;
-		pipelineCI.pColorBlendState = &colorBlendStateCI;
-		pipelineCI.pMultisampleState = &multisampleStateCI;
-		pipelineCI.pViewportState = &viewportStateCI;
-		pipelineCI.pDepthStencilState = &depthStencilStateCI;
-		pipelineCI.pDynamicState = &dynamicStateCI;
-		pipelineCI.stageCount = 2;
-		pipelineCI.pStages = shaderStages.data();
+	static VkDeviceSize getMipChainSize(VkFormat format, uint32_t dim, uint32_t mipLevels, uint32_t layerCount)
+	{
+		VkDeviceSize size = 0;
+		for (uint32_t m = 0; m < mipLevels; m++) {
+			const VkDeviceSize mipDim = std::max(dim >> m, 1u);
+			size += mipDim * mipDim * getFormatSize(format) * layerCount;
+		}
+		return size;
+	}
 
-		// Look-up-table (from BRDF) pipeline		
-		shaderStages = {
-			loadShader(device, "genbrdflut.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-			loadShader(device, "genbrdflut.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	/*
+		Select the formats for the generated cube maps
+		If the requested packed format can't be sampled with linear filtering, the other packed format is tried before falling back to the default formats
+	*/
+	void selectIBLFormats()
+	{
+		if (iblFormats.requested == VK_FORMAT_UNDEFINED) {
+			return;
+		}
+		const std::vector<VkFormat> candidates = {
+			iblFormats.requested,
+			(iblFormats.requested == VK_FORMAT_B10G11R11_UFLOAT_PACK32) ? VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 : VK_FORMAT_B10G11R11_UFLOAT_PACK32
 		};
-		VkPipeline pipeline;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-		for (auto shaderStage : shaderStages) {
-			vkDestroyShaderModule(device, shaderStage.module, nullptr);
+		VkFormat format = vulkanDevice->getSupportedFormat(candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+		// The packed texels are written to an R32_UINT storage image, which is then copied to the packed image (both formats are in the same 32 bit compatibility class)
+		if (!vulkanDevice->formatSupported(VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+			format = VK_FORMAT_UNDEFINED;
 		}
+		if (format == VK_FORMAT_UNDEFINED) {
+			std::cerr << "Packed image based lighting formats are not supported, using default formats" << std::endl;
+			return;
+		}
+		if (format != iblFormats.requested) {
+			std::cerr << "Requested image based lighting format is not supported, using " << ((format == VK_FORMAT_B10G11R11_UFLOAT_PACK32) ? "b10g11r11" : "e5b9g9r9") << " instead" << std::endl;
+		}
+		iblFormats.irradiance = format;
+		iblFormats.prefiltered = format;
+	}
 
-		// Render
-		VkClearValue clearValues[1];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-
-		VkRenderPassBeginInfo renderPassBeginInfo{};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = renderpass;
-		renderPassBeginInfo.renderArea.extent.width = dim;
-		renderPassBeginInfo.renderArea.extent.height = dim;
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = clearValues;
-		renderPassBeginInfo.framebuffer = framebuffer;
-
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		VkViewport viewport{};
-		viewport.width = (float)dim;
-		viewport.height = (float)dim;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.extent.width = dim;
-		scissor.extent.height = dim;
-
-		vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-		vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-		vkCmdDraw(cmdBuf, 3, 1, 0, 0);
-		vkCmdEndRenderPass(cmdBuf);
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
+	// State of an image based lighting map generation between submission and finishing
+	struct IBLGeneration {
+		enum Target { IRRADIANCE = 0, PREFILTEREDENV = 1, BRDFLUT = 2 };
 
-		vkQueueWaitIdle(queue);
+		struct TargetInfo {
+			Target type;
+			vks::Texture* texture;
+			std::string name;
+			VkFormat format;
+			uint32_t dim;
+			uint32_t layerCount;
+			std::string shader;
+			bool packed;
+			uint32_t mipLevels;
+			// Image written by the compute shaders, a separate R32_UINT image for packed formats
+			VkImage storageImage;
+			VkImage packingImage;
+			vks::Allocation packingMemory;
+			VkPipeline pipeline;
+			std::vector<VkImageView> mipViews;
+			std::vector<VkDescriptorSet> descriptorSets;
+			std::string cacheFileName;
+			gli::texture cachedData;
+			bool cached;
+			VkDeviceSize stagingOffset;
+			VkDeviceSize size;
+		};
 
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+		// Spherical harmonics projection of the environment for diffuse irradiance, replaces the irradiance cube map
+		struct SHProjection {
+			VkDescriptorSetLayout descriptorSetLayout;
+			VkDescriptorPool descriptorPool;
+			VkDescriptorSet descriptorSet;
+			VkPipelineLayout pipelineLayout;
+			VkPipeline pipeline;
+			Buffer coefficients;
+		};
 
-		textures.lutBrdf.descriptor.imageView = textures.lutBrdf.view;
-		textures.lutBrdf.descriptor.sampler = textures.lutBrdf.sampler;
-		textures.lutBrdf.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		textures.lutBrdf.device = vulkanDevice;
+		std::vector<TargetInfo> targets;
+		bool generateSH = false;
+		SHProjection shProjection{};
+		Buffer stagingBuffer;
+		uint32_t descriptorSetCount = 0;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		bool readback = false;
+		// GPU time of each generation stage
+		vks::GPUProfiler profiler;
+		// Upload of the environment cube map recorded into the same command buffer
+		VkBuffer environmentStagingBuffer = VK_NULL_HANDLE;
+		vks::Allocation environmentStagingMemory{};
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		// Signaled once the generation has finished on the GPU
+		VkFence fence = VK_NULL_HANDLE;
+		std::chrono::high_resolution_clock::time_point tStart;
+	};
 
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
-	}
+	// Background loading of environments selected at runtime, see loadEnvironmentAsync
+	struct EnvironmentLoader {
+		std::thread thread;
+		std::atomic<bool> dataLoaded{ false };
+		// Set from starting the worker thread until the new maps have replaced the current ones
+		bool busy = false;
+		std::string queuedFileName;
+		// Written by the worker thread
+		gli::texture_cube data;
+		uint64_t hash = 0;
+		// Maps for the new environment, not used for rendering until their generation has finished
+		vks::TextureCubeMap environmentCube;
+		vks::TextureCubeMap irradianceCube;
+		vks::TextureCubeMap prefilteredCube;
+		IBLGeneration generation;
+		// Maps replaced by the last switch, along with a bit for each frame whose descriptor sets still reference them
+		vks::TextureCubeMap retiredEnvironmentCube;
+		vks::TextureCubeMap retiredIrradianceCube;
+		vks::TextureCubeMap retiredPrefilteredCube;
+		uint32_t outdatedFrames = 0;
+	} environmentLoader;
 
 	/*
-		Offline generation for the cube maps used for PBR lighting		
-		- Irradiance cube map
-		- Pre-filterd environment cubemap
+		Generate the maps used for image based lighting with compute shaders
+		- Irradiance cube map, or spherical harmonics coefficients for diffuse irradiance if enabled
+		- Pre-filtered environment cube map
+		- BRDF integration map storing roughness/NdotV as a look-up-table (doesn't depend on the environment, so it's only generated once)
+		The cube maps can optionally be stored in packed formats, see selectIBLFormats
+		All mip levels are written as storage images and all dispatches are recorded into a single command buffer
+		Maps found in the on-disk cache are uploaded in the same command buffer instead, newly generated maps are read back and stored in the cache
+		Generation is split into recording (and submitting) and finishing, so the maps for a new environment can be generated while the current one is still in use
 	*/
-	void generateCubemaps()
+	void recordIBLGeneration(IBLGeneration& generation, VkCommandBuffer cmdBuf, vks::TextureCubeMap& environmentCube, vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& prefilteredCube, uint64_t environmentHash)
 	{
-		enum Target { IRRADIANCE = 0, PREFILTEREDENV = 1 };
+		generation.generateSH = (shaderValuesParams.shIrradiance > 0.0f);
+		const bool packedIrradiance = (iblFormats.irradiance != VK_FORMAT_R32G32B32A32_SFLOAT);
+		const bool packedPrefiltered = (iblFormats.prefiltered != VK_FORMAT_R16G16B16A16_SFLOAT);
+		if (!generation.generateSH) {
+			generation.targets.push_back({ IBLGeneration::IRRADIANCE, &irradianceCube, "irradiance", iblFormats.irradiance, 64, 6, packedIrradiance ? "irradiancecube_packed.comp.spv" : "irradiancecube.comp.spv", packedIrradiance });
+		}
+		generation.targets.push_back({ IBLGeneration::PREFILTEREDENV, &prefilteredCube, "prefiltered", iblFormats.prefiltered, 512, 6, packedPrefiltered ? "prefilterenvmap_packed.comp.spv" : "prefilterenvmap.comp.spv", packedPrefiltered });
+		if (textures.lutBrdf.image == VK_NULL_HANDLE) {
+			// Two channel storage images are optional, fall back to a four channel format with mandatory storage support
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R16G16_SFLOAT, &formatProperties);
+			if (enabledFeatures.shaderStorageImageExtendedFormats && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+				generation.targets.push_back({ IBLGeneration::BRDFLUT, &textures.lutBrdf, "brdflut", VK_FORMAT_R16G16_SFLOAT, 512, 1, "genbrdflut.comp.spv", false });
+			} else {
+				generation.targets.push_back({ IBLGeneration::BRDFLUT, &textures.lutBrdf, "brdflut", VK_FORMAT_R16G16B16A16_SFLOAT, 512, 1, "genbrdflut_rgba16f.comp.spv", false });
+			}
+		}
 
-		for (uint32_t target = 0; target < PREFILTEREDENV + 1; target++) {
+		struct PushBlockIrradiance {
+			float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
+			float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+		} pushBlockIrradiance;
+
+		struct PushBlockPrefilterEnv {
+			float roughness;
+			uint32_t numSamples = 32u;
+		} pushBlockPrefilterEnv;
+
+		// Sample count of the BRDF LUT shader (specialization constant default)
+		const uint32_t brdfLUTSamples = 1024u;
+
+		generation.descriptorSetCount = 0;
+		VkDeviceSize stagingSize = 0;
+		for (auto& target : generation.targets) {
+			// The BRDF LUT is only sampled at the base level
+			target.mipLevels = (target.layerCount == 6) ? static_cast<uint32_t>(floor(log2(target.dim))) + 1 : 1;
+			target.size = getMipChainSize(target.format, target.dim, target.mipLevels, target.layerCount);
+
+			// Look for a matching cached map, the key covers the cache version, the source environment (cubes only) and all filtering parameters
+			target.cached = false;
+			if (iblCache.enabled) {
+				std::stringstream key;
+				key << iblCache.version << target.name << target.format << target.dim << target.mipLevels;
+				switch (target.type) {
+					case IBLGeneration::IRRADIANCE:
+						key << environmentHash << pushBlockIrradiance.deltaPhi << pushBlockIrradiance.deltaTheta;
+						break;
+					case IBLGeneration::PREFILTEREDENV:
+						key << environmentHash << pushBlockPrefilterEnv.numSamples;
+						break;
+					case IBLGeneration::BRDFLUT:
+						key << brdfLUTSamples;
+						break;
+				}
+				const std::string keyString = key.str();
+				target.cacheFileName = getIBLCacheFileName(target.name, hashData(keyString.data(), keyString.size()));
+				std::ifstream cacheFile(target.cacheFileName);
+				if (cacheFile.good()) {
+					cacheFile.close();
+					target.cachedData = gli::load(target.cacheFileName);
+					// Reject files that don't match the layout of the target, e.g. partially written ones
+					target.cached = !target.cachedData.empty() &&
+						(target.cachedData.format() == getGliFormat(target.format)) &&
+						(target.cachedData.extent().x == static_cast<int>(target.dim)) &&
+						(target.cachedData.levels() == target.mipLevels) &&
+						(target.cachedData.faces() == target.layerCount) &&
+						(target.cachedData.size() == target.size);
+					if (!target.cached) {
+						std::cerr << "Ignoring invalid image based lighting cache file " << target.cacheFileName << std::endl;
+					}
+				}
+			}
 
-			vks::TextureCubeMap cubemap;
+			if (!target.cached) {
+				generation.descriptorSetCount += target.mipLevels;
+			}
+			// Staging memory is used for uploading cached maps and for reading back generated maps that are added to the cache
+			target.stagingOffset = stagingSize;
+			if (iblCache.enabled) {
+				stagingSize += target.size;
+			}
 
-			auto tStart = std::chrono::high_resolution_clock::now();
+			vks::Texture* texture = target.texture;
+			texture->device = vulkanDevice;
+			texture->width = target.dim;
+			texture->height = target.dim;
+			texture->mipLevels = target.mipLevels;
+			texture->layerCount = target.layerCount;
+
+			// Image
+			VkImageCreateInfo imageCI{};
+			imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = target.format;
+			imageCI.extent.width = target.dim;
+			imageCI.extent.height = target.dim;
+			imageCI.extent.depth = 1;
+			imageCI.mipLevels = target.mipLevels;
+			imageCI.arrayLayers = target.layerCount;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			// Cached and packed maps are filled with copies
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | ((target.cached || target.packed) ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+			imageCI.flags = (target.layerCount == 6) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+			VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &texture->image));
+			vulkanDevice->allocateImageMemory(texture->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->deviceMemory, vks::MemoryCategory::Environment);
+
+			// Packed formats don't support storage (and Vulkan 1.0 has no extended usage for storage views of them), so the compute shaders
+			// write the packed texels to an R32_UINT image of the same size, which is then copied to the map
+			target.storageImage = texture->image;
+			target.packingImage = VK_NULL_HANDLE;
+			if (target.packed && !target.cached) {
+				imageCI.format = VK_FORMAT_R32_UINT;
+				imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+				imageCI.flags = 0;
+				VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &target.packingImage));
+				vulkanDevice->allocateImageMemory(target.packingImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &target.packingMemory, vks::MemoryCategory::Environment);
+				target.storageImage = target.packingImage;
+			}
 
-			VkFormat format;
-			int32_t dim;
-
-			switch (target) {
-			case IRRADIANCE:
-				format = VK_FORMAT_R32G32B32A32_SFLOAT;
-				dim = 64;
-				break;
-			case PREFILTEREDENV:
-				format = VK_FORMAT_R16G16B16A16_SFLOAT;
-				dim = 512;
-				break;
-			};
+			// View used for sampling
+			VkImageViewCreateInfo viewCI{};
+			viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCI.viewType = (target.layerCount == 6) ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = target.format;
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, target.mipLevels, 0, target.layerCount };
+			viewCI.image = texture->image;
+			VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &texture->view));
+
+			// Views used for writing a single mip level (all faces for cube maps) from the compute shaders
+			if (!target.cached) {
+				target.mipViews.resize(target.mipLevels);
+				viewCI.viewType = (target.layerCount == 6) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+				viewCI.format = target.packed ? VK_FORMAT_R32_UINT : target.format;
+				viewCI.image = target.storageImage;
+				for (uint32_t m = 0; m < target.mipLevels; m++) {
+					viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, m, 1, 0, target.layerCount };
+					VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &target.mipViews[m]));
+				}
+			}
 
-			const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+			// Sampler
+			VkSamplerCreateInfo samplerCI{};
+			samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			samplerCI.magFilter = VK_FILTER_LINEAR;
+			samplerCI.minFilter = VK_FILTER_LINEAR;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.minLod = 0.0f;
+			samplerCI.maxLod = static_cast<float>(target.mipLevels);
+			samplerCI.maxAnisotropy = 1.0f;
+			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &texture->sampler));
+
+			texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			texture->updateDescriptor();
+		}
 
-			// Create target cubemap
-			{
-				// Image
-				VkImageCreateInfo imageCI{};
-				imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-				imageCI.imageType = VK_IMAGE_TYPE_2D;
-				imageCI.format = format;
-				imageCI.extent.width = dim;
-				imageCI.extent.height = dim;
-				imageCI.extent.depth = 1;
-				imageCI.mipLevels = numMips;
-				imageCI.arrayLayers = 6;
-				imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-				imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-				imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-				imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-				VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &cubemap.image));
-				VkMemoryRequirements memReqs;
-				vkGetImageMemoryRequirements(device, cubemap.image, &memReqs);
-				VkMemoryAllocateInfo memAllocInfo{};
-				memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-				memAllocInfo.allocationSize = memReqs.size;
-				memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-				VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &cubemap.deviceMemory));
-				VK_CHECK_RESULT(vkBindImageMemory(device, cubemap.image, cubemap.deviceMemory, 0));
-
-				// View
-				VkImageViewCreateInfo viewCI{};
-				viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-				viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-				viewCI.format = format;
-				viewCI.subresourceRange = {};
-				viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				viewCI.subresourceRange.levelCount = numMips;
-				viewCI.subresourceRange.layerCount = 6;
-				viewCI.image = cubemap.image;
-				VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &cubemap.view));
-
-				// Sampler
-				VkSamplerCreateInfo samplerCI{};
-				samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-				samplerCI.magFilter = VK_FILTER_LINEAR;
-				samplerCI.minFilter = VK_FILTER_LINEAR;
-				samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-				samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-				samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-				samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-				samplerCI.minLod = 0.0f;
-				samplerCI.maxLod = static_cast<float>(numMips);
-				samplerCI.maxAnisotropy = 1.0f;
-				samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-				VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &cubemap.sampler));
-			}
-
-			// FB, Att, RP, Pipe, etc.
-			VkAttachmentDescription attDesc{};
-			// Color attachment
-			attDesc.format = format;
-			attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-			attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpassDescription{};
-			subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpassDescription.colorAttachmentCount = 1;
-			subpassDescription.pColorAttachments = &colorReference;
-
-			// Use subpass dependencies for layout transitions
-			std::array<VkSubpassDependency, 2> dependencies;
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			// Renderpass
-			VkRenderPassCreateInfo renderPassCI{};
-			renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassCI.attachmentCount = 1;
-			renderPassCI.pAttachments = &attDesc;
-			renderPassCI.subpassCount = 1;
-			renderPassCI.pSubpasses = &subpassDescription;
-			renderPassCI.dependencyCount = 2;
-			renderPassCI.pDependencies = dependencies.data();
-			VkRenderPass renderpass;
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCI, nullptr, &renderpass));
-
-			struct Offscreen {
-				VkImage image;
-				VkImageView view;
-				VkDeviceMemory memory;
-				VkFramebuffer framebuffer;
-			} offscreen;
-
-			// Create offscreen framebuffer
-			{
-				// Image
-				VkImageCreateInfo imageCI{};
-				imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-				imageCI.imageType = VK_IMAGE_TYPE_2D;
-				imageCI.format = format;
-				imageCI.extent.width = dim;
-				imageCI.extent.height = dim;
-				imageCI.extent.depth = 1;
-				imageCI.mipLevels = 1;
-				imageCI.arrayLayers = 1;
-				imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-				imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-				imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-				imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-				VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &offscreen.image));
-				VkMemoryRequirements memReqs;
-				vkGetImageMemoryRequirements(device, offscreen.image, &memReqs);
-				VkMemoryAllocateInfo memAllocInfo{};
-				memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-				memAllocInfo.allocationSize = memReqs.size;
-				memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-				VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &offscreen.memory));
-				VK_CHECK_RESULT(vkBindImageMemory(device, offscreen.image, offscreen.memory, 0));
-
-				// View
-				VkImageViewCreateInfo viewCI{};
-				viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-				viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-				viewCI.format = format;
-				viewCI.flags = 0;
-				viewCI.subresourceRange = {};
-				viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				viewCI.subresourceRange.baseMipLevel = 0;
-				viewCI.subresourceRange.levelCount = 1;
-				viewCI.subresourceRange.baseArrayLayer = 0;
-				viewCI.subresourceRange.layerCount = 1;
-				viewCI.image = offscreen.image;
-				VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &offscreen.view));
-
-				// Framebuffer
-				VkFramebufferCreateInfo framebufferCI{};
-				framebufferCI.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-				framebufferCI.renderPass = renderpass;
-				framebufferCI.attachmentCount = 1;
-				framebufferCI.pAttachments = &offscreen.view;
-				framebufferCI.width = dim;
-				framebufferCI.height = dim;
-				framebufferCI.layers = 1;
-				VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferCI, nullptr, &offscreen.framebuffer));
-
-				VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.image = offscreen.image;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-				imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-				vkCmdPipelineBarrier(layoutCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-				vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
+		if (stagingSize > 0) {
+			generation.stagingBuffer.create(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingSize, true, vks::MemoryCategory::Staging);
+			for (auto& target : generation.targets) {
+				if (target.cached) {
+					memcpy(static_cast<char*>(generation.stagingBuffer.mapped) + target.stagingOffset, target.cachedData.data(), target.size);
+				}
+			}
+		}
+
+		// Buffer regions use the same layout as the KTX data: All mip levels of the first face, followed by all mip levels of the next face
+		auto getCopyRegions = [](const IBLGeneration::TargetInfo& target) {
+			std::vector<VkBufferImageCopy> copyRegions;
+			VkDeviceSize offset = target.stagingOffset;
+			for (uint32_t face = 0; face < target.layerCount; face++) {
+				for (uint32_t m = 0; m < target.mipLevels; m++) {
+					const uint32_t mipDim = std::max(target.dim >> m, 1u);
+					VkBufferImageCopy copyRegion{};
+					copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, m, face, 1 };
+					copyRegion.imageExtent = { mipDim, mipDim, 1 };
+					copyRegion.bufferOffset = offset;
+					copyRegions.push_back(copyRegion);
+					offset += mipDim * mipDim * getFormatSize(target.format);
+				}
 			}
+			return copyRegions;
+		};
 
+		if (generation.descriptorSetCount > 0) {
 			// Descriptors
-			VkDescriptorSetLayout descriptorsetlayout;
-			VkDescriptorSetLayoutBinding setLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+			// All targets share the same layout, with the environment map at binding 0 and the mip level to write at binding 1
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			};
 			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
 			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			descriptorSetLayoutCI.pBindings = &setLayoutBinding;
-			descriptorSetLayoutCI.bindingCount = 1;
-			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorsetlayout));
+			descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &generation.descriptorSetLayout));
 
-			// Descriptor Pool
-			VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 };
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, generation.descriptorSetCount },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, generation.descriptorSetCount },
+			};
 			VkDescriptorPoolCreateInfo descriptorPoolCI{};
 			descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-			descriptorPoolCI.poolSizeCount = 1;
-			descriptorPoolCI.pPoolSizes = &poolSize;
-			descriptorPoolCI.maxSets = 2;
-			VkDescriptorPool descriptorpool;
-			VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorpool));
-
-			// Descriptor sets
-			VkDescriptorSet descriptorset;
-			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-			descriptorSetAllocInfo.descriptorPool = descriptorpool;
-			descriptorSetAllocInfo.pSetLayouts = &descriptorsetlayout;
-			descriptorSetAllocInfo.descriptorSetCount = 1;
-			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorset));
-			VkWriteDescriptorSet writeDescriptorSet{};
-			writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			writeDescriptorSet.descriptorCount = 1;
-			writeDescriptorSet.dstSet = descriptorset;
-			writeDescriptorSet.dstBinding = 0;
-			writeDescriptorSet.pImageInfo = &textures.environmentCube.descriptor;
-			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
-
-			struct PushBlockIrradiance {
-				glm::mat4 mvp;
-				float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-				float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
-			} pushBlockIrradiance;
-
-			struct PushBlockPrefilterEnv {
-				glm::mat4 mvp;
-				float roughness;
-				uint32_t numSamples = 32u;
-			} pushBlockPrefilterEnv;
+			descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+			descriptorPoolCI.pPoolSizes = poolSizes.data();
+			descriptorPoolCI.maxSets = generation.descriptorSetCount;
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &generation.descriptorPool));
 
 			// Pipeline layout
-			VkPipelineLayout pipelinelayout;
-			VkPushConstantRange pushConstantRange{};
-			pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-
-			switch (target) {
-				case IRRADIANCE:
-					pushConstantRange.size = sizeof(PushBlockIrradiance);
-					break;
-				case PREFILTEREDENV:
-					pushConstantRange.size = sizeof(PushBlockPrefilterEnv);
-					break;
-			};
-
+			VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, static_cast<uint32_t>(std::max(sizeof(PushBlockIrradiance), sizeof(PushBlockPrefilterEnv))) };
 			VkPipelineLayoutCreateInfo pipelineLayoutCI{};
 			pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 			pipelineLayoutCI.setLayoutCount = 1;
-			pipelineLayoutCI.pSetLayouts = &descriptorsetlayout;
+			pipelineLayoutCI.pSetLayouts = &generation.descriptorSetLayout;
 			pipelineLayoutCI.pushConstantRangeCount = 1;
 			pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
-			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelinelayout));
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &generation.pipelineLayout));
+		}
+
+		for (auto& target : generation.targets) {
+			if (target.cached) {
+				continue;
+			}
+			target.descriptorSets.resize(target.mipLevels);
+			std::vector<VkDescriptorSetLayout> setLayouts(target.mipLevels, generation.descriptorSetLayout);
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = generation.descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = setLayouts.data();
+			descriptorSetAllocInfo.descriptorSetCount = target.mipLevels;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, target.descriptorSets.data()));
+			for (uint32_t m = 0; m < target.mipLevels; m++) {
+				VkDescriptorImageInfo storageImageInfo{ VK_NULL_HANDLE, target.mipViews[m], VK_IMAGE_LAYOUT_GENERAL };
+				std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+				writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				writeDescriptorSets[0].descriptorCount = 1;
+				writeDescriptorSets[0].dstSet = target.descriptorSets[m];
+				writeDescriptorSets[0].dstBinding = 0;
+				writeDescriptorSets[0].pImageInfo = &environmentCube.descriptor;
+				writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+				writeDescriptorSets[1].descriptorCount = 1;
+				writeDescriptorSets[1].dstSet = target.descriptorSets[m];
+				writeDescriptorSets[1].dstBinding = 1;
+				writeDescriptorSets[1].pImageInfo = &storageImageInfo;
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			}
 
 			// Pipeline
-			VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
-			inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-			inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-			VkPipelineRasterizationStateCreateInfo rasterizationStateCI{};
-			rasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-			rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-			rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-			rasterizationStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-			rasterizationStateCI.lineWidth = 1.0f;
-
-			VkPipelineColorBlendAttachmentState blendAttachmentState{};
-			blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-			blendAttachmentState.blendEnable = VK_FALSE;
-
-			VkPipelineColorBlendStateCreateInfo colorBlendStateCI{};
-			colorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-			colorBlendStateCI.attachmentCount = 1;
-			colorBlendStateCI.pAttachments = &blendAttachmentState;
-
-			VkPipelineDepthStencilStateCreateInfo depthStencilStateCI{};
-			depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-			depthStencilStateCI.depthTestEnable = VK_FALSE;
-			depthStencilStateCI.depthWriteEnable = VK_FALSE;
-			depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-			depthStencilStateCI.front = depthStencilStateCI.back;
-			depthStencilStateCI.back.compareOp = VK_COMPARE_OP_ALWAYS;
-
-			VkPipelineViewportStateCreateInfo viewportStateCI{};
-			viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-			viewportStateCI.viewportCount = 1;
-			viewportStateCI.scissorCount = 1;
-
-			VkPipelineMultisampleStateCreateInfo multisampleStateCI{};
-			multisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-			multisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-			
-			std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-			VkPipelineDynamicStateCreateInfo dynamicStateCI{};
-			dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-			dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
-			dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-
-			// Vertex input state
-			VkVertexInputBindingDescription vertexInputBinding = { 0, sizeof(vkglTF::Model::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
-			VkVertexInputAttributeDescription vertexInputAttribute = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
-
-			VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
-			vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-			vertexInputStateCI.vertexBindingDescriptionCount = 1;
-			vertexInputStateCI.pVertexBindingDescriptions = &vertexInputBinding;
-			vertexInputStateCI.vertexAttributeDescriptionCount = 1;
-			vertexInputStateCI.pVertexAttributeDescriptions = &vertexInputAttribute;
-
-			std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-
-			VkGraphicsPipelineCreateInfo pipelineCI{};
-			pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineCI.layout = pipelinelayout;
-			pipelineCI.renderPass = renderpass;
-			pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
-			pipelineCI.pVertexInputState = &vertexInputStateCI;
-			pipelineCI.pRasterizationState = &rasterizationStateCI;
-			pipelineCI.pColorBlendState = &colorBlendStateCI;
-			pipelineCI.pMultisampleState = &multisampleStateCI;
-			pipelineCI.pViewportState = &viewportStateCI;
-			pipelineCI.pDepthStencilState = &depthStencilStateCI;
-			pipelineCI.pDynamicState = &dynamicStateCI;
-			pipelineCI.stageCount = 2;
-			pipelineCI.pStages = shaderStages.data();
-			pipelineCI.renderPass = renderpass;
-
-			shaderStages[0] = loadShader(device, "filtercube.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			switch (target) {
-				case IRRADIANCE:
-					shaderStages[1] = loadShader(device, "irradiancecube.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-					break;
-				case PREFILTEREDENV:
-					shaderStages[1] = loadShader(device, "prefilterenvmap.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-					break;
-			};
-			VkPipeline pipeline;
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
-			for (auto shaderStage : shaderStages) {
-				vkDestroyShaderModule(device, shaderStage.module, nullptr);
-			}
-
-			// Render cubemap
-			VkClearValue clearValues[1];
-			clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
-
-			VkRenderPassBeginInfo renderPassBeginInfo{};
-			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBeginInfo.renderPass = renderpass;
-			renderPassBeginInfo.framebuffer = offscreen.framebuffer;
-			renderPassBeginInfo.renderArea.extent.width = dim;
-			renderPassBeginInfo.renderArea.extent.height = dim;
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValues;
-
-			std::vector<glm::mat4> matrices = {
-				glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-			};
+			VkComputePipelineCreateInfo computePipelineCI{};
+			computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			computePipelineCI.layout = generation.pipelineLayout;
+			computePipelineCI.stage = loadShader(device, target.shader, VK_SHADER_STAGE_COMPUTE_BIT);
+			// The packed variants select the packing function with a specialization constant
+			const uint32_t packedFormat = (target.format == VK_FORMAT_E5B9G9R9_UFLOAT_PACK32) ? 1 : 0;
+			VkSpecializationMapEntry specializationMapEntry{ 0, 0, sizeof(uint32_t) };
+			VkSpecializationInfo specializationInfo{ 1, &specializationMapEntry, sizeof(uint32_t), &packedFormat };
+			if (target.packed) {
+				computePipelineCI.stage.pSpecializationInfo = &specializationInfo;
+			}
+			VK_CHECK_RESULT(createComputePipeline(computePipelineCI, &target.pipeline));
+			vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+		}
 
-			VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+		// Spherical harmonics projection of the environment for diffuse irradiance, replaces the irradiance cube map
+		if (generation.generateSH) {
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &generation.shProjection.descriptorSetLayout));
 
-			VkViewport viewport{};
-			viewport.width = (float)dim;
-			viewport.height = (float)dim;
-			viewport.minDepth = 0.0f;
-			viewport.maxDepth = 1.0f;
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolCI{};
+			descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+			descriptorPoolCI.pPoolSizes = poolSizes.data();
+			descriptorPoolCI.maxSets = 1;
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &generation.shProjection.descriptorPool));
 
-			VkRect2D scissor{};
-			scissor.extent.width = dim;
-			scissor.extent.height = dim;
+			// The coefficients are read back on the host and passed to the shaders via the parameter uniform buffer
+			generation.shProjection.coefficients.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesParams.shCoefficients), true, vks::MemoryCategory::Environment);
 
-			VkImageSubresourceRange subresourceRange{};
-			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			subresourceRange.baseMipLevel = 0;
-			subresourceRange.levelCount = numMips;
-			subresourceRange.layerCount = 6;
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = generation.shProjection.descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = &generation.shProjection.descriptorSetLayout;
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &generation.shProjection.descriptorSet));
+			std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeDescriptorSets[0].descriptorCount = 1;
+			writeDescriptorSets[0].dstSet = generation.shProjection.descriptorSet;
+			writeDescriptorSets[0].dstBinding = 0;
+			writeDescriptorSets[0].pImageInfo = &environmentCube.descriptor;
+			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[1].descriptorCount = 1;
+			writeDescriptorSets[1].dstSet = generation.shProjection.descriptorSet;
+			writeDescriptorSets[1].dstBinding = 1;
+			writeDescriptorSets[1].pBufferInfo = &generation.shProjection.coefficients.descriptor;
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
-			// Change image layout for all cubemap faces to transfer destination
-			{
-				vulkanDevice->beginCommandBuffer(cmdBuf);
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.image = cubemap.image;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-				vulkanDevice->flushCommandBuffer(cmdBuf, queue, false);
-			}
-
-			for (uint32_t m = 0; m < numMips; m++) {
-				for (uint32_t f = 0; f < 6; f++) {
-
-					vulkanDevice->beginCommandBuffer(cmdBuf);
-
-					viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-					viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-					vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-					vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-
-					// Render scene from cube face's point of view
-					vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-					// Pass parameters for current pass using a push constant block
-					switch (target) {
-						case IRRADIANCE:
-							pushBlockIrradiance.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-							vkCmdPushConstants(cmdBuf, pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlockIrradiance), &pushBlockIrradiance);
-							break;
-						case PREFILTEREDENV:
-							pushBlockPrefilterEnv.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-							pushBlockPrefilterEnv.roughness = (float)m / (float)(numMips - 1);
-							vkCmdPushConstants(cmdBuf, pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlockPrefilterEnv), &pushBlockPrefilterEnv);
-							break;
-					};
+			VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+			pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipelineLayoutCI.setLayoutCount = 1;
+			pipelineLayoutCI.pSetLayouts = &generation.shProjection.descriptorSetLayout;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &generation.shProjection.pipelineLayout));
+
+			VkComputePipelineCreateInfo computePipelineCI{};
+			computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			computePipelineCI.layout = generation.shProjection.pipelineLayout;
+			computePipelineCI.stage = loadShader(device, "shirradiance.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(createComputePipeline(computePipelineCI, &generation.shProjection.pipeline));
+			vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+		}
 
-					vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-					vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelinelayout, 0, 1, &descriptorset, 0, NULL);
+		// The generation is profiled as a single frame with one scope per stage
+		uint32_t stageCount = generation.generateSH ? 1 : 0;
+		for (auto& target : generation.targets) {
+			if (!target.cached) {
+				stageCount++;
+			}
+		}
+		if (stageCount > 0) {
+			generation.profiler.create(vulkanDevice, 1, stageCount + 1);
+		}
 
-					VkDeviceSize offsets[1] = { 0 };
+		auto imageBarrier = [](VkImage image, const IBLGeneration::TargetInfo& target, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) {
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.oldLayout = oldLayout;
+			imageMemoryBarrier.newLayout = newLayout;
+			imageMemoryBarrier.srcAccessMask = srcAccessMask;
+			imageMemoryBarrier.dstAccessMask = dstAccessMask;
+			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, target.mipLevels, 0, target.layerCount };
+			return imageMemoryBarrier;
+		};
 
-					models.skybox.draw(cmdBuf);
+		// Transition all mip levels of all targets for uploading from the cache, writing from the compute shaders or copying the packed texels
+		std::vector<VkImageMemoryBarrier> imageMemoryBarriers;
+		for (auto& target : generation.targets) {
+			if (target.cached || target.packed) {
+				imageMemoryBarriers.push_back(imageBarrier(target.texture->image, target, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+			}
+			if (!target.cached) {
+				imageMemoryBarriers.push_back(imageBarrier(target.storageImage, target, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT));
+			}
+		}
+		vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageMemoryBarriers.size()), imageMemoryBarriers.data());
 
-					vkCmdEndRenderPass(cmdBuf);
+		for (auto& target : generation.targets) {
+			if (target.cached) {
+				std::vector<VkBufferImageCopy> copyRegions = getCopyRegions(target);
+				vkCmdCopyBufferToImage(cmdBuf, generation.stagingBuffer.buffer, target.texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+			}
+		}
 
-					VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-					subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-					subresourceRange.baseMipLevel = 0;
-					subresourceRange.levelCount = numMips;
-					subresourceRange.layerCount = 6;
+		generation.profiler.beginFrame(cmdBuf, 0, "Total");
+
+		// The stages don't depend on each other, so no barriers are required between the dispatches
+		if (generation.generateSH) {
+			generation.profiler.beginScope(cmdBuf, "spherical harmonics irradiance");
+			vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, generation.shProjection.pipeline);
+			vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, generation.shProjection.pipelineLayout, 0, 1, &generation.shProjection.descriptorSet, 0, nullptr);
+			vkCmdDispatch(cmdBuf, 1, 1, 1);
+			generation.profiler.endScope(cmdBuf);
+			VkBufferMemoryBarrier bufferMemoryBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+			bufferMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.buffer = generation.shProjection.coefficients.buffer;
+			bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+		}
+		for (auto& target : generation.targets) {
+			if (!target.cached) {
+				generation.profiler.beginScope(cmdBuf, target.name + " map with " + std::to_string(target.mipLevels) + " mip level(s)");
+				vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, target.pipeline);
+				for (uint32_t m = 0; m < target.mipLevels; m++) {
+					switch (target.type) {
+						case IBLGeneration::IRRADIANCE:
+							vkCmdPushConstants(cmdBuf, generation.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushBlockIrradiance), &pushBlockIrradiance);
+							break;
+						case IBLGeneration::PREFILTEREDENV:
+							pushBlockPrefilterEnv.roughness = (float)m / (float)(target.mipLevels - 1);
+							vkCmdPushConstants(cmdBuf, generation.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushBlockPrefilterEnv), &pushBlockPrefilterEnv);
+							break;
+						default:
+							break;
+					};
+					vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, generation.pipelineLayout, 0, 1, &target.descriptorSets[m], 0, nullptr);
+					const uint32_t mipDim = std::max(target.dim >> m, 1u);
+					vkCmdDispatch(cmdBuf, (mipDim + 7) / 8, (mipDim + 7) / 8, target.layerCount);
+				}
+				generation.profiler.endScope(cmdBuf);
+			}
+		}
+		generation.profiler.endFrame(cmdBuf);
+
+		// Generated images are copied to the packed maps and read back for storing them in the cache
+		generation.readback = iblCache.enabled && (generation.descriptorSetCount > 0);
+		imageMemoryBarriers.clear();
+		for (auto& target : generation.targets) {
+			if (!target.cached && (target.packed || generation.readback)) {
+				imageMemoryBarriers.push_back(imageBarrier(target.storageImage, target, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+			}
+		}
+		if (!imageMemoryBarriers.empty()) {
+			vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageMemoryBarriers.size()), imageMemoryBarriers.data());
+		}
+		for (auto& target : generation.targets) {
+			if (!target.cached && target.packed) {
+				std::vector<VkImageCopy> copyRegions(target.mipLevels);
+				for (uint32_t m = 0; m < target.mipLevels; m++) {
+					const uint32_t mipDim = std::max(target.dim >> m, 1u);
+					copyRegions[m].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, m, 0, target.layerCount };
+					copyRegions[m].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, m, 0, target.layerCount };
+					copyRegions[m].extent = { mipDim, mipDim, 1 };
+				}
+				vkCmdCopyImage(cmdBuf, target.packingImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+			}
+		}
+		if (generation.readback) {
+			// The R32_UINT images of packed maps contain the same texels as the maps
+			for (auto& target : generation.targets) {
+				if (!target.cached) {
+					std::vector<VkBufferImageCopy> copyRegions = getCopyRegions(target);
+					vkCmdCopyImageToBuffer(cmdBuf, target.storageImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, generation.stagingBuffer.buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+				}
+			}
+			VkBufferMemoryBarrier bufferMemoryBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+			bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.buffer = generation.stagingBuffer.buffer;
+			bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+		}
 
-					{
-						VkImageMemoryBarrier imageMemoryBarrier{};
-						imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-						imageMemoryBarrier.image = offscreen.image;
-						imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-						imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-						imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-						imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-						imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-						vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-					}
+		// Transition all targets for sampling in the fragment shaders
+		imageMemoryBarriers.clear();
+		for (auto& target : generation.targets) {
+			if (target.cached || target.packed) {
+				imageMemoryBarriers.push_back(imageBarrier(target.texture->image, target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+			} else if (generation.readback) {
+				// Targets that have been read back were already made available by the barrier for the copy
+				imageMemoryBarriers.push_back(imageBarrier(target.texture->image, target, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT));
+			} else {
+				imageMemoryBarriers.push_back(imageBarrier(target.texture->image, target, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+			}
+		}
+		vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageMemoryBarriers.size()), imageMemoryBarriers.data());
+	}
 
-					// Copy region for transfer from framebuffer to cube face
-					VkImageCopy copyRegion{};
-
-					copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-					copyRegion.srcSubresource.baseArrayLayer = 0;
-					copyRegion.srcSubresource.mipLevel = 0;
-					copyRegion.srcSubresource.layerCount = 1;
-					copyRegion.srcOffset = { 0, 0, 0 };
-
-					copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-					copyRegion.dstSubresource.baseArrayLayer = f;
-					copyRegion.dstSubresource.mipLevel = m;
-					copyRegion.dstSubresource.layerCount = 1;
-					copyRegion.dstOffset = { 0, 0, 0 };
-
-					copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-					copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-					copyRegion.extent.depth = 1;
-
-					vkCmdCopyImage(
-						cmdBuf,
-						offscreen.image,
-						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-						cubemap.image,
-						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-						1,
-						&copyRegion);
-
-					{
-						VkImageMemoryBarrier imageMemoryBarrier{};
-						imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-						imageMemoryBarrier.image = offscreen.image;
-						imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-						imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-						imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-						imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-						imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-						vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-					}
+	/*
+		Upload the environment cube map and generate the image based lighting maps for it in a single submission
+		The submission is signaled with the generation's fence, finishIBLGeneration needs to be called before the maps can be used
+	*/
+	void beginIBLGeneration(IBLGeneration& generation, const gli::texture_cube& environmentData, uint64_t environmentHash, vks::TextureCubeMap& environmentCube, vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& prefilteredCube)
+	{
+		generation = IBLGeneration();
+		generation.tStart = std::chrono::high_resolution_clock::now();
+		generation.commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		environmentCube.fromData(environmentData, VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, generation.commandBuffer, &generation.environmentStagingBuffer, &generation.environmentStagingMemory);
+		recordIBLGeneration(generation, generation.commandBuffer, environmentCube, irradianceCube, prefilteredCube, environmentHash);
+		VK_CHECK_RESULT(vkEndCommandBuffer(generation.commandBuffer));
+
+		VkFenceCreateInfo fenceCI{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceCI, nullptr, &generation.fence));
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &generation.commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, generation.fence));
+	}
 
-					vulkanDevice->flushCommandBuffer(cmdBuf, queue, false);
+	// Read back the results of a submitted generation and release all temporary resources, waits for the submission if it hasn't finished yet
+	void finishIBLGeneration(IBLGeneration& generation)
+	{
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &generation.fence, VK_TRUE, UINT64_MAX));
+		vkDestroyFence(device, generation.fence, nullptr);
+		generation.fence = VK_NULL_HANDLE;
+		vkFreeCommandBuffers(device, vulkanDevice->commandPool, 1, &generation.commandBuffer);
+		vkDestroyBuffer(device, generation.environmentStagingBuffer, nullptr);
+		vulkanDevice->freeMemory(generation.environmentStagingMemory);
+		// Cached maps aren't generated, so there are no times to report
+		iblGenerationTimes.clear();
+		if (generation.profiler.readResults(0, true)) {
+			iblGenerationTimes = generation.profiler.getResults();
+			for (auto& result : iblGenerationTimes) {
+				if (result.depth > 0) {
+					std::cout << "Generating " << result.name << " took " << result.time << " ms (GPU)" << std::endl;
+				}
+			}
+		}
+		generation.profiler.destroy();
+
+		for (auto& target : generation.targets) {
+			if (target.cached) {
+				std::cout << "Loaded " << target.name << " map from " << target.cacheFileName << std::endl;
+			} else if (generation.readback && createDirectory(target.cacheFileName.substr(0, target.cacheFileName.find_last_of('/')))) {
+				const char* data = static_cast<const char*>(generation.stagingBuffer.mapped) + target.stagingOffset;
+				const gli::extent2d extent(target.dim, target.dim);
+				bool saved;
+				if (target.layerCount == 6) {
+					gli::texture_cube texture(getGliFormat(target.format), extent, target.mipLevels);
+					memcpy(texture.data(), data, target.size);
+					saved = gli::save_ktx(texture, target.cacheFileName);
+				} else {
+					gli::texture2d texture(getGliFormat(target.format), extent, target.mipLevels);
+					memcpy(texture.data(), data, target.size);
+					saved = gli::save_ktx(texture, target.cacheFileName);
+				}
+				if (!saved) {
+					std::cerr << "Could not write image based lighting cache file " << target.cacheFileName << std::endl;
 				}
 			}
+			for (auto& view : target.mipViews) {
+				vkDestroyImageView(device, view, nullptr);
+			}
+			if (target.packingImage != VK_NULL_HANDLE) {
+				vkDestroyImage(device, target.packingImage, nullptr);
+				vulkanDevice->freeMemory(target.packingMemory);
+			}
+			if (target.pipeline) {
+				vkDestroyPipeline(device, target.pipeline, nullptr);
+			}
+		}
+		generation.stagingBuffer.destroy();
+		if (generation.descriptorSetCount > 0) {
+			vkDestroyDescriptorPool(device, generation.descriptorPool, nullptr);
+			vkDestroyDescriptorSetLayout(device, generation.descriptorSetLayout, nullptr);
+			vkDestroyPipelineLayout(device, generation.pipelineLayout, nullptr);
+		}
 
-			{
-				vulkanDevice->beginCommandBuffer(cmdBuf);
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.image = cubemap.image;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-				vulkanDevice->flushCommandBuffer(cmdBuf, queue, false);
-			}
-
-
-			vkDestroyRenderPass(device, renderpass, nullptr);
-			vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-			vkFreeMemory(device, offscreen.memory, nullptr);
-			vkDestroyImageView(device, offscreen.view, nullptr);
-			vkDestroyImage(device, offscreen.image, nullptr);
-			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
-			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-			vkDestroyPipeline(device, pipeline, nullptr);
-			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-
-			cubemap.descriptor.imageView = cubemap.view;
-			cubemap.descriptor.sampler = cubemap.sampler;
-			cubemap.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			cubemap.device = vulkanDevice;
-
-			switch (target) {
-				case IRRADIANCE:
-					textures.irradianceCube = cubemap;
-					break;
-				case PREFILTEREDENV:
-					textures.prefilteredCube = cubemap;
-					shaderValuesParams.prefilteredCubeMipLevels = static_cast<float>(numMips);
-					break;
-			};
+		if (generation.generateSH) {
+			memcpy(shaderValuesParams.shCoefficients, generation.shProjection.coefficients.mapped, sizeof(shaderValuesParams.shCoefficients));
+			generation.shProjection.coefficients.destroy();
+			vkDestroyPipeline(device, generation.shProjection.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, generation.shProjection.pipelineLayout, nullptr);
+			vkDestroyDescriptorPool(device, generation.shProjection.descriptorPool, nullptr);
+			vkDestroyDescriptorSetLayout(device, generation.shProjection.descriptorSetLayout, nullptr);
+		}
 
-			auto tEnd = std::chrono::high_resolution_clock::now();
-			auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-			std::cout << "Generating cube map with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+		// Compare the memory used by the cube maps against the default formats, without spherical harmonics an irradiance cube map would also be required
+		iblFormats.size = 0;
+		for (auto& target : generation.targets) {
+			if (target.type == IBLGeneration::PREFILTEREDENV) {
+				shaderValuesParams.prefilteredCubeMipLevels = static_cast<float>(target.mipLevels);
+			}
+			if (target.type != IBLGeneration::BRDFLUT) {
+				iblFormats.size += target.size;
+			}
 		}
+		iblFormats.defaultSize = getMipChainSize(VK_FORMAT_R32G32B32A32_SFLOAT, 64, 7, 6) + getMipChainSize(VK_FORMAT_R16G16B16A16_SFLOAT, 512, 10, 6);
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - generation.tStart).count();
+		std::cout << "Preparing image based lighting maps took " << tDiff << " ms" << std::endl;
 	}
 
 	/* 
@@ -1834,9 +2654,9 @@ public:
 	void prepareUniformBuffers()
 	{
 		for (auto &uniformBuffer : uniformBuffers) {
-			uniformBuffer.scene.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesScene));
-			uniformBuffer.skybox.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesSkybox));
-			uniformBuffer.params.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesParams));
+			uniformBuffer.scene.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesScene), true, vks::MemoryCategory::Uniforms);
+			uniformBuffer.skybox.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesSkybox), true, vks::MemoryCategory::Uniforms);
+			uniformBuffer.params.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(shaderValuesParams), true, vks::MemoryCategory::Uniforms);
 		}
 		updateUniformData();
 	}
@@ -1884,10 +2704,72 @@ public:
 		updateOverlay();
 	}
 
+	void getEnabledFeatures()
+	{
+		// Allows writing the BRDF LUT as a two channel storage image
+		if (deviceFeatures.shaderStorageImageExtendedFormats) {
+			enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+		}
+
+		if (gpuDriven.requested) {
+			// Culling is recorded into the graphics command buffer, so the graphics queue also needs to support compute
+			const uint32_t graphicsQueueFamily = vulkanDevice->getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT);
+			const bool graphicsQueueCompute = (vulkanDevice->queueFamilyProperties[graphicsQueueFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+			if (vulkanDevice->extensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) && deviceFeatures.multiDrawIndirect && deviceFeatures.drawIndirectFirstInstance && graphicsQueueCompute) {
+				enabledFeatures.multiDrawIndirect = VK_TRUE;
+				enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+				enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				gpuDriven.supported = true;
+			} else {
+				std::cout << "GPU driven rendering requires " << VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME << ", multiDrawIndirect and drawIndirectFirstInstance, using CPU draws instead\n";
+			}
+		}
+
+		const bool instanceSupport = std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end();
+
+		if (instanceSupport && vulkanDevice->extensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			memoryBudgetSupported = true;
+		}
+
+		if (bindless.requested) {
+			VkPhysicalDeviceDescriptorIndexingFeaturesEXT availableFeatures{};
+			availableFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+			if (instanceSupport && vulkanDevice->extensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) && vulkanDevice->extensionSupported(VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+				PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+				VkPhysicalDeviceFeatures2KHR deviceFeatures2{};
+				deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+				deviceFeatures2.pNext = &availableFeatures;
+				vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &deviceFeatures2);
+			}
+			if (availableFeatures.shaderSampledImageArrayNonUniformIndexing && availableFeatures.runtimeDescriptorArray && availableFeatures.descriptorBindingVariableDescriptorCount && availableFeatures.descriptorBindingPartiallyBound) {
+				bindless.descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+				bindless.descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+				bindless.descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+				bindless.descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+				bindless.descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+				deviceCreatepNextChain = &bindless.descriptorIndexingFeatures;
+				enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+				enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+				// The environment samplers of the scene set count against the same per stage limits
+				const VkPhysicalDeviceLimits& limits = deviceProperties.limits;
+				bindless.maxTextures = std::min({ limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages, 16384u }) - 3;
+				bindless.enabled = true;
+				std::cout << "Using bindless material textures (up to " << bindless.maxTextures << " textures)\n";
+			} else {
+				std::cout << "Bindless material textures require " << VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME << " with non-uniform indexing, runtime and partially bound arrays, using per material descriptor sets instead\n";
+			}
+		}
+	}
+
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 
+		if (memoryBudgetSupported) {
+			vulkanDevice->memoryAllocator->enableMemoryBudget(reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR")));
+		}
+
 		camera.type = Camera::CameraType::lookat;
 
 		camera.setPerspective(45.0f, (float)width / (float)height, 0.01f, 256.0f);
@@ -1903,7 +2785,13 @@ public:
 		uniformBuffers.resize(renderAhead);
 		descriptorSets.resize(renderAhead);
 		shaderMeshDataBuffers.resize(renderAhead);
+		shaderJointBuffers.resize(renderAhead);
 		descriptorSetsMeshData.resize(renderAhead);
+		if (gpuDriven.supported) {
+			gpuDriven.descriptorSets.resize(renderAhead);
+			gpuDriven.drawCommands.resize(renderAhead);
+			gpuDriven.drawCounts.resize(renderAhead);
+		}
 		// Command buffer execution fences
 		for (auto &waitFence : waitFences) {
 			VkFenceCreateInfo fenceCI{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, VK_FENCE_CREATE_SIGNALED_BIT };
@@ -1928,23 +2816,122 @@ public:
 			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, commandBuffers.data()));
 		}
 
+		stagingRing.create(vulkanDevice, renderAhead, 4 * 1024 * 1024);
+
+		gpuProfiler.create(vulkanDevice, renderAhead);
+		profiledBenchmarkSamples.resize(renderAhead, -1);
+
+		if (gpuDriven.supported) {
+			prepareGPUDriven();
+		}
+		prepareMaterialPipelineSets();
+		selectIBLFormats();
 		loadAssets();
-		generateBRDFLUT();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
+		// The material pipelines of the initial scene are included in the reported pipeline creation time
+		prepareRenderPipelines();
+
+		ui = new UI(vulkanDevice, renderPass, queue, [this](const VkGraphicsPipelineCreateInfo& pipelineCI, VkPipeline* pipeline) { return createGraphicsPipeline(pipelineCI, pipeline); }, settings.sampleCount);
+
+		std::cout << "Pipeline creation took " << pipelineCreationTime << " ms (" << (pipelineCacheWarm ? "warm" : "cold") << " pipeline cache)" << std::endl;
 
-		ui = new UI(vulkanDevice, renderPass, queue, pipelineCache, settings.sampleCount);
 		updateOverlay();
 
+		if (benchmark.active) {
+			startBenchmark();
+		}
+
 		prepared = true;
 	}
 
+	void startBenchmark()
+	{
+		benchmark.frameSeries = benchmark.addSeries("frame");
+		benchmark.cpuSeries = benchmark.addSeries("cpu");
+		benchmark.cameraRotation = camera.rotation;
+
+		std::stringstream driverVersion;
+		driverVersion << VK_VERSION_MAJOR(deviceProperties.driverVersion) << "." << VK_VERSION_MINOR(deviceProperties.driverVersion) << "." << VK_VERSION_PATCH(deviceProperties.driverVersion);
+		benchmark.addInfo("device", deviceProperties.deviceName);
+		benchmark.addInfo("driverVersion", driverVersion.str());
+		benchmark.addInfo("scene", sceneFileName);
+		benchmark.addInfo("resolution", std::to_string(width) + "x" + std::to_string(height));
+		benchmark.addInfo("sampleCount", std::to_string(settings.multiSampling ? settings.sampleCount : 1));
+		benchmark.addInfo("vsync", settings.vsync ? "true" : "false");
+		benchmark.addInfo("headless", settings.headless ? "true" : "false");
+		benchmark.addInfo("gpuDriven", gpuDriven.enabled ? "true" : "false");
+		benchmark.addInfo("bindless", bindless.enabled ? "true" : "false");
+		benchmark.addInfo("shIrradiance", (shaderValuesParams.shIrradiance > 0.0f) ? "true" : "false");
+		benchmark.addInfo("animationSampleRate", std::to_string(models.scene.animationSampleRate));
+		benchmark.addInfo("timestep", std::to_string(benchmark.timestep));
+		benchmark.addInfo("orbitSpeed", std::to_string(benchmark.orbitSpeed));
+		for (auto& result : iblGenerationTimes) {
+			benchmark.addInfo("iblGeneration." + result.name, std::to_string(result.time) + " ms");
+		}
+
+		std::cout << "Running benchmark with " << benchmark.warmupFrames << " warmup frames and " << benchmark.frameCount << " measured frames\n";
+	}
+
+	// Stores the times of the frame that has just been submitted and writes the results once all frames have been rendered
+	void updateBenchmark(const std::chrono::high_resolution_clock::time_point& tFrameStart, double waitTime)
+	{
+		if (benchmark.recording()) {
+			const uint32_t sample = benchmark.sampleIndex();
+			const double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tFrameStart).count() - waitTime;
+			benchmark.setValue(benchmark.cpuSeries, sample, cpuTime);
+			if (benchmark.frame > 0) {
+				benchmark.setValue(benchmark.frameSeries, sample, std::chrono::duration<double, std::milli>(tFrameStart - benchmark.tLastFrame).count());
+			}
+		}
+		benchmark.tLastFrame = tFrameStart;
+		benchmark.frame++;
+		if (benchmark.finished()) {
+			// Timestamps of the frames still in flight
+			vkDeviceWaitIdle(device);
+			for (uint32_t i = 0; i < renderAhead; i++) {
+				readFrameTimestamps(i);
+			}
+			benchmark.printSummary();
+			benchmark.save();
+			benchmark.active = false;
+			requestQuit();
+		}
+	}
+
+	// The frame's fence has signaled before this is called, so results are available and reading them doesn't stall
+	void readFrameTimestamps(uint32_t frame)
+	{
+		if (!gpuProfiler.readResults(frame)) {
+			return;
+		}
+		gpuProfilerResults = gpuProfiler.getResults();
+		const int64_t sample = profiledBenchmarkSamples[frame];
+		if (sample < 0) {
+			return;
+		}
+		// The root scope is stored as the GPU frame time, passes get a series named after their scope
+		for (size_t i = 0; i < gpuProfilerResults.size(); i++) {
+			std::string seriesName = "gpu";
+			if (i > 0) {
+				seriesName += "_" + gpuProfilerResults[i].name;
+				std::transform(seriesName.begin(), seriesName.end(), seriesName.begin(), [](char c) { return (c == ' ') ? '_' : static_cast<char>(tolower(c)); });
+			}
+			if (benchmark.gpuSeries.find(seriesName) == benchmark.gpuSeries.end()) {
+				benchmark.gpuSeries[seriesName] = benchmark.addSeries(seriesName);
+			}
+			benchmark.setValue(benchmark.gpuSeries[seriesName], static_cast<uint32_t>(sample), gpuProfilerResults[i].time);
+		}
+		profiledBenchmarkSamples[frame] = -1;
+	}
+
 	/*
 		Update ImGui user interface
 	*/
 	void updateOverlay()
 	{
+		VKS_TRACE_SCOPE("updateOverlay");
 		ImGuiIO& io = ImGui::GetIO();
 
 		ImVec2 lastDisplaySize = io.DisplaySize;
@@ -1966,12 +2953,21 @@ public:
 		ImGui::NewFrame();
 
 		ImGui::SetNextWindowPos(ImVec2(10, 10));
-		ImGui::SetNextWindowSize(ImVec2(200 * scale, (models.scene.animations.size() > 0 ? 500 : 420) * scale), ImGuiSetCond_Always);
+		ImGui::SetNextWindowSize(ImVec2(200 * scale, ((models.scene.animations.size() > 0 ? 580 : 500) + (gpuDriven.supported ? 40 : 0) + (gpuProfiler.supported ? 40 : 0) + 20) * scale), ImGuiSetCond_Always);
 		ImGui::Begin("Vulkan glTF 2.0 PBR", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 		ImGui::PushItemWidth(100.0f * scale);
 
 		ui->text("www.saschawillems.de");
 		ui->text("%.1d fps (%.2f ms)", lastFPS, (1000.0f / lastFPS));
+		if (gpuProfiler.supported) {
+			ui->text("GPU: %.2f ms", gpuProfilerResults.empty() ? 0.0 : gpuProfilerResults[0].time);
+		}
+		ui->text("%d of %d meshes visible", cullingStats.visible, cullingStats.visible + cullingStats.culled);
+		ui->text("%d draws, %d pipeline binds", renderStats.draws, renderStats.pipelineBinds);
+		ui->text("%d descriptor set binds", renderStats.descriptorSetBinds);
+		if (gpuDriven.enabled) {
+			ui->text("%d of %d GPU draws visible", gpuDriven.visibleDraws, gpuDriven.drawCount);
+		}
 
 		if (ui->header("Scene")) {
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -2019,9 +3015,7 @@ public:
 			}
 #endif
 			if (ui->combo("Environment##env", selectedEnvironment, environments)) {
-				vkDeviceWaitIdle(device);
-				loadEnvironment(environments[selectedEnvironment]);
-				setupDescriptors();
+				loadEnvironmentAsync(environments[selectedEnvironment]);
 			}
 		}
 
@@ -2030,6 +3024,7 @@ public:
 			ui->slider("Exposure", &shaderValuesParams.exposure, 0.1f, 10.0f);
 			ui->slider("Gamma", &shaderValuesParams.gamma, 0.1f, 4.0f);
 			ui->slider("IBL", &shaderValuesParams.scaleIBLAmbient, 0.0f, 1.0f);
+			ui->text("IBL maps: %.2f MB (%.2f MB saved)", iblFormats.size / (1024.0f * 1024.0f), (iblFormats.defaultSize - iblFormats.size) / (1024.0f * 1024.0f));
 		}
 
 		if (ui->header("Camera")) {
@@ -2054,6 +3049,44 @@ public:
 			if (ui->combo("PBR equation", &debugViewEquation, debugNamesEquation)) {
 				shaderValuesParams.debugViewEquation = static_cast<float>(debugViewEquation);
 			}
+			ui->checkbox("Frustum culling", &frustumCulling);
+			if (gpuDriven.supported) {
+				ui->checkbox("GPU driven", &gpuDriven.enabled);
+			}
+		}
+
+		// Collapsed by default as the number of scopes varies
+		if (gpuProfiler.supported && ImGui::CollapsingHeader("GPU profiler")) {
+			for (auto& result : gpuProfilerResults) {
+				ui->text("%*s%s: %.3f ms", result.depth * 2, "", result.name.c_str(), result.time);
+			}
+			if (!iblGenerationTimes.empty()) {
+				ui->text("IBL generation:");
+				for (auto& result : iblGenerationTimes) {
+					ui->text("%*s%s: %.3f ms", (result.depth + 1) * 2, "", result.name.c_str(), result.time);
+				}
+			}
+		}
+
+		// Collapsed by default as the number of categories and heaps varies
+		if (ImGui::CollapsingHeader("Memory")) {
+			const float toMB = 1.0f / (1024.0f * 1024.0f);
+			for (uint32_t i = 0; i < static_cast<uint32_t>(vks::MemoryCategory::Count); i++) {
+				const vks::MemoryAllocator::CategoryStats category = vulkanDevice->memoryAllocator->getCategoryStats(static_cast<vks::MemoryCategory>(i));
+				if (category.allocationCount > 0) {
+					ui->text("%s: %.2f MB", vks::getMemoryCategoryName(static_cast<vks::MemoryCategory>(i)), category.bytes * toMB);
+				}
+			}
+			const std::vector<vks::MemoryAllocator::HeapStats> heapStats = vulkanDevice->memoryAllocator->getHeapStats();
+			for (size_t i = 0; i < heapStats.size(); i++) {
+				if (heapStats[i].allocatedBytes == 0) {
+					continue;
+				}
+				ui->text("Heap %zu%s: %.1f / %.1f MB", i, (heapStats[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (local)" : "", heapStats[i].usedBytes * toMB, heapStats[i].allocatedBytes * toMB);
+				if (vulkanDevice->memoryAllocator->memoryBudgetEnabled()) {
+					ui->text("  budget: %.1f / %.1f MB", heapStats[i].usage * toMB, heapStats[i].budget * toMB);
+				}
+			}
 		}
 
 		if (models.scene.animations.size() > 0) {
@@ -2085,12 +3118,12 @@ public:
 				if (ui->vertexBuffer.buffer) {
 					ui->vertexBuffer.destroy();
 				}
-				ui->vertexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexBufferSize);
+				ui->vertexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexBufferSize, true, vks::MemoryCategory::Overlay);
 				ui->vertexBuffer.count = imDrawData->TotalVtxCount;
 				if (ui->indexBuffer.buffer) {
 					ui->indexBuffer.destroy();
 				}
-				ui->indexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indexBufferSize);
+				ui->indexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indexBufferSize, true, vks::MemoryCategory::Overlay);
 				ui->indexBuffer.count = imDrawData->TotalIdxCount;
 			}
 
@@ -2123,6 +3156,16 @@ public:
 			return;
 		}
 
+		VKS_TRACE_SCOPE("Frame");
+		const auto tFrameStart = std::chrono::high_resolution_clock::now();
+		// Time spent waiting for the GPU and the swapchain, which isn't counted as CPU time by the benchmark
+		double waitTime = 0.0;
+		if (benchmark.active) {
+			// Animations and the camera advance by a fixed step per frame, so every run renders the same sequence of frames
+			frameTimer = benchmark.timestep;
+			camera.setRotation(benchmark.cameraRotation + glm::vec3(0.0f, benchmark.orbitSpeed * benchmark.time(), 0.0f));
+		}
+
 		ui->updateTimer -= frameTimer;
 		if (ui->updateTimer <= 0.0f) {
 			updateOverlay();
@@ -2141,21 +3184,58 @@ public:
 		}
 #endif
 
+		auto tWait = std::chrono::high_resolution_clock::now();
 		VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[frameIndex], VK_TRUE, UINT64_MAX));
+		waitTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tWait).count();
 		VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[frameIndex]));
-
-		VkResult acquire = swapChain.acquireNextImage(presentCompleteSemaphores[frameIndex], &imageIndex);
-		if ((acquire == VK_ERROR_OUT_OF_DATE_KHR) || (acquire == VK_SUBOPTIMAL_KHR)) {
-			windowResize();
+		readFrameTimestamps(frameIndex);
+		stagingRing.beginFrame(frameIndex);
+		updateEnvironmentLoader();
+
+		// Draw counts written by the culling shader in the last use of this frame's buffers
+		if (gpuDriven.enabled) {
+			const uint32_t* drawCounts = static_cast<const uint32_t*>(gpuDriven.drawCounts[frameIndex].mapped);
+			gpuDriven.visibleDraws = 0;
+			for (size_t i = 0; i < gpuDriven.buckets.size(); i++) {
+				if (!gpuDriven.buckets[i].ordered) {
+					gpuDriven.visibleDraws += drawCounts[i];
+				}
+			}
 		}
-		else {
-			VK_CHECK_RESULT(acquire);
+
+		if (settings.headless) {
+			// Offscreen images are used in turn, this frame's fence wait guarantees that the image is no longer in use
+			imageIndex = (imageIndex + 1) % swapChain.imageCount;
+		} else {
+			tWait = std::chrono::high_resolution_clock::now();
+			VkResult acquire = swapChain.acquireNextImage(presentCompleteSemaphores[frameIndex], &imageIndex);
+			waitTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tWait).count();
+			if ((acquire == VK_ERROR_OUT_OF_DATE_KHR) || (acquire == VK_SUBOPTIMAL_KHR)) {
+				windowResize();
+			}
+			else {
+				VK_CHECK_RESULT(acquire);
+			}
 		}
 		
-		recordCommandBuffer();
+		// Update animation and mesh data for this frame before recording, so uploads end up in this frame's command buffer
+		if (!paused) {
+			if ((animate) && (models.scene.animations.size() > 0)) {
+				animationTimer += frameTimer;
+				if (animationTimer > models.scene.animations[animationIndex].end) {
+					animationTimer -= models.scene.animations[animationIndex].end;
+				}
+				models.scene.updateAnimation(animationIndex, animationTimer);
+			}
+		}
+		// Only meshes that changed since this frame's buffers were last written are uploaded
+		updateMeshDataBuffer(frameIndex);
 
-		// Update UBOs
+		// Update UBOs before recording, culling uses the current camera and model matrices
 		updateUniformData();
+
+		recordCommandBuffer();
+
 		UniformBufferSet currentUB = uniformBuffers[frameIndex];
 		memcpy(currentUB.scene.mapped, &shaderValuesScene, sizeof(shaderValuesScene));
 		memcpy(currentUB.params.mapped, &shaderValuesParams, sizeof(shaderValuesParams));
@@ -2165,34 +3245,37 @@ public:
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submitInfo.pWaitDstStageMask = &waitDstStageMask;
+		// Nothing is presented in headless mode, so there are no semaphores to wait on or signal
 		submitInfo.pWaitSemaphores = &presentCompleteSemaphores[frameIndex];
-		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.waitSemaphoreCount = settings.headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = &renderCompleteSemaphores[imageIndex];
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.signalSemaphoreCount = settings.headless ? 0 : 1;
 		submitInfo.pCommandBuffers = &commandBuffers[frameIndex];
 		submitInfo.commandBufferCount = 1;
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[frameIndex]));
 
-		VkResult present = swapChain.queuePresent(queue, imageIndex, renderCompleteSemaphores[imageIndex]);
-		if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
-			if (present == VK_ERROR_OUT_OF_DATE_KHR) {
-				windowResize();
-				return;
-			}
-			else {
-				VK_CHECK_RESULT(present);
-			}
+		if (gpuProfiler.supported) {
+			profiledBenchmarkSamples[frameIndex] = benchmark.recording() ? static_cast<int64_t>(benchmark.sampleIndex()) : -1;
+		}
+		// Presentation may block (e.g. with vsync) and is not counted as CPU time
+		if (benchmark.active) {
+			updateBenchmark(tFrameStart, waitTime);
 		}
 
-		if (!paused) {
-			if ((animate) && (models.scene.animations.size() > 0)) {
-				animationTimer += frameTimer;
-				if (animationTimer > models.scene.animations[animationIndex].end) {
-					animationTimer -= models.scene.animations[animationIndex].end;
+		if (!settings.headless) {
+			VkResult present = swapChain.queuePresent(queue, imageIndex, renderCompleteSemaphores[imageIndex]);
+			if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
+				if (present == VK_ERROR_OUT_OF_DATE_KHR) {
+					windowResize();
+					return;
+				}
+				else {
+					VK_CHECK_RESULT(present);
 				}
-				models.scene.updateAnimation(animationIndex, animationTimer);
-				updateMeshDataBuffer(frameIndex);
 			}
+		}
+
+		if (!paused) {
 			updateParams();
 		}
 
@@ -2225,7 +3308,9 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 	for (int32_t i = 0; i < __argc; i++) { VulkanApplication::args.push_back(__argv[i]); };
 	vulkanApplication = new VulkanApplication();
 	vulkanApplication->initVulkan();
-	vulkanApplication->setupWindow(hInstance, WndProc);
+	if (!vulkanApplication->settings.headless) {
+		vulkanApplication->setupWindow(hInstance, WndProc);
+	}
 	vulkanApplication->prepare();
 	vulkanApplication->renderLoop();
 	delete(vulkanApplication);
@@ -2265,7 +3350,9 @@ int main(const int argc, const char *argv[])
 	for (size_t i = 0; i < argc; i++) { VulkanApplication::args.push_back(argv[i]); };
 	vulkanApplication = new VulkanApplication();
 	vulkanApplication->initVulkan();
-	vulkanApplication->setupWindow();
+	if (!vulkanApplication->settings.headless) {
+		vulkanApplication->setupWindow();
+	}
 	vulkanApplication->prepare();
 	vulkanApplication->renderLoop();
 	delete(vulkanApplication);
@@ -2284,7 +3371,9 @@ int main(const int argc, const char *argv[])
 	for (size_t i = 0; i < argc; i++) { VulkanApplication::args.push_back(argv[i]); };
 	vulkanApplication = new VulkanApplication();
 	vulkanApplication->initVulkan();
-	vulkanApplication->setupWindow();
+	if (!vulkanApplication->settings.headless) {
+		vulkanApplication->setupWindow();
+	}
 	vulkanApplication->prepare();
 	vulkanApplication->renderLoop();
 	delete(vulkanApplication);
@@ -2298,7 +3387,9 @@ int main(const int argc, const char *argv[])
 		for (size_t i = 0; i < argc; i++) { VulkanApplication::args.push_back(argv[i]); };
 		vulkanApplication = new VulkanApplication();
 		vulkanApplication->initVulkan();
-		vulkanApplication->setupWindow();
+		if (!vulkanApplication->settings.headless) {
+			vulkanApplication->setupWindow();
+		}
 		vulkanApplication->prepare();
 		vulkanApplication->renderLoop();
 		delete(vulkanApplication);